@@ -0,0 +1,176 @@
+#include "appendfile.h"
+
+#include <algorithm>
+#include <ios>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif	// !_WIN32
+
+
+
+#ifdef _WIN32
+
+AppendFile::AppendFile(const std::string& filePath, bool truncate)
+	: path(filePath)
+{
+	// FlushFileBuffers() requires write access, which is not limited to the end of the file, so the file pointer is moved there
+	HANDLE file = CreateFileA(filePath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, truncate ? CREATE_ALWAYS : OPEN_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::ios_base::failure("Failed to open " + filePath, std::error_code(static_cast<int>(GetLastError()), std::system_category()));
+
+	LARGE_INTEGER zero = {};
+	if (!SetFilePointerEx(file, zero, nullptr, FILE_END))
+	{
+		auto error = static_cast<int>(GetLastError());
+		CloseHandle(file);
+		throw std::ios_base::failure("Failed to open " + filePath, std::error_code(error, std::system_category()));
+	}
+
+	this->fileHandle = file;
+}	// ctor
+
+bool AppendFile::isOpen() const noexcept
+{
+	return this->fileHandle != nullptr;
+}
+
+void AppendFile::write(const void* data, std::size_t size)
+{
+	const char* p = static_cast<const char*>(data);
+	while (size > 0)
+	{
+		DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1u << 30)), written = 0;
+		if (!WriteFile(this->fileHandle, p, chunk, &written, nullptr))
+			throw std::ios_base::failure("Failed to write " + this->path, std::error_code(static_cast<int>(GetLastError()), std::system_category()));
+
+		p += written;
+		size -= written;
+	}
+}	// write
+
+void AppendFile::sync()
+{
+	if (!FlushFileBuffers(this->fileHandle))
+		throw std::ios_base::failure("Failed to sync " + this->path, std::error_code(static_cast<int>(GetLastError()), std::system_category()));
+}	// sync
+
+void AppendFile::syncDirectory(const std::string& /*directoryPath*/)
+{
+}	// syncDirectory
+
+void AppendFile::close() noexcept
+{
+	if (this->fileHandle)
+		CloseHandle(this->fileHandle);
+
+	this->fileHandle = nullptr;
+}	// close
+
+#else
+
+AppendFile::AppendFile(const std::string& filePath, bool truncate)
+	: path(filePath)
+{
+	this->fd = ::open(filePath.c_str(), O_WRONLY | O_APPEND | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+	if (this->fd < 0)
+		throw std::ios_base::failure("Failed to open " + filePath, std::error_code(errno, std::generic_category()));
+}	// ctor
+
+bool AppendFile::isOpen() const noexcept
+{
+	return this->fd >= 0;
+}
+
+void AppendFile::write(const void* data, std::size_t size)
+{
+	const char* p = static_cast<const char*>(data);
+	while (size > 0)
+	{
+		ssize_t written = ::write(this->fd, p, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		if (written < 0)
+			throw std::ios_base::failure("Failed to write " + this->path, std::error_code(errno, std::generic_category()));
+
+		p += written;
+		size -= static_cast<std::size_t>(written);
+	}
+}	// write
+
+void AppendFile::sync()
+{
+	// The metadata which are not needed to read the data back (e.g. the modification time) are not synced unless the system lacks fdatasync()
+#ifdef __APPLE__
+	int result = ::fsync(this->fd);
+#else
+	int result = ::fdatasync(this->fd);
+#endif	// !__APPLE__
+	if (result != 0)
+		throw std::ios_base::failure("Failed to sync " + this->path, std::error_code(errno, std::generic_category()));
+}	// sync
+
+void AppendFile::syncDirectory(const std::string& directoryPath)
+{
+	std::string path = directoryPath.empty() ? std::string(".") : directoryPath;
+	int dirFd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+	if (dirFd < 0)
+		throw std::ios_base::failure("Failed to open the directory " + path, std::error_code(errno, std::generic_category()));
+
+	int result = ::fsync(dirFd), error = errno;
+	::close(dirFd);
+	if (result != 0)
+		throw std::ios_base::failure("Failed to sync the directory " + path, std::error_code(error, std::generic_category()));
+}	// syncDirectory
+
+void AppendFile::close() noexcept
+{
+	if (this->fd >= 0)
+		::close(this->fd);
+
+	this->fd = -1;
+}	// close
+
+#endif	// !_WIN32
+
+
+AppendFile::AppendFile(AppendFile&& other) noexcept
+	: path(std::move(other.path))
+#ifdef _WIN32
+	, fileHandle(std::exchange(other.fileHandle, nullptr))
+#else
+	, fd(std::exchange(other.fd, -1))
+#endif	// !_WIN32
+{
+}
+
+AppendFile& AppendFile::operator = (AppendFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		this->path = std::move(other.path);
+#ifdef _WIN32
+		this->fileHandle = std::exchange(other.fileHandle, nullptr);
+#else
+		this->fd = std::exchange(other.fd, -1);
+#endif	// !_WIN32
+	}
+
+	return *this;
+}
+
+AppendFile::~AppendFile()
+{
+	close();
+}
@@ -0,0 +1,58 @@
+#ifndef APPENDFILE_H
+#define APPENDFILE_H
+
+#include <string>
+#include <cstddef>
+
+
+/*
+* AppendFile writes to the end of a file through the file handle of the operating system, so the written data can be forced
+* to the storage device by sync(). Flushing a stream only hands the data over to the operating system, which keeps them
+* in the page cache for a while; synced data also survive a power failure or a crash of the operating system.
+*
+* Writes are not buffered. The file is closed when the object is destroyed.
+*/
+
+class AppendFile
+{
+public:
+
+	AppendFile() noexcept = default;
+
+	// Opens the file for appending. The file is created if it does not exist; otherwise, if truncate is true, it is emptied.
+	explicit AppendFile(const std::string& filePath, bool truncate = false);
+
+	AppendFile(const AppendFile& other) = delete;
+	AppendFile(AppendFile&& other) noexcept;
+
+	AppendFile& operator = (const AppendFile& other) = delete;
+	AppendFile& operator = (AppendFile&& other) noexcept;
+
+	~AppendFile();
+
+	bool isOpen() const noexcept;
+
+	void write(const void* data, std::size_t size);
+
+	// Waits until the data written to the file reach the storage device
+	void sync();
+
+	// Waits until the entries of the directory (e.g. a file renamed into it) reach the storage device. On Windows it does nothing,
+	// since the file system does not require it.
+	static void syncDirectory(const std::string& directoryPath);
+
+private:
+
+	void close() noexcept;
+
+	std::string path;		// for error messages
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+#else
+	int fd = -1;
+#endif	// !_WIN32
+};	// AppendFile
+
+
+#endif	// APPENDFILE_H
@@ -0,0 +1,609 @@
+#include "benchmark.h"
+#include "syntheticgallery.h"
+#include "syntheticdescriptorcomputer.h"
+#include "facedb.h"
+#include "resnet.h"
+#include "resnetfacedescriptorcomputer.h"
+#include "resnetfacedescriptormetric.h"
+#include "dlibmatrixdata.h"
+#include "dlibfaceextractor.h"
+#include "openface.h"
+#include "openfacedescriptormetric.h"
+#include "openfacedescriptordata.h"
+#include "openfaceextractor.h"
+#include "labeldata.h"
+#include "threadpool.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <sstream>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <dlib/pixel.h>
+
+
+
+// The descriptors have the type of ResNet descriptors
+using SyntheticFaceDb = FaceDb<SyntheticDescriptorComputer<ResNetFaceDescriptorComputer>, ResNetFaceDescriptorMetric>;
+
+
+// Keeps the most recently built database, since consecutive benchmarks usually work with a database of the same size
+class GalleryCache
+{
+public:
+
+	// The number of descriptors of each label in the gallery
+	static constexpr std::size_t facesPerLabel = 10;
+
+	std::shared_ptr<SyntheticFaceDb> get(std::size_t size)
+	{
+		if (this->faceDb && this->size == size)
+			return this->faceDb;
+
+		this->faceDb.reset();	// free the memory before building another database
+
+		auto gallery = std::make_shared<const SyntheticGallery>(std::max(size / facesPerLabel, std::size_t(1)));
+		auto faceDb = std::make_shared<SyntheticFaceDb>(SyntheticDescriptorComputer<ResNetFaceDescriptorComputer>(gallery));
+
+		// Enroll the descriptors in chunks, so the names do not take much memory
+		constexpr std::size_t chunkSize = 1 << 16;
+		std::vector<std::pair<std::string, std::string>> images;
+		for (std::size_t head = 0; head < size; head += chunkSize)
+		{
+			images.clear();
+			for (std::size_t i = head; i < std::min(head + chunkSize, size); ++i)
+				images.emplace_back("g" + std::to_string(i), SyntheticGallery::labelName(gallery->labelOf(i)));
+
+			faceDb->enroll(images);
+		}
+
+		this->faceDb = std::move(faceDb);
+		this->size = size;
+		return this->faceDb;
+	}
+
+	void clear() noexcept
+	{
+		this->faceDb.reset();
+	}
+
+private:
+	std::shared_ptr<SyntheticFaceDb> faceDb;
+	std::size_t size = 0;
+};	// GalleryCache
+
+
+// Creates a uniquely named directory for the files written by benchmarks and removes it with its content on destruction
+class TemporaryDirectory
+{
+public:
+
+	TemporaryDirectory()
+		: path(std::filesystem::temp_directory_path() / ("doppelganger_bench_" + std::to_string(std::random_device{}())))
+	{
+		std::filesystem::create_directories(this->path);
+	}
+
+	TemporaryDirectory(const TemporaryDirectory& other) = delete;
+	TemporaryDirectory& operator = (const TemporaryDirectory& other) = delete;
+
+	~TemporaryDirectory()
+	{
+		std::error_code ec;
+		std::filesystem::remove_all(this->path, ec);	// must not throw
+	}
+
+	std::string file(const std::string& name) const { return (this->path / name).string(); }
+
+private:
+	std::filesystem::path path;
+};	// TemporaryDirectory
+
+
+std::vector<std::string> makeNames(char prefix, std::size_t count)
+{
+	std::vector<std::string> names;
+	for (std::size_t i = 0; i < count; ++i)
+		names.push_back(prefix + std::to_string(i));
+
+	return names;
+}	// makeNames
+
+std::filesystem::path requireFile(const std::filesystem::path& filePath)
+{
+	if (!std::filesystem::is_regular_file(filePath))
+		throw BenchmarkSuite::Skip("The file is missing: " + filePath.string());
+
+	return filePath;
+}	// requireFile
+
+// Lists the image files in the directory
+std::vector<std::string> requireImages(const std::filesystem::path& directory)
+{
+	std::vector<std::string> images;
+	if (std::filesystem::is_directory(directory))
+	{
+		for (const auto& entry : std::filesystem::directory_iterator(directory))
+		{
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.cbegin(), extension.cend(), extension.begin(), static_cast<int (*)(int)>(&std::tolower));
+			if (entry.is_regular_file() && (extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".bmp"))
+				images.push_back(entry.path().string());
+		}
+	}
+
+	if (images.empty())
+		throw BenchmarkSuite::Skip("No images found in " + directory.string());
+
+	std::sort(images.begin(), images.end());
+	return images;
+}	// requireImages
+
+
+void addDistanceBenchmarks(BenchmarkSuite& suite)
+{
+	// The descriptors are cycled through, so the benchmark is not bound by memory bandwidth
+	constexpr std::size_t numDescriptors = 1024, dimension = 128;
+	auto makeDescriptors = []
+		{
+			SyntheticGallery gallery(numDescriptors);
+			std::vector<float> data(numDescriptors * dimension);
+			for (std::size_t i = 0; i < numDescriptors; ++i)
+				gallery.descriptor(i, data.data() + i * dimension);
+
+			return data;
+		};
+
+	suite.add("distance/packed", [makeDescriptors]
+		{
+			auto data = std::make_shared<std::vector<float>>(makeDescriptors());
+			return [data, metric = L2Distance<float>()](std::size_t iterations) -> std::uint64_t
+				{
+					double sum = 0;
+					for (std::size_t i = 0; i < iterations; ++i)
+					{
+						const float* v = data->data() + (i & (numDescriptors - 1)) * dimension;
+						sum += metric(v, data->data() + ((i + 1) & (numDescriptors - 1)) * dimension, dimension);
+					}
+
+					BenchmarkSuite::keep(sum);
+					return iterations;
+				};
+		});
+
+	suite.add("distance/resnet", [makeDescriptors]
+		{
+			auto data = makeDescriptors();
+			auto descriptors = std::make_shared<std::vector<ResNet::Descriptor>>();
+			for (std::size_t i = 0; i < numDescriptors; ++i)
+				descriptors->push_back(DescriptorData<ResNet::Descriptor>::make(data.data() + i * dimension, dimension));
+
+			return [descriptors, metric = ResNetFaceDescriptorMetric()](std::size_t iterations) -> std::uint64_t
+				{
+					double sum = 0;
+					for (std::size_t i = 0; i < iterations; ++i)
+						sum += metric((*descriptors)[i & (numDescriptors - 1)], (*descriptors)[(i + 1) & (numDescriptors - 1)]);
+
+					BenchmarkSuite::keep(sum);
+					return iterations;
+				};
+		});
+
+	suite.add("distance/openface", [makeDescriptors]
+		{
+			auto data = makeDescriptors();
+			auto descriptors = std::make_shared<std::vector<OpenFace::Descriptor>>();
+			for (std::size_t i = 0; i < numDescriptors; ++i)
+				descriptors->push_back(DescriptorData<OpenFace::Descriptor>::make(data.data() + i * dimension, dimension));
+
+			return [descriptors, metric = L2Distance<OpenFace::Descriptor>()](std::size_t iterations) -> std::uint64_t
+				{
+					double sum = 0;
+					for (std::size_t i = 0; i < iterations; ++i)
+						sum += metric((*descriptors)[i & (numDescriptors - 1)], (*descriptors)[(i + 1) & (numDescriptors - 1)]);
+
+					BenchmarkSuite::keep(sum);
+					return iterations;
+				};
+		});
+}	// addDistanceBenchmarks
+
+
+void addSearchBenchmarks(BenchmarkSuite& suite, GalleryCache& galleries)
+{
+	for (std::size_t size : { 10000, 100000, 1000000 })
+	{
+		suite.add("find/" + std::to_string(size), [&galleries, size]
+			{
+				auto faceDb = galleries.get(size);
+				auto queries = std::make_shared<std::vector<std::string>>(makeNames('q', 1024));
+				return [faceDb, queries](std::size_t iterations) -> std::uint64_t
+					{
+						for (std::size_t i = 0; i < iterations; ++i)
+							BenchmarkSuite::keep(faceDb->find((*queries)[i % queries->size()]).second);
+
+						return iterations;
+					};
+			});
+
+		suite.add("find_batch/" + std::to_string(size), [&galleries, size]
+			{
+				auto faceDb = galleries.get(size);
+				auto queries = std::make_shared<std::vector<std::filesystem::path>>();
+				for (const auto& name : makeNames('q', 256))
+					queries->push_back(name);
+
+				return [faceDb, queries](std::size_t iterations) -> std::uint64_t
+					{
+						for (std::size_t i = 0; i < iterations; ++i)
+							BenchmarkSuite::keep(faceDb->findBatch(*queries).size());
+
+						return iterations * queries->size();
+					};
+			});
+	}	// size
+}	// addSearchBenchmarks
+
+
+void addStorageBenchmarks(BenchmarkSuite& suite, GalleryCache& galleries, const TemporaryDirectory& directory)
+{
+	for (std::size_t size : { 10000, 100000 })
+	{
+		for (FaceDbFormat format : { FaceDbFormat::Text, FaceDbFormat::Binary })
+		{
+			std::string suffix = std::string(format == FaceDbFormat::Text ? "text/" : "binary/") + std::to_string(size);
+			std::string filePath = directory.file("gallery_" + std::to_string(size) + (format == FaceDbFormat::Text ? ".txt" : ".db"));
+
+			suite.add("save/" + suffix, [&galleries, size, format, filePath]
+				{
+					// Saving attaches the database to the file, so a copy is saved rather than the cached database
+					auto faceDb = std::make_shared<SyntheticFaceDb>(*galleries.get(size));
+					return [faceDb, format, filePath, size](std::size_t iterations) -> std::uint64_t
+						{
+							for (std::size_t i = 0; i < iterations; ++i)
+								faceDb->save(filePath, format);
+
+							return iterations * size;
+						};
+				});
+
+			suite.add("load/" + suffix, [&galleries, size, format, filePath]
+				{
+					SyntheticFaceDb(*galleries.get(size)).save(filePath, format);
+					auto gallery = std::make_shared<const SyntheticGallery>(1);		// descriptors are not computed
+					return [gallery, filePath, size](std::size_t iterations) -> std::uint64_t
+						{
+							for (std::size_t i = 0; i < iterations; ++i)
+							{
+								SyntheticFaceDb faceDb{ SyntheticDescriptorComputer<ResNetFaceDescriptorComputer>(gallery) };
+								faceDb.load(filePath);
+							}
+
+							return iterations * size;
+						};
+				});
+		}	// format
+	}	// size
+}	// addStorageBenchmarks
+
+
+void addLabelBenchmarks(BenchmarkSuite& suite, const TemporaryDirectory& directory)
+{
+	// Every fourth label is unknown, so failed lookups are measured too
+	constexpr std::size_t numLabels = 1 << 12;
+	auto makeLabels = [](const std::string& prefix, std::size_t numKnown)
+		{
+			std::vector<std::string> labels;
+			for (std::size_t i = 0; i < numLabels; ++i)
+			{
+				char label[32];
+				std::snprintf(label, sizeof(label), "%s%08zu", prefix.c_str(), i % 4 ? i * 7919 % numKnown + 1 : numKnown + i + 1);
+				labels.push_back(label);
+			}
+
+			return labels;
+		};
+
+	suite.add("label_name/builtin", [makeLabels]
+		{
+			auto labels = std::make_shared<std::vector<std::string>>(makeLabels("n", 2622));
+			return [labels, labelNames = std::make_shared<LabelNames>()](std::size_t iterations) -> std::uint64_t
+				{
+					std::size_t length = 0;
+					for (std::size_t i = 0; i < iterations; ++i)
+						length += getNameFromLabel(*labelNames, (*labels)[i & (numLabels - 1)]).size();
+
+					BenchmarkSuite::keep(length);
+					return iterations;
+				};
+		});
+
+	suite.add("label_name/file", [makeLabels, &directory]
+		{
+			constexpr std::size_t numNames = 100000;
+			std::string filePath = directory.file("names.txt");
+			{
+				std::ofstream file(filePath);
+				file.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+				for (std::size_t i = 1; i <= numNames; ++i)
+					file << 'x' << std::setw(8) << std::setfill('0') << i << "\tPerson " << i << '\n';
+			}
+
+			auto labels = std::make_shared<std::vector<std::string>>(makeLabels("x", numNames));
+			return [labels, labelNames = std::make_shared<LabelNames>(filePath)](std::size_t iterations) -> std::uint64_t
+				{
+					std::size_t length = 0;
+					for (std::size_t i = 0; i < iterations; ++i)
+						length += getNameFromLabel(*labelNames, (*labels)[i & (numLabels - 1)]).size();
+
+					BenchmarkSuite::keep(length);
+					return iterations;
+				};
+		});
+}	// addLabelBenchmarks
+
+
+void addExtractorBenchmarks(BenchmarkSuite& suite, const std::filesystem::path& modelDir, const std::filesystem::path& imageDir)
+{
+	suite.add("extract/dlib", [modelDir, imageDir]
+		{
+			auto images = std::make_shared<std::vector<std::string>>(requireImages(imageDir));
+			auto extractor = std::make_shared<DlibFaceExtractor<ResNet::Input>>(
+				requireFile(modelDir / "shape_predictor_5_face_landmarks.dat").string(), ResNet::inputSize, 0.25);
+			return [images, extractor](std::size_t iterations) -> std::uint64_t
+				{
+					for (std::size_t i = 0; i < iterations; ++i)
+						BenchmarkSuite::keep((*extractor)((*images)[i % images->size()]).has_value());
+
+					return iterations;
+				};
+		});
+
+	// All faces of an image are found by one pass of the detector; the items are images, so the time is comparable to extract/dlib
+	suite.add("extract/dlib/all", [modelDir, imageDir]
+		{
+			auto images = std::make_shared<std::vector<std::string>>(requireImages(imageDir));
+			auto extractor = std::make_shared<DlibFaceExtractor<ResNet::Input>>(
+				requireFile(modelDir / "shape_predictor_5_face_landmarks.dat").string(), ResNet::inputSize, 0.25);
+			return [images, extractor](std::size_t iterations) -> std::uint64_t
+				{
+					for (std::size_t i = 0; i < iterations; ++i)
+						BenchmarkSuite::keep(extractor->extractAll(extractor->decode((*images)[i % images->size()])).size());
+
+					return iterations;
+				};
+		});
+
+	// Faces are detected in images downscaled to 640 pixels, but aligned at full resolution
+	suite.add("extract/dlib/640", [modelDir, imageDir]
+		{
+			auto images = std::make_shared<std::vector<std::string>>(requireImages(imageDir));
+			auto extractor = std::make_shared<DlibFaceExtractor<ResNet::Input>>(
+				requireFile(modelDir / "shape_predictor_5_face_landmarks.dat").string(), ResNet::inputSize, 0.25);
+			extractor->setMaxDetectionSide(640);
+			return [images, extractor](std::size_t iterations) -> std::uint64_t
+				{
+					for (std::size_t i = 0; i < iterations; ++i)
+						BenchmarkSuite::keep((*extractor)((*images)[i % images->size()]).has_value());
+
+					return iterations;
+				};
+		});
+
+	suite.add("extract/openface", [modelDir, imageDir]
+		{
+			auto images = std::make_shared<std::vector<std::string>>(requireImages(imageDir));
+			auto extractor = std::make_shared<OpenFaceExtractor<OpenFaceAlignment::OuterEyesAndNose>>(
+				requireFile(modelDir / "shape_predictor_68_face_landmarks.dat").string(), OpenFace::inputSize);
+			return [images, extractor](std::size_t iterations) -> std::uint64_t
+				{
+					for (std::size_t i = 0; i < iterations; ++i)
+						BenchmarkSuite::keep((*extractor)((*images)[i % images->size()]).has_value());
+
+					return iterations;
+				};
+		});
+}	// addExtractorBenchmarks
+
+
+void addInferenceBenchmarks(BenchmarkSuite& suite, const std::filesystem::path& modelDir)
+{
+	// Random faces take as long to recognize as real ones
+	for (std::size_t batchSize : { 1, 8, 32 })
+	{
+		suite.add("inference/resnet/" + std::to_string(batchSize), [modelDir, batchSize]
+			{
+				auto net = std::make_shared<ResNet>(requireFile(modelDir / "dlib_face_recognition_resnet_model_v1.dat").string());
+				auto faces = std::make_shared<std::vector<ResNet::Input>>(batchSize);
+				std::mt19937 random(static_cast<std::mt19937::result_type>(batchSize));
+				for (auto& face : *faces)
+				{
+					face.set_size(ResNet::inputSize, ResNet::inputSize);
+					for (auto& pixel : face)
+						pixel = dlib::rgb_pixel(static_cast<unsigned char>(random()), static_cast<unsigned char>(random()),
+							static_cast<unsigned char>(random()));
+				}
+
+				return [net, faces](std::size_t iterations) -> std::uint64_t
+					{
+						std::vector<std::optional<ResNet::Descriptor>> descriptors(faces->size());
+						for (std::size_t i = 0; i < iterations; ++i)
+							(*net)(faces->cbegin(), faces->cend(), descriptors.begin());
+
+						BenchmarkSuite::keep(descriptors);
+						return iterations * faces->size();
+					};
+			});
+
+		suite.add("inference/openface/" + std::to_string(batchSize), [modelDir, batchSize]
+			{
+				auto net = std::make_shared<OpenFace>(requireFile(modelDir / "nn4.v2.t7").string(), false);
+				auto faces = std::make_shared<std::vector<OpenFace::Input>>();
+				cv::RNG random(batchSize);
+				for (std::size_t i = 0; i < batchSize; ++i)
+				{
+					cv::Mat face(OpenFace::inputSize, OpenFace::inputSize, CV_8UC3);
+					random.fill(face, cv::RNG::UNIFORM, 0, 256);
+					faces->push_back(face);
+				}
+
+				return [net, faces](std::size_t iterations) -> std::uint64_t
+					{
+						std::vector<std::optional<OpenFace::Descriptor>> descriptors(faces->size());
+						for (std::size_t i = 0; i < iterations; ++i)
+							(*net)(faces->cbegin(), faces->cend(), descriptors.begin());
+
+						BenchmarkSuite::keep(descriptors);
+						return iterations * faces->size();
+					};
+			});
+	}	// batchSize
+}	// addInferenceBenchmarks
+
+
+// Formats a duration in nanoseconds with a suitable unit
+std::string formatTime(double nanoseconds)
+{
+	std::ostringstream stream;
+	stream << std::fixed << std::setprecision(nanoseconds < 10 ? 2 : 1);
+	if (nanoseconds < 1e3)
+		stream << nanoseconds << " ns";
+	else if (nanoseconds < 1e6)
+		stream << nanoseconds / 1e3 << " us";
+	else if (nanoseconds < 1e9)
+		stream << nanoseconds / 1e6 << " ms";
+	else
+		stream << nanoseconds / 1e9 << " s";
+
+	return stream.str();
+}	// formatTime
+
+
+void printUsage()
+{
+	std::cout << "Usage: doppelganger_bench [-h]"
+		" [--filter=<regular expression>]"
+		" [--list]"
+		" [--time=<the minimum duration of a run in seconds>]"
+		" [--repetitions=<the number of runs>]"
+		" [--threads=<the number of threads of parallel computations>]"
+		" [--out=<JSON output file>]"
+		" [--label=<run label, e.g. a commit hash>]"
+		" [--models=<model directory>]"
+		" [--images=<image directory>]" << std::endl;
+}	// printUsage
+
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		static const cv::String keys =
+			"{help h usage ?        |       | Print the help message  }"
+			"{filter                |       | A regular expression selecting the benchmarks to run by name (all by default) }"
+			"{list                  |       | List the benchmarks instead of running them }"
+			"{time                  |0.5    | The minimum duration of a run in seconds }"
+			"{repetitions           |5      | The number of runs of each benchmark }"
+			"{threads               |0      | The number of threads running parallel computations (the number of hardware threads if zero) }"
+			"{out                   |doppelganger_bench.json | The file the results are written to in JSON (nothing is written if empty) }"
+			"{label                 |       | A label stored with the results, e.g. a commit hash, to tell runs apart }"
+			"{models                |./models | The directory of the face detection and recognition models }"
+			"{images                |./test | The directory of the images faces are extracted from }";
+
+		cv::CommandLineParser parser(argc, argv, keys);
+		parser.about("Doppelganger benchmarks");
+
+		if (parser.has("help"))
+		{
+			printUsage();
+			return 0;
+		}
+
+		BenchmarkSuite::Settings settings;
+		settings.filter = parser.get<std::string>("filter");
+		settings.minTime = parser.get<double>("time");
+		int repetitions = parser.get<int>("repetitions");
+		int threads = parser.get<int>("threads");
+		std::string out = parser.get<std::string>("out");
+		std::string label = parser.get<std::string>("label");
+		std::filesystem::path modelDir = parser.get<std::string>("models");
+		std::filesystem::path imageDir = parser.get<std::string>("images");
+
+		if (!parser.check())
+		{
+			parser.printErrors();
+			printUsage();
+			return -1;
+		}
+
+		if (settings.minTime <= 0 || repetitions <= 0)
+			throw std::invalid_argument("The minimum time and the number of repetitions must be positive.");
+
+		if (threads < 0)
+			throw std::invalid_argument("The number of threads cannot be negative.");
+
+		ThreadPool::configure({ static_cast<std::size_t>(threads) });
+
+		settings.repetitions = static_cast<std::size_t>(repetitions);
+
+		TemporaryDirectory directory;
+		GalleryCache galleries;
+
+		BenchmarkSuite suite;
+		addDistanceBenchmarks(suite);
+		addSearchBenchmarks(suite, galleries);
+		addStorageBenchmarks(suite, galleries, directory);
+		addLabelBenchmarks(suite, directory);
+		addExtractorBenchmarks(suite, modelDir, imageDir);
+		addInferenceBenchmarks(suite, modelDir);
+
+		if (parser.has("list"))
+		{
+			for (const auto& name : suite.list(settings.filter))
+				std::cout << name << std::endl;
+
+			return 0;
+		}
+
+		std::cout << std::left << std::setw(32) << "Benchmark" << std::right << std::setw(14) << "Time" << std::setw(14) << "Min"
+			<< std::setw(12) << "Iterations" << std::setw(16) << "Items/s" << std::endl;
+		auto results = suite.run(settings, [](const BenchmarkSuite::Result& result)
+			{
+				std::cout << std::left << std::setw(32) << result.name << std::right;
+				if (!result.skipped.empty())
+					std::cout << "  skipped: " << result.skipped << std::endl;
+				else
+				{
+					std::cout << std::setw(14) << formatTime(result.median()) << std::setw(14) << formatTime(result.min())
+						<< std::setw(12) << result.iterations << std::setw(16) << std::setprecision(4) << result.itemsPerSecond() << std::endl;
+				}
+			});
+
+		galleries.clear();
+
+		if (!out.empty())
+		{
+			std::ofstream file(out);
+			file.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+			file << BenchmarkSuite::toJson(results, label) << '\n';
+			std::cout << "The results have been written to " << out << std::endl;
+		}
+	}	// try
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -4;
+	}
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+#include "benchmark.h"
+#include "json.h"
+#include "l2kernels.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <numeric>
+#include <regex>
+#include <thread>
+#include <utility>
+
+
+
+namespace
+{
+	// Runs the body and returns the elapsed seconds and the number of processed items
+	std::pair<double, std::uint64_t> measure(const BenchmarkSuite::Body& body, std::size_t iterations)
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::uint64_t items = body(iterations);
+		return { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), items };
+	}
+
+	std::string compiler()
+	{
+#if defined(__clang__)
+		return "clang " __clang_version__;
+#elif defined(__GNUC__)
+		return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+		return "msvc " + std::to_string(_MSC_FULL_VER);
+#else
+		return "unknown";
+#endif
+	}
+}	// anonymous namespace
+
+
+double BenchmarkSuite::Result::mean() const noexcept
+{
+	return this->runs.empty() ? 0 : std::accumulate(this->runs.cbegin(), this->runs.cend(), 0.0) / static_cast<double>(this->runs.size());
+}	// mean
+
+double BenchmarkSuite::Result::median() const
+{
+	if (this->runs.empty())
+		return 0;
+
+	std::vector<double> sorted(this->runs);
+	std::sort(sorted.begin(), sorted.end());
+	std::size_t middle = sorted.size() / 2;
+	return sorted.size() % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+}	// median
+
+double BenchmarkSuite::Result::min() const noexcept
+{
+	return this->runs.empty() ? 0 : *std::min_element(this->runs.cbegin(), this->runs.cend());
+}	// min
+
+double BenchmarkSuite::Result::stddev() const noexcept
+{
+	if (this->runs.size() < 2)
+		return 0;
+
+	double m = mean(), sum = 0;
+	for (double run : this->runs)
+		sum += (run - m) * (run - m);
+
+	return std::sqrt(sum / static_cast<double>(this->runs.size() - 1));
+}	// stddev
+
+double BenchmarkSuite::Result::itemsPerSecond() const noexcept
+{
+	double m = mean();
+	return m > 0 ? this->itemsPerIteration * 1e9 / m : 0;
+}	// itemsPerSecond
+
+
+void BenchmarkSuite::add(std::string name, Setup setup)
+{
+	this->entries.push_back({ std::move(name), std::move(setup) });
+}	// add
+
+std::vector<std::string> BenchmarkSuite::list(const std::string& filter) const
+{
+	std::regex pattern(filter);
+	std::vector<std::string> names;
+	for (const auto& entry : this->entries)
+	{
+		if (std::regex_search(entry.name, pattern))
+			names.push_back(entry.name);
+	}
+
+	return names;
+}	// list
+
+std::vector<BenchmarkSuite::Result> BenchmarkSuite::run(const Settings& settings, const std::function<void (const Result&)>& reporter) const
+{
+	if (settings.minTime <= 0 || settings.repetitions == 0)
+		throw std::invalid_argument("The minimum time and the number of repetitions must be positive.");
+
+	std::regex pattern(settings.filter);
+	std::vector<Result> results;
+	for (const auto& entry : this->entries)
+	{
+		if (!std::regex_search(entry.name, pattern))
+			continue;
+
+		Result result;
+		result.name = entry.name;
+		try
+		{
+			Body body = entry.setup();
+
+			// Find the number of iterations which takes the minimum time. The last of these runs warms up the caches.
+			std::size_t iterations = 1;
+			for (double seconds = measure(body, iterations).first; seconds < settings.minTime; seconds = measure(body, iterations).first)
+			{
+				double factor = seconds > 0 ? std::min(1.2 * settings.minTime / seconds, 100.0) : 100.0;
+				iterations = std::max(iterations + 1, static_cast<std::size_t>(static_cast<double>(iterations) * factor));
+			}
+
+			result.iterations = iterations;
+			std::uint64_t totalItems = 0;
+			for (std::size_t i = 0; i < settings.repetitions; ++i)
+			{
+				auto [seconds, items] = measure(body, iterations);
+				result.runs.push_back(seconds * 1e9 / static_cast<double>(iterations));
+				totalItems += items;
+			}
+
+			result.itemsPerIteration = static_cast<double>(totalItems) / static_cast<double>(iterations * settings.repetitions);
+		}	// try
+		catch (const Skip& e)
+		{
+			result.skipped = e.what();
+		}
+
+		reporter(result);
+		results.push_back(std::move(result));
+	}	// entry
+
+	return results;
+}	// run
+
+std::string BenchmarkSuite::toJson(const std::vector<Result>& results, const std::string& label)
+{
+	char date[32];
+	std::time_t now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+	std::string text = "{\"context\":{\"label\":" + json::quote(label)
+		+ ",\"date\":" + json::quote(date)
+		+ ",\"compiler\":" + json::quote(compiler())
+#ifdef NDEBUG
+		+ ",\"build\":\"release\""
+#else
+		+ ",\"build\":\"debug\""
+#endif	// NDEBUG
+#ifdef PARALLEL_EXECUTION
+		+ ",\"parallel_execution\":true"
+#else
+		+ ",\"parallel_execution\":false"
+#endif	// PARALLEL_EXECUTION
+		+ ",\"hardware_concurrency\":" + std::to_string(std::thread::hardware_concurrency())
+		+ ",\"threads\":" + std::to_string(ThreadPool::globalSize())
+		+ ",\"instruction_set\":" + json::quote(l2kernels::getName(l2kernels::detect()))
+		+ "},\"benchmarks\":[";
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const Result& result = results[i];
+		text += (i > 0 ? ",{\"name\":" : "{\"name\":") + json::quote(result.name);
+		if (!result.skipped.empty())
+		{
+			text += ",\"skipped\":" + json::quote(result.skipped) + "}";
+			continue;
+		}
+
+		text += ",\"iterations\":" + std::to_string(result.iterations)
+			+ ",\"repetitions\":" + std::to_string(result.runs.size())
+			+ ",\"mean_ns\":" + json::number(result.mean())
+			+ ",\"median_ns\":" + json::number(result.median())
+			+ ",\"min_ns\":" + json::number(result.min())
+			+ ",\"stddev_ns\":" + json::number(result.stddev())
+			+ ",\"items_per_iteration\":" + json::number(result.itemsPerIteration)
+			+ ",\"items_per_second\":" + json::number(result.itemsPerSecond()) + "}";
+	}
+
+	return text + "]}";
+}	// toJson
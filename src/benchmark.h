@@ -0,0 +1,93 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/*
+* BenchmarkSuite is a minimal harness for microbenchmarks, so the performance of the hot paths can be compared across builds
+* without external dependencies.
+*
+* A benchmark is registered with a name and a setup function, which prepares the data and returns the body to be measured. Setup is
+* only run for the benchmarks selected by the filter, and it is not timed. The body is called with the number of iterations to run
+* and returns the number of items (e.g. images, faces, or queries) they have processed. The number of iterations is chosen so that
+* a run takes at least the minimum time, and the runs are repeated several times after a warm-up run. A benchmark whose
+* prerequisites (e.g. model files) are missing is skipped by throwing BenchmarkSuite::Skip from the setup function.
+*/
+
+class BenchmarkSuite
+{
+public:
+
+	using Body = std::function<std::uint64_t (std::size_t iterations)>;
+	using Setup = std::function<Body ()>;
+
+	// Thrown by a setup function to skip the benchmark
+	class Skip : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};	// Skip
+
+	struct Settings
+	{
+		std::string filter;				// a regular expression matching a part of the names of the benchmarks to run
+		double minTime = 0.5;			// the minimum duration of a run in seconds
+		std::size_t repetitions = 5;
+	};	// Settings
+
+	struct Result
+	{
+		std::string name;
+		std::string skipped;			// the reason the benchmark has been skipped or an empty string
+		std::size_t iterations = 0;		// the number of iterations in each run
+		std::vector<double> runs;		// nanoseconds per iteration
+		double itemsPerIteration = 0;
+
+		double mean() const noexcept;
+		double median() const;
+		double min() const noexcept;
+		double stddev() const noexcept;
+		double itemsPerSecond() const noexcept;
+	};	// Result
+
+	void add(std::string name, Setup setup);
+
+	// The names of the registered benchmarks matching the filter
+	std::vector<std::string> list(const std::string& filter) const;
+
+	// Runs the selected benchmarks in the order of registration. The reporter is called with the result of each benchmark.
+	std::vector<Result> run(const Settings& settings, const std::function<void (const Result&)>& reporter) const;
+
+	// Formats the results as JSON along with the context of the run: the label (e.g. a commit hash), the time, and the host
+	static std::string toJson(const std::vector<Result>& results, const std::string& label);
+
+	// Makes the compiler believe that the value is used, so its computation is not optimized away
+	template <class T>
+	static void keep(const T& value) noexcept
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static_cast<void>(*static_cast<const volatile char*>(static_cast<const void*>(&value)));
+#endif
+	}
+
+private:
+
+	struct Entry
+	{
+		std::string name;
+		Setup setup;
+	};	// Entry
+
+	std::vector<Entry> entries;
+};	// BenchmarkSuite
+
+
+#endif	// BENCHMARK_H
@@ -0,0 +1,194 @@
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+
+/*
+* A handful of helpers for reading and writing binary database files. Values are stored in the native byte order,
+* therefore the files are expected to be read on the same platform (or a platform with the same endianness) they were written on.
+*/
+
+namespace binaryio
+{
+
+	// The byte order mark is written to file headers to detect files created on a machine with different endianness
+	constexpr std::uint32_t byteOrderMark = 0x01020304;
+
+	template <typename T>
+	void write(std::ostream& stream, const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be written as raw bytes.");
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	void write(std::ostream& stream, const T* values, std::size_t count)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be written as raw bytes.");
+		stream.write(reinterpret_cast<const char*>(values), static_cast<std::streamsize>(count * sizeof(T)));
+	}
+
+	template <typename T>
+	T read(std::istream& stream)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be read as raw bytes.");
+		T value;
+		stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	void read(std::istream& stream, T* values, std::size_t count)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be read as raw bytes.");
+		stream.read(reinterpret_cast<char*>(values), static_cast<std::streamsize>(count * sizeof(T)));
+	}
+
+	// Strings are stored as a 64-bit length followed by characters (no terminating zero)
+	inline void writeString(std::ostream& stream, const std::string& s)
+	{
+		write<std::uint64_t>(stream, s.size());
+		stream.write(s.data(), static_cast<std::streamsize>(s.size()));
+	}
+
+	inline std::string readString(std::istream& stream)
+	{
+		std::string s(static_cast<std::size_t>(read<std::uint64_t>(stream)), '\0');
+		stream.read(s.data(), static_cast<std::streamsize>(s.size()));
+		return s;
+	}
+
+	// Pads the stream with zeros until the write position becomes a multiple of the alignment
+	inline std::uint64_t pad(std::ostream& stream, std::uint64_t alignment)
+	{
+		std::uint64_t pos = static_cast<std::uint64_t>(stream.tellp());
+		for (; pos % alignment != 0; ++pos)
+			stream.put('\0');
+		return pos;
+	}
+
+	inline constexpr std::uint64_t alignUp(std::uint64_t offset, std::uint64_t alignment) noexcept
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+
+	// File headers start with the signature of the format, its version, and the byte order mark. The header type is expected
+	// to provide the signature and currentVersion constants along with the magic, version, and byteOrderMark fields.
+	template <class Header>
+	void initHeader(Header& header) noexcept
+	{
+		std::copy(std::cbegin(Header::signature), std::cend(Header::signature), header.magic);
+		header.version = Header::currentVersion;
+		header.byteOrderMark = byteOrderMark;
+	}
+
+	template <class Header>
+	bool checkHeader(const Header& header) noexcept
+	{
+		return std::equal(std::cbegin(header.magic), std::cend(header.magic), std::cbegin(Header::signature))
+			&& header.version == Header::currentVersion && header.byteOrderMark == byteOrderMark;
+	}
+
+	// Writes the file by calling writer(stream) for a temporary file, which then replaces the target. A crash or an error
+	// leaves either the old file or the new one, but never a partially written one. Stream errors throw std::ios_base::failure.
+	template <class Writer>
+	void atomicWrite(const std::string& filePath, Writer&& writer)
+	{
+		std::string tempPath = filePath + ".tmp";
+		{
+			std::ofstream file(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+			file.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+			writer(file);
+		}
+
+		std::filesystem::rename(tempPath, filePath);
+	}
+
+	// Reads a side file (e.g. a search index) by calling reader(stream), which returns false if the contents are outdated.
+	// Side files are derived from the database and can always be rebuilt, hence a missing or truncated file is just as useless
+	// as an outdated one: instead of throwing, all of these cases return false, and the caller recomputes the data.
+	template <class Reader>
+	bool tryRead(const std::string& filePath, Reader&& reader)
+	{
+		std::ifstream file(filePath, std::ios::in | std::ios::binary);
+		if (!file)
+			return false;
+
+		try
+		{
+			file.exceptions(std::ios_base::badbit | std::ios_base::failbit | std::ios_base::eofbit);
+			return reader(file);
+		}
+		catch (const std::ios_base::failure&)
+		{
+			return false;
+		}
+	}	// tryRead
+
+
+	/*
+	* MemoryReader reads values from a memory region (e.g. a memory-mapped file) checking that they never cross its boundaries.
+	*/
+	class MemoryReader
+	{
+	public:
+		MemoryReader(const char* data, std::size_t size) noexcept
+			: head(data), size(size) {}
+
+		std::size_t tell() const noexcept { return this->offset; }
+
+		void seek(std::size_t offset)
+		{
+			this->offset = offset <= this->size ? offset : throw std::runtime_error("The file is truncated or corrupted.");
+		}
+
+		template <typename T>
+		T read()
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be read as raw bytes.");
+			T value;
+			std::memcpy(&value, view(sizeof(T)), sizeof(T));
+			return value;
+		}
+
+		std::string readString()
+		{
+			auto length = read<std::uint64_t>();
+			if (length > this->size)
+				throw std::runtime_error("The file is truncated or corrupted.");
+			return std::string(view(static_cast<std::size_t>(length)), static_cast<std::size_t>(length));
+		}
+
+		// Returns a pointer to the specified number of bytes at the current position and advances the position
+		const char* view(std::size_t bytes)
+		{
+			if (bytes > this->size - this->offset)
+				throw std::runtime_error("The file is truncated or corrupted.");
+
+			const char* p = this->head + this->offset;
+			this->offset += bytes;
+			return p;
+		}
+
+	private:
+		const char* head;
+		std::size_t size;
+		std::size_t offset = 0;
+	};	// MemoryReader
+
+}	// binaryio
+
+
+#endif	// BINARYIO_H
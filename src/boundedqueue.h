@@ -0,0 +1,119 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+/*
+* BoundedQueue is a thread-safe FIFO queue of limited capacity connecting the stages of a pipeline.
+*
+* A producer blocks while the queue is full, so a fast stage cannot run too far ahead of a slow one and exhaust memory. A consumer
+* blocks while the queue is empty. When the producers are done (or the pipeline is aborted), the queue is closed: pushing fails,
+* and consumers receive the remaining items followed by an empty result.
+*/
+
+template <typename T>
+class BoundedQueue
+{
+public:
+
+	explicit BoundedQueue(std::size_t capacity)
+		: capacity(capacity > 0 ? capacity : throw std::invalid_argument("The queue capacity must be positive.")) {}
+
+	BoundedQueue(const BoundedQueue& other) = delete;
+	BoundedQueue& operator = (const BoundedQueue& other) = delete;
+
+	// Waits for free space and appends the item. Returns false if the queue has been closed.
+	bool push(T item);
+
+	// Waits for an item and removes it from the queue. Returns std::nullopt if the queue has been closed and no items are left.
+	std::optional<T> pop();
+
+	// Waits for at least one item and moves up to maxCount available items to the vector. Returns false if the queue has been
+	// closed and no items are left.
+	bool pop(std::vector<T>& items, std::size_t maxCount);
+
+	void close();
+
+private:
+	std::size_t capacity;
+	std::deque<T> items;
+	bool closed = false;
+	std::mutex mutex;
+	std::condition_variable notEmpty, notFull;
+};	// BoundedQueue
+
+
+template <typename T>
+bool BoundedQueue<T>::push(T item)
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->notFull.wait(lock, [this] { return this->closed || this->items.size() < this->capacity; });
+	if (this->closed)
+		return false;
+
+	this->items.push_back(std::move(item));
+	lock.unlock();
+	this->notEmpty.notify_one();
+	return true;
+}	// push
+
+template <typename T>
+std::optional<T> BoundedQueue<T>::pop()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->notEmpty.wait(lock, [this] { return this->closed || !this->items.empty(); });
+	if (this->items.empty())
+		return std::nullopt;	// closed
+
+	std::optional<T> item(std::move(this->items.front()));
+	this->items.pop_front();
+	lock.unlock();
+	this->notFull.notify_one();
+	return item;
+}	// pop
+
+template <typename T>
+bool BoundedQueue<T>::pop(std::vector<T>& items, std::size_t maxCount)
+{
+	assert(maxCount > 0);
+	items.clear();
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->notEmpty.wait(lock, [this] { return this->closed || !this->items.empty(); });
+	if (this->items.empty())
+		return false;	// closed
+
+	// Items which are already available are taken at once rather than waiting for more of them
+	std::size_t count = std::min(maxCount, this->items.size());
+	std::move(this->items.begin(), this->items.begin() + count, std::back_inserter(items));
+	this->items.erase(this->items.begin(), this->items.begin() + count);
+	lock.unlock();
+	this->notFull.notify_all();
+	return true;
+}	// pop
+
+template <typename T>
+void BoundedQueue<T>::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->closed = true;
+	}
+
+	this->notEmpty.notify_all();
+	this->notFull.notify_all();
+}	// close
+
+
+#endif	// BOUNDEDQUEUE_H
@@ -0,0 +1,175 @@
+#include "descriptorstore.h"
+#include "l2kernels.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+
+
+DescriptorStore::DescriptorStore(const DescriptorStore& other)
+	: buffer(other.buffer)
+	, file(other.file)
+	, descriptors(other.descriptors)
+	, labelData(other.labelData)
+	, dim(other.dim)
+	, count(other.count)
+{
+	std::lock_guard<std::mutex> lock(other.normsMutex);
+	this->norms = other.norms;
+}
+
+DescriptorStore::DescriptorStore(DescriptorStore&& other) noexcept
+	: buffer(std::move(other.buffer))
+	, file(std::move(other.file))
+	, descriptors(std::exchange(other.descriptors, nullptr))
+	, labelData(std::exchange(other.labelData, nullptr))
+	, dim(std::exchange(other.dim, 0))
+	, count(std::exchange(other.count, 0))
+	, norms(std::move(other.norms))
+{
+}
+
+DescriptorStore& DescriptorStore::operator = (const DescriptorStore& other)
+{
+	if (this != &other)
+	{
+		DescriptorStore copy(other);
+		*this = std::move(copy);
+	}
+
+	return *this;
+}
+
+DescriptorStore& DescriptorStore::operator = (DescriptorStore&& other) noexcept
+{
+	this->buffer = std::move(other.buffer);
+	this->file = std::move(other.file);
+	this->descriptors = std::exchange(other.descriptors, nullptr);
+	this->labelData = std::exchange(other.labelData, nullptr);
+	this->dim = std::exchange(other.dim, 0);
+	this->count = std::exchange(other.count, 0);
+	this->norms = std::move(other.norms);
+	return *this;
+}
+
+void DescriptorStore::reserve(std::size_t capacity)
+{
+	if (capacity > this->capacity() || isMapped())
+		grow(std::max(capacity, this->count));
+}
+
+void DescriptorStore::push_back(const float* descriptor, std::size_t n, std::uint32_t label)
+{
+	std::copy_n(descriptor, n, append(n, label));
+}
+
+float* DescriptorStore::append(std::size_t n, std::uint32_t label)
+{
+	if (this->dim == 0 && this->count == 0)
+	{
+		// The row size is not known until the first descriptor is added, so a buffer reserved in advance has to be reallocated
+		this->dim = n;
+		if (this->capacity() > 0)
+			grow(this->capacity());
+	}
+	else if (n != this->dim)
+		throw std::runtime_error("The size of the descriptor does not match the other descriptors in the database.");
+
+	// The next row of a shared buffer belongs to the copy which claims it first. A mapped store is copied to an owned buffer here.
+	std::size_t claimed = this->count;
+	if (!this->buffer || this->count == this->buffer->capacity || !this->buffer->size.compare_exchange_strong(claimed, this->count + 1))
+	{
+		grow(std::max({ this->capacity() * 2, this->count + 1, std::size_t(64) }));
+		++this->buffer->size;
+	}
+
+	this->buffer->labels[this->count] = label;
+	return this->buffer->descriptors.get() + this->dim * this->count++;
+}	// append
+
+void DescriptorStore::map(std::shared_ptr<const MappedFile> file, const float* descriptors, const std::uint32_t* labels, 
+	std::size_t count, std::size_t dimension)
+{
+	clear();
+	this->file = std::move(file);
+	this->descriptors = descriptors;
+	this->labelData = labels;
+	this->count = count;
+	this->dim = dimension;
+}	// map
+
+void DescriptorStore::clear() noexcept
+{
+	this->buffer.reset();
+	this->file.reset();
+	this->descriptors = nullptr;
+	this->labelData = nullptr;
+	this->dim = this->count = 0;
+	this->norms.clear();
+}	// clear
+
+std::uint64_t DescriptorStore::fingerprint() const noexcept
+{
+	// FNV-1a hash of the sampled data; sampling keeps the pages of a mapped store from being read in
+	std::uint64_t hash = 14695981039346656037ull;
+	auto combine = [&hash](const void* data, std::size_t size)
+	{
+		auto bytes = static_cast<const unsigned char*>(data);
+		for (std::size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+	};
+
+	std::uint64_t size = this->count, dimension = this->dim;
+	combine(&size, sizeof(size));
+	combine(&dimension, sizeof(dimension));
+
+	constexpr std::size_t numSamples = 64;
+	for (std::size_t s = 0; s < numSamples && s < this->count; ++s)
+	{
+		std::size_t i = this->count <= numSamples ? s : s * (this->count - 1) / (numSamples - 1);
+		combine(descriptor(i), this->dim * sizeof(float));
+		combine(this->labelData + i, sizeof(std::uint32_t));
+	}
+
+	return hash;
+}	// fingerprint
+
+const float* DescriptorStore::squaredNorms() const
+{
+	// Queries may be the first to ask for the norms, and they run concurrently
+	std::lock_guard<std::mutex> lock(this->normsMutex);
+	if (this->norms.size() < this->count)
+	{
+		std::vector<float> zero(this->dim, 0.0f);
+		auto squaredDistance = l2kernels::select();
+		std::size_t first = this->norms.size();
+		this->norms.resize(this->count);
+		for (std::size_t i = first; i < this->count; ++i)
+			this->norms[i] = squaredDistance(descriptor(i), zero.data(), this->dim);
+	}
+
+	return this->norms.data();
+}	// squaredNorms
+
+void DescriptorStore::grow(std::size_t capacity)
+{
+	// Zero-dimensional descriptors still need a valid (though empty) buffer
+	auto newBuffer = std::make_shared<Buffer>();
+	newBuffer->descriptors.reset(static_cast<float*>(
+		::operator new[](std::max<std::size_t>(capacity * this->dim, 1) * sizeof(float), std::align_val_t{ alignment })));
+	newBuffer->labels.reset(new std::uint32_t[std::max<std::size_t>(capacity, 1)]);
+	newBuffer->capacity = capacity;
+	newBuffer->size = this->count;
+
+	if (this->count > 0)
+	{
+		std::copy_n(this->descriptors, this->count * this->dim, newBuffer->descriptors.get());
+		std::copy_n(this->labelData, this->count, newBuffer->labels.get());
+	}
+
+	this->buffer = std::move(newBuffer);
+	this->descriptors = this->buffer->descriptors.get();
+	this->labelData = this->buffer->labels.get();
+	this->file.reset();		// the data have been copied, so the mapping is no longer needed
+}	// grow
@@ -0,0 +1,111 @@
+#ifndef DESCRIPTORSTORE_H
+#define DESCRIPTORSTORE_H
+
+#include "mappedfile.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+
+/*
+* DescriptorStore keeps face descriptors as packed float vectors in one contiguous row-major buffer aligned to the cache line size.
+* Labels are stored in a parallel array. Thus, a linear scan over the descriptors reads memory sequentially instead of chasing 
+* a pointer per entry.
+* 
+* The store can either own its buffer or refer to descriptors residing in a memory-mapped database file. A mapped store is read-only: 
+* the data are copied to an owned buffer as soon as new descriptors are added.
+*
+* Stored descriptors are never modified, so copies of the store share the buffer, and copying is cheap (e.g. a snapshot written to 
+* a file in the background). A copy appends descriptors in place to the free space of the shared buffer unless another copy has 
+* claimed that space first, in which case it moves its descriptors to a new buffer.
+*/
+
+class DescriptorStore
+{
+public:
+
+	static constexpr std::size_t alignment = 64;
+
+	DescriptorStore() noexcept = default;
+
+	DescriptorStore(const DescriptorStore& other);
+	DescriptorStore(DescriptorStore&& other) noexcept;
+
+	DescriptorStore& operator = (const DescriptorStore& other);
+	DescriptorStore& operator = (DescriptorStore&& other) noexcept;
+
+	std::size_t size() const noexcept { return this->count; }
+
+	bool empty() const noexcept { return this->count == 0; }
+
+	// The number of elements in each descriptor (zero until the first descriptor is added)
+	std::size_t dimension() const noexcept { return this->dim; }
+
+	bool isMapped() const noexcept { return this->file != nullptr; }
+
+	const float* data() const noexcept { return this->descriptors; }
+
+	const std::uint32_t* labels() const noexcept { return this->labelData; }
+
+	const float* descriptor(std::size_t i) const noexcept { return this->descriptors + i * this->dim; }
+
+	std::uint32_t label(std::size_t i) const noexcept { return this->labelData[i]; }
+
+	// Computes a hash of the store's size, dimension, and a sample of descriptors and labels. It allows to check whether
+	// data derived from the store (e.g. a search index saved to a file) are still valid for it.
+	std::uint64_t fingerprint() const noexcept;
+
+	// Returns squared L2 norms of the stored descriptors. They are computed on the first call and updated for the descriptors added later.
+	// Concurrent calls are safe (e.g. by queries served in parallel), but not concurrently with adding descriptors.
+	const float* squaredNorms() const;
+
+	void reserve(std::size_t capacity);
+
+	// Appends a descriptor of the store's dimension. The dimension of an empty store is defined by the first descriptor added.
+	void push_back(const float* descriptor, std::size_t n, std::uint32_t label);
+
+	// Appends an uninitialized descriptor and returns a pointer to its data
+	float* append(std::size_t n, std::uint32_t label);
+
+	// Makes the store refer to the data residing in a mapped file, which is kept alive by the store
+	void map(std::shared_ptr<const MappedFile> file, const float* descriptors, const std::uint32_t* labels, std::size_t count, std::size_t dimension);
+
+	void clear() noexcept;
+
+private:
+
+	struct AlignedDeleter
+	{
+		void operator()(float* p) const noexcept { ::operator delete[](p, std::align_val_t{ alignment }); }
+	};
+
+	// The owned descriptors and labels shared by copies of the store
+	struct Buffer
+	{
+		std::unique_ptr<float[], AlignedDeleter> descriptors;
+		std::unique_ptr<std::uint32_t[]> labels;
+		std::size_t capacity = 0;
+		std::atomic<std::size_t> size{ 0 };		// the number of rows claimed by the copies
+	};	// Buffer
+
+	std::size_t capacity() const noexcept { return this->buffer ? this->buffer->capacity : 0; }
+
+	void grow(std::size_t capacity);
+
+	std::shared_ptr<Buffer> buffer;		// null for a mapped store
+	std::shared_ptr<const MappedFile> file;		// read-only, hence it can be shared by copies of the store
+	const float* descriptors = nullptr;		// points either to the owned buffer or to the mapped file
+	const std::uint32_t* labelData = nullptr;
+	std::size_t dim = 0;
+	std::size_t count = 0;
+	mutable std::mutex normsMutex;
+	mutable std::vector<float> norms;		// cached squared norms of the first norms.size() descriptors
+};	// DescriptorStore
+
+
+#endif	// DESCRIPTORSTORE_H
@@ -2,11 +2,14 @@
 #define DLIBFACEEXTRACTOR_H
 
 #include "faceextractorhelper.h"
+#include "metrics.h"
 
 #include <optional>
 #include <string>
-#include <execution>	
+#include <filesystem>
 #include <atomic>
+#include <utility>
+#include <vector>
 
 #include <dlib/image_io.h>
 #include <dlib/image_transforms.h>
@@ -14,6 +17,8 @@
 
 /*
 * DlibFaceExtractor detects, crops, and aligns a face in the input image by means of standard Dlib functions. 
+* Decoding an image file and extracting the face can also be performed separately, e.g. by different stages of a pipeline.
+* All faces of an image can be extracted at once along with their bounding boxes.
 */
 
 template <class Image>
@@ -23,6 +28,7 @@ class DlibFaceExtractor : FaceExtractorHelper<Image>
 public:
 
 	using typename DlibFaceExtractor::FaceExtractorHelper::Output;
+	using DecodedImage = Image;
 
 	// DlibFaceExtractor works with both 5 and 68 landmark detection models
 	DlibFaceExtractor(const std::string& landmarkDetectionModel, unsigned long size, double padding = 0.2)
@@ -46,6 +52,18 @@ public:
 	DlibFaceExtractor& operator = (DlibFaceExtractor&& other) = default;
 
 	using DlibFaceExtractor::FaceExtractorHelper::operator();
+	using DlibFaceExtractor::FaceExtractorHelper::getMaxDetectionSide;
+	using DlibFaceExtractor::FaceExtractorHelper::setMaxDetectionSide;
+
+	// Loads the image file (throws if it cannot be read)
+	DecodedImage decode(const std::filesystem::path& filePath) const;
+
+	// Detects and aligns the face in the decoded image. Face detection is a non-const operation.
+	std::optional<Output> extract(const DecodedImage& image);
+
+	// Detects and aligns the faces in the decoded image (at most maxFaces of them unless it is zero). The faces are listed with their 
+	// bounding boxes in the order of the detector's confidence.
+	std::vector<std::pair<FaceBox, Output>> extractAll(const DecodedImage& image, std::size_t maxFaces = 0);
 
 private:
 
@@ -59,21 +77,54 @@ private:
 template <class Image>
 std::optional<typename DlibFaceExtractor<Image>::Output> DlibFaceExtractor<Image>::extractFace(const std::string& filePath)
 {
-	// Load the image
+	return extract(decode(filePath));
+}	// extractFace
+
+template <class Image>
+typename DlibFaceExtractor<Image>::DecodedImage DlibFaceExtractor<Image>::decode(const std::filesystem::path& filePath) const
+{
+	Metrics::Timer timer(Metrics::Stage::Decode);
 	Image im;
-	dlib::load_image(im, filePath);
+	dlib::load_image(im, filePath.string());
+	return im;
+}	// decode
 
-	// Obtain the coordinates of facial landmarks
-	auto landmarks = DlibFaceExtractor::FaceExtractorHelper::getLandmarks(im);		// call the inherited helper function
-	if (landmarks.num_parts() < 1)
+template <class Image>
+std::optional<typename DlibFaceExtractor<Image>::Output> DlibFaceExtractor<Image>::extract(const DecodedImage& im)
+{
+	// Only the landmarks of the most confident detection are needed
+	auto faces = extractAll(im, 1);
+	if (faces.empty())
 		return std::nullopt;
 
-	// Align the face
-	Image face;
-	dlib::extract_image_chip(im, dlib::get_face_chip_details(landmarks, this->size, this->padding), face);
+	return std::move(faces.front().second);		// prefer move-constructor for std::optional
+}	// extract
 
-	return std::move(face);		// prefer move-constructor for std::optional
-}	// extractFace
+template <class Image>
+std::vector<std::pair<FaceBox, typename DlibFaceExtractor<Image>::Output>> DlibFaceExtractor<Image>::extractAll(const DecodedImage& im, 
+	std::size_t maxFaces)
+{
+	// Obtain the coordinates of facial landmarks
+	auto landmarks = DlibFaceExtractor::FaceExtractorHelper::getLandmarks(im, maxFaces);		// call the inherited helper function
+	std::vector<std::pair<FaceBox, Output>> faces;
+	if (landmarks.empty())
+		return faces;
+
+	// Align the faces
+	Metrics::Timer timer(Metrics::Stage::Alignment, landmarks.size());
+	faces.reserve(landmarks.size());
+	for (const auto& faceLandmarks : landmarks)
+	{
+		if (faceLandmarks.num_parts() < 1)
+			continue;
+
+		Image face;
+		dlib::extract_image_chip(im, dlib::get_face_chip_details(faceLandmarks, this->size, this->padding), face);
+		faces.emplace_back(DlibFaceExtractor::FaceExtractorHelper::getFaceBox(faceLandmarks), std::move(face));
+	}
+
+	return faces;
+}	// extractAll
 
 
 
@@ -0,0 +1,44 @@
+#ifndef DLIBMATRIXDATA_H
+#define DLIBMATRIXDATA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+#include <dlib/matrix.h>
+
+
+template <typename T>
+struct DescriptorData;
+
+
+/*
+* DescriptorData specialization for dlib column vectors (e.g. ResNet face descriptors) converts them to and from packed float arrays.
+*/
+
+template <typename T, long NR, typename MM, typename L>
+struct DescriptorData<dlib::matrix<T, NR, 1, MM, L>>
+{
+	static_assert(std::is_arithmetic_v<T>, "Only matrices of arithmetic types can be stored as packed floats.");
+
+	static std::size_t size(const dlib::matrix<T, NR, 1, MM, L>& m) noexcept
+	{
+		return static_cast<std::size_t>(m.size());
+	}
+
+	static void copy(const dlib::matrix<T, NR, 1, MM, L>& m, float* data)
+	{
+		std::transform(m.begin(), m.end(), data, [](const T& x) { return static_cast<float>(x); });
+	}
+
+	static dlib::matrix<T, NR, 1, MM, L> make(const float* data, std::size_t n)
+	{
+		dlib::matrix<T, NR, 1, MM, L> m;
+		m.set_size(static_cast<long>(n));
+		std::transform(data, data + n, m.begin(), [](float x) { return static_cast<T>(x); });
+		return m;
+	}
+};	// DescriptorData
+
+
+#endif	// DLIBMATRIXDATA_H
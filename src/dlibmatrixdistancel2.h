@@ -1,6 +1,10 @@
 #ifndef DLIBMATRIXDISTANCEL2
 #define DLIBMATRIXDISTANCEL2
 
+#include "floatvectordistancel2.h"
+
+#include <cmath>
+#include <type_traits>
 
 #include <dlib/matrix.h>
 
@@ -8,13 +12,22 @@ template <typename T>
 struct L2Distance;
 
 template <typename T, long NR, long NC, typename MM, typename L>
-struct L2Distance<dlib::matrix<T, NR, NC, MM, L>>
+struct L2Distance<dlib::matrix<T, NR, NC, MM, L>> : L2Distance<float>
 {
+	using L2Distance<float>::operator();	// packed vectors from a binary database file
+
 	double operator()(const dlib::matrix<T, NR, NC, MM, L>& m1, const dlib::matrix<T, NR, NC, MM, L>& m2) const
 	{
+		// Float matrices are contiguous, so the vectorized kernel can be applied without building a temporary expression
+		if constexpr (std::is_same_v<T, float>)
+		{
+			if (m1.size() == m2.size() && m1.size() > 0)
+				return std::sqrt(squared(&m1(0, 0), &m2(0, 0), static_cast<std::size_t>(m1.size())));
+		}
+
 		return dlib::length(m1 - m2);
 	}
 };	// L2Distance
 
 
-#endif	// DLIBMATRIXDISTANCEL2
\ No newline at end of file
+#endif	// DLIBMATRIXDISTANCEL2
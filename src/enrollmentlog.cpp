@@ -0,0 +1,220 @@
+#include "enrollmentlog.h"
+#include "binaryio.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+
+
+std::vector<EnrollmentLog::Record> EnrollmentLog::open(const std::string& databasePath, const DescriptorStore& store)
+{
+	close();
+
+	std::string filePath = databasePath + fileExtension();
+
+	FileHeader header;
+	std::vector<Record> records;
+	std::uint64_t length = read(filePath, header, records);
+
+	// The log must continue the descriptors stored in the database file
+	std::uint64_t numStored = store.size();
+	bool matches = length > 0 && header.base <= numStored && header.base + records.size() >= numStored;
+	if (matches && header.base == numStored)
+	{
+		matches = header.fingerprint == store.fingerprint();
+	}
+	else if (matches)
+	{
+		// The file has been rewritten by a compaction, which has not dropped the merged records yet
+		for (std::uint64_t i = header.base; i < numStored && matches; ++i)
+		{
+			const auto& descriptor = records[static_cast<std::size_t>(i - header.base)].descriptor;
+			matches = descriptor.size() == store.dimension()
+				&& std::equal(descriptor.cbegin(), descriptor.cend(), store.descriptor(static_cast<std::size_t>(i)));
+		}
+	}
+
+	if (!matches)
+	{
+		reset(databasePath, store);
+		return {};
+	}
+
+	// A torn record at the end is cut off, so that new records follow the intact ones
+	std::filesystem::resize_file(filePath, length);
+
+	this->file = AppendFile(filePath);
+	this->dbPath = databasePath;
+	this->base = header.base;
+	this->count = records.size();
+
+	records.erase(records.begin(), records.begin() + static_cast<std::ptrdiff_t>(numStored - header.base));
+	return records;
+}	// open
+
+void EnrollmentLog::reset(const std::string& databasePath, const DescriptorStore& store)
+{
+	close();
+	write(databasePath, store.size(), store.fingerprint(), {});
+}	// reset
+
+void EnrollmentLog::append(const std::string& label, const float* descriptor, std::size_t dimension)
+{
+	assert(isOpen());
+
+	// The record is written at once and synced, so it is not lost even if the system crashes afterwards
+	std::string record = serialize(this->base + this->count, label, descriptor, dimension);
+	this->file.write(record.data(), record.size());
+	this->file.sync();
+	++this->count;
+}	// append
+
+void EnrollmentLog::compact(std::function<void()> task, const DescriptorStore& snapshot)
+{
+	assert(isOpen() && !isCompacting());
+
+	this->snapshotSize = snapshot.size();
+	this->snapshotFingerprint = snapshot.fingerprint();
+	this->compaction = std::async(std::launch::async, std::move(task));
+}	// compact
+
+bool EnrollmentLog::isCompacted() const
+{
+	return !this->compaction.valid() || this->compaction.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}	// isCompacted
+
+void EnrollmentLog::finishCompaction()
+{
+	if (!this->compaction.valid())
+		return;
+
+	this->compaction.get();		// rethrows the exception of the compaction task
+
+	// The merged records may only be dropped once the new database file is durable
+	AppendFile(this->dbPath).sync();
+	AppendFile::syncDirectory(std::filesystem::path(this->dbPath).parent_path().string());
+
+	// The database file holds the snapshot now, so only the records appended since then are kept
+	FileHeader header;
+	std::vector<Record> records;
+	read(this->dbPath + fileExtension(), header, records);
+	std::uint64_t numMerged = std::min<std::uint64_t>(this->snapshotSize - this->base, records.size());
+	records.erase(records.begin(), records.begin() + static_cast<std::ptrdiff_t>(numMerged));
+	write(this->dbPath, this->snapshotSize, this->snapshotFingerprint, records);
+}	// finishCompaction
+
+void EnrollmentLog::close()
+{
+	finishCompaction();
+
+	this->file = AppendFile();
+	this->dbPath.clear();
+	this->base = 0;
+	this->count = 0;
+}	// close
+
+std::uint64_t EnrollmentLog::read(const std::string& filePath, FileHeader& header, std::vector<Record>& records)
+{
+	records.clear();
+
+	std::ifstream file(filePath, std::ios::in | std::ios::binary);
+	if (!file)
+		return 0;
+
+	header = binaryio::read<FileHeader>(file);
+	if (!file || !binaryio::checkHeader(header))
+		return 0;
+
+	// Records are read until the end of the file or the first broken one
+	std::error_code ec;
+	std::uint64_t fileSize = std::filesystem::file_size(filePath, ec);
+	std::uint64_t length = sizeof(FileHeader);
+	for (;;)
+	{
+		Record record;
+		record.position = binaryio::read<std::uint64_t>(file);
+		auto labelLength = binaryio::read<std::uint64_t>(file);
+		if (!file || labelLength > fileSize - length)
+			break;
+
+		record.label.resize(static_cast<std::size_t>(labelLength));
+		file.read(record.label.data(), static_cast<std::streamsize>(labelLength));
+		auto dimension = binaryio::read<std::uint64_t>(file);
+		if (!file || dimension > (fileSize - length) / sizeof(float))
+			break;
+
+		record.descriptor.resize(static_cast<std::size_t>(dimension));
+		binaryio::read(file, record.descriptor.data(), record.descriptor.size());
+		auto checksum = binaryio::read<std::uint64_t>(file);
+		if (!file || record.position != header.base + records.size())
+			break;
+
+		// The checksum is the last field of the serialized record
+		std::string bytes = serialize(record.position, record.label, record.descriptor.data(), record.descriptor.size());
+		if (std::memcmp(bytes.data() + bytes.size() - sizeof(checksum), &checksum, sizeof(checksum)) != 0)
+			break;
+
+		length += bytes.size();
+		records.push_back(std::move(record));
+	}	// for
+
+	return length;
+}	// read
+
+void EnrollmentLog::write(const std::string& databasePath, std::uint64_t base, std::uint64_t fingerprint, const std::vector<Record>& records)
+{
+	FileHeader header = {};
+	binaryio::initHeader(header);
+	header.base = base;
+	header.fingerprint = fingerprint;
+
+	// The log is replaced atomically, so a crash leaves either the old or the new one. The new log is synced before the rename,
+	// and the directory after it, so the log cannot end up empty or missing.
+	std::string filePath = databasePath + fileExtension(), tempPath = filePath + ".tmp";
+	{
+		AppendFile file(tempPath, true);
+		file.write(&header, sizeof(header));
+		for (const auto& record : records)
+		{
+			std::string bytes = serialize(record.position, record.label, record.descriptor.data(), record.descriptor.size());
+			file.write(bytes.data(), bytes.size());
+		}
+
+		file.sync();
+	}
+
+	std::filesystem::rename(tempPath, filePath);
+	AppendFile::syncDirectory(std::filesystem::path(filePath).parent_path().string());
+
+	this->file = AppendFile(filePath);
+	this->dbPath = databasePath;
+	this->base = base;
+	this->count = records.size();
+}	// write
+
+std::string EnrollmentLog::serialize(std::uint64_t position, const std::string& label, const float* descriptor, std::size_t dimension)
+{
+	std::string bytes;
+	auto append = [&bytes](const void* data, std::size_t size) { bytes.append(static_cast<const char*>(data), size); };
+
+	std::uint64_t labelLength = label.size(), numElements = dimension;
+	append(&position, sizeof(position));
+	append(&labelLength, sizeof(labelLength));
+	append(label.data(), label.size());
+	append(&numElements, sizeof(numElements));
+	append(descriptor, dimension * sizeof(float));
+
+	// FNV-1a hash of the record
+	std::uint64_t checksum = 14695981039346656037ull;
+	for (char c : bytes)
+		checksum = (checksum ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+
+	append(&checksum, sizeof(checksum));
+	return bytes;
+}	// serialize
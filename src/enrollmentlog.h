@@ -0,0 +1,128 @@
+#ifndef ENROLLMENTLOG_H
+#define ENROLLMENTLOG_H
+
+#include "descriptorstore.h"
+#include "appendfile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+
+/*
+* EnrollmentLog is an append-only write-ahead log of descriptors enrolled into a database after its file was written. Enrolling a face
+* costs one small sequential write to the log instead of rewriting the whole database file. When the database is loaded, the logged
+* descriptors are replayed on top of the ones stored in the file.
+*
+* The log is based on the state of the database file it was started for: the header keeps the number of descriptors in the file and
+* a fingerprint of them. Every record holds the position of the descriptor in the store and a checksum, so a record torn by a crash
+* is detected and discarded along with anything after it.
+*
+* From time to time the log is compacted, i.e. merged into the database file, which is rewritten in the background while enrollment
+* goes on. Once the new file has replaced the old one, the merged records are dropped from the log. If the process stops before that,
+* the log still matches the new file: the records which are already stored there are recognized by their positions and skipped.
+*
+* Every record is synced to the storage device before append() returns, so an enrolled face survives a power failure as well as
+* a crash of the process. Compaction drops records only after the new database file has been synced, and the shortened log is synced
+* before it replaces the old one.
+*
+* Copies of the log are not attached to the file, since there must be only one writer.
+*/
+
+class EnrollmentLog
+{
+public:
+
+	struct Record
+	{
+		std::uint64_t position;		// the position of the descriptor in the store
+		std::string label;
+		std::vector<float> descriptor;
+	};	// Record
+
+	// The suffix appended to the database path to make the name of the log file
+	static std::string fileExtension() { return ".wal"; }
+
+	EnrollmentLog() = default;
+
+	EnrollmentLog(const EnrollmentLog&)
+		: EnrollmentLog() {}
+
+	EnrollmentLog(EnrollmentLog&& other) = default;
+
+	EnrollmentLog& operator = (const EnrollmentLog&)
+	{
+		return *this = EnrollmentLog();
+	}
+
+	EnrollmentLog& operator = (EnrollmentLog&& other) = default;
+
+	bool isOpen() const noexcept { return this->file.isOpen(); }
+
+	// The path of the database file the log belongs to
+	const std::string& databasePath() const noexcept { return this->dbPath; }
+
+	// The number of records in the log
+	std::size_t size() const noexcept { return this->count; }
+
+	// Opens the log for the descriptors loaded from the database file and returns the records which have to be replayed.
+	// If the log does not exist or does not match the store, a new one is started.
+	std::vector<Record> open(const std::string& databasePath, const DescriptorStore& store);
+
+	// Starts a new log for the descriptors which have just been written to the database file replacing the existing log
+	void reset(const std::string& databasePath, const DescriptorStore& store);
+
+	// Appends a record for the descriptor added to the end of the store and waits until it reaches the storage device
+	void append(const std::string& label, const float* descriptor, std::size_t dimension);
+
+	// Runs the task rewriting the database file with the descriptors of the snapshot in the background
+	void compact(std::function<void()> task, const DescriptorStore& snapshot);
+
+	bool isCompacting() const noexcept { return this->compaction.valid(); }
+
+	// Returns true if the background compaction has finished (or none is running)
+	bool isCompacted() const;
+
+	// Waits for the background compaction and drops the records merged into the database file. If the compaction has failed,
+	// the log is kept as is, and the exception is rethrown.
+	void finishCompaction();
+
+	// Waits for the background compaction and closes the log
+	void close();
+
+private:
+
+	// Binary file header
+	struct FileHeader
+	{
+		static constexpr char signature[8] = { 'F', 'A', 'C', 'E', 'W', 'L', 'O', 'G' };
+		static constexpr std::uint32_t currentVersion = 1;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byteOrderMark;
+		std::uint64_t base;		// the number of descriptors in the database file the log is based on
+		std::uint64_t fingerprint;	// the fingerprint of those descriptors
+	};	// FileHeader
+
+	// Reads the header and the intact records of the log. Returns the size of the intact part of the file or zero if the log cannot be read.
+	static std::uint64_t read(const std::string& filePath, FileHeader& header, std::vector<Record>& records);
+
+	// Writes a new log with the specified records and opens it for appending
+	void write(const std::string& databasePath, std::uint64_t base, std::uint64_t fingerprint, const std::vector<Record>& records);
+
+	static std::string serialize(std::uint64_t position, const std::string& label, const float* descriptor, std::size_t dimension);
+
+	std::string dbPath;
+	AppendFile file;
+	std::uint64_t base = 0;
+	std::size_t count = 0;
+	std::future<void> compaction;
+	std::uint64_t snapshotSize = 0, snapshotFingerprint = 0;	// the descriptors written by the compaction
+};	// EnrollmentLog
+
+
+#endif	// ENROLLMENTLOG_H
@@ -0,0 +1,22 @@
+#ifndef FACEBOX_H
+#define FACEBOX_H
+
+
+/*
+* FaceBox is the bounding box of a face detected in an image. The coordinates are in pixels of the original image, and the right and
+* the bottom edges belong to the box like those of dlib::rectangle.
+*/
+
+struct FaceBox
+{
+	long left = 0;
+	long top = 0;
+	long right = -1;
+	long bottom = -1;
+
+	long width() const noexcept { return this->right - this->left + 1; }
+	long height() const noexcept { return this->bottom - this->top + 1; }
+};	// FaceBox
+
+
+#endif	// FACEBOX_H
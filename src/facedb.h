@@ -1,17 +1,38 @@
 #ifndef FACEDB_H
 #define FACEDB_H
 
+#include "binaryio.h"
+#include "mappedfile.h"
+#include "descriptorstore.h"
+#include "fileindex.h"
+#include "enrollmentlog.h"
+#include "facebox.h"
+#include "labeltable.h"
+#include "searchindex.h"
+#include "nearestneighbors.h"
+#include "l2kernels.h"
+#include "metrics.h"
+#include "parallel.h"
+
 #include <cassert>
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include <cstring>
 #include <vector>	
 #include <string>
 #include <optional>
 #include <functional>
 #include <filesystem>
+#include <iterator>
+#include <memory>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+#include <tuple>
 
 #include <fstream>
 #include <iomanip>
-#include <execution>
-#include <atomic>
 
 
 /*
@@ -28,6 +49,45 @@ template <typename T>
 struct L2Distance;
 
 
+/*
+* A metric for packed float vectors may additionally define the squared() member function of the same signature returning the squared
+* distance. In this case candidates are ranked by squared distances, and the square root is only taken for the best matches.
+*/
+template <class DescriptorMetric, class = void>
+struct HasSquaredDistance : std::false_type {};
+
+template <class DescriptorMetric>
+struct HasSquaredDistance<DescriptorMetric, std::void_t<decltype(std::declval<const DescriptorMetric&>().squared(
+	std::declval<const float*>(), std::declval<const float*>(), std::declval<std::size_t>()))>> : std::true_type {};
+
+
+/*
+* DescriptorData must be specialized for descriptor types in order to store them in the binary database format. Specializations 
+* convert descriptors to and from packed arrays of 32-bit floats and must define the following static member functions:
+*	std::size_t size(const DescriptorType& descriptor)				// the number of elements in the descriptor
+*	void copy(const DescriptorType& descriptor, float* data)		// writes size(descriptor) elements to data
+*	DescriptorType make(const float* data, std::size_t n)			// creates a descriptor from n elements
+*/
+template <typename T>
+struct DescriptorData;
+
+
+/*
+* The binary database file format. 
+*/
+enum class FaceDbFormat
+{
+	Text,		// human-readable, one value per line; slow to load
+	Binary		// versioned binary file which is memory-mapped and searched in place when loaded
+};
+
+
+/*
+* The bounding box of a face found in a query image and the best matches for it: pairs of a label and a dissimilarity.
+*/
+using FaceMatches = std::pair<FaceBox, std::vector<std::pair<std::string, double>>>;
+
+
 /*
 * DescriptorComputerType structure must be specialized for any descriptor computer used. It must define the id member of type string describing 
 * a particular face descriptor type.
@@ -44,11 +104,36 @@ struct DescriptorComputerType;
 * and returning a face descriptor (or a list of optional descriptors) wrapped into std::optional. In case a descriptor cannot be computed 
 * for a particular input file, the returned value must be std::nullopt. 
 * 
-* The descriptor computer type must expose the subtype Descriptor serializable by means of I/O operators. 
+* The descriptor computer type must expose the subtype Descriptor serializable by means of I/O operators and DescriptorData. 
 * 
 * The descriptor metric must be a functor callable in a const context. It has to take two descriptors as arguments and return a double. 
 * When two faces represented by descriptors are similar, the returned value should be small. When they are different, the returned value 
-* should be high. The call operator must ensure data race avoidance. 
+* should be high. The call operator must ensure data race avoidance. If the metric can also be called for two packed float vectors 
+* as (const float*, const float*, std::size_t), the descriptor store is searched in place. Otherwise each stored descriptor has to be 
+* converted to the Descriptor type before comparison.
+* 
+* Descriptors are kept in a DescriptorStore, i.e. as packed float vectors in one contiguous buffer, which is either owned by the database
+* or mapped from a binary database file. 
+* 
+* By default the whole gallery is scanned. For L2 metrics a search backend implementing the SearchIndex interface can be plugged in
+* to make the search approximate: 8-bit quantized descriptors (QuantizedStore), an inverted-file index with product quantization 
+* (IvfPqIndex), or a navigable small world graph (HnswIndex). The backend selects a number of candidates, which are then re-ranked 
+* by exact distances to the float descriptors. It is kept up to date by enroll() and saved to a separate file next to the database 
+* (with the extension of the backend appended), so it is reused when the database is loaded again rather than rebuilt at startup.
+* 
+* The dataset files the descriptors were computed from are listed in a FileIndex, which is saved next to the database as well. 
+* It makes it possible to update the database after changes in the dataset by recomputing only the descriptors of new and modified files.
+* 
+* The database is attached to the file it has been created with, loaded from, or saved to (in the binary format). Faces enrolled afterwards are 
+* appended to an EnrollmentLog next to the file (with the .wal extension appended), which is replayed when the database is loaded. 
+* When the log grows long enough, it is compacted: the database file is rewritten from a snapshot of the database in the background.
+* 
+* The binary file layout (all values are stored in the native byte order):
+*	header: magic, version, byte order mark, dimension, the number of labels and descriptors, and offsets of the blocks below
+*	descriptor computer type id
+*	descriptor block: numDescriptors x dimension packed 32-bit floats aligned to 64 bytes
+*	label indices: a 32-bit label index for each descriptor
+*	label table: numLabels+1 64-bit offsets followed by concatenated label strings
 */
 
 template <class DescriptorComputer, class DescriptorMetric = L2Distance<typename DescriptorComputer::Descriptor>>
@@ -70,6 +155,24 @@ class FaceDb final
 	// It would also be nice to check whether Descriptor can be serialized/deserialized by means of >> and << operators,
 	// but there seems to be no simple way to do it
 
+	// Binary file header
+	struct FileHeader
+	{
+		static constexpr char signature[8] = { 'F', 'A', 'C', 'E', 'D', 'B', '\r', '\n' };
+		static constexpr std::uint32_t currentVersion = 1;
+		static constexpr std::uint64_t alignment = 64;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byteOrderMark;
+		std::uint64_t dimension;
+		std::uint64_t numLabels;
+		std::uint64_t numDescriptors;
+		std::uint64_t descriptorOffset;
+		std::uint64_t labelIndexOffset;
+		std::uint64_t labelTableOffset;
+	};	// FileHeader
+
 public:
 
 	FaceDb(const DescriptorComputer& descriptorComputer, DescriptorMetric descriptorMetric = DescriptorMetric()) noexcept(
@@ -91,85 +194,606 @@ public:
 
 	void setReporter(Reporter reporter) { this->reporter = std::move(reporter); }
 
-	void create(const std::string& datasetPath);
+	// Computes descriptors for the images in the subdirectories of the dataset directory (named by labels). The dataset is processed 
+	// in chunks. If the database path is specified, each chunk is written to the binary database file as soon as it is done, and 
+	// the file is mapped at the end, so memory usage does not grow with the size of the dataset.
+	// 
+	// Every chunk written to the file makes a checkpoint: the files processed so far are recorded in a manifest next to the database.
+	// If creation is interrupted, it can be resumed from the last checkpoint skipping the processed files. Otherwise it starts over.
+	void create(const std::string& datasetPath, const std::string& databasePath = std::string(), bool resume = false);
+
+	// Brings the database in line with the dataset directory after changes to it. Descriptors of new and modified files are computed,
+	// those of deleted files are removed, and the label table is rebuilt. Unchanged files are recognized by the file index, so their
+	// descriptors are reused. The result is the same as if the database were created from the dataset anew: descriptors which are
+	// not listed in the file index (e.g. enrolled ones or all of them, if the database was saved without the index) are dropped.
+	// The database is detached from the file until it is saved.
+	void update(const std::string& datasetPath);
 
 	void load(const std::string& databasePath);
 
-	void save(const std::string& databasePath);
+	void save(const std::string& databasePath, FaceDbFormat format = FaceDbFormat::Binary);
 
+	// Adds the descriptor of a face to the database and, if the database is attached to a file, to the enrollment log
 	bool enroll(const std::string& imageFile, const std::string& label);
 
+	// Enrolls a range of pairs (or tuples) of an image file and a label. Descriptors are computed in batches by the descriptor computer.
+	// Labels are only added for the images in which a face has been found. Returns the number of enrolled faces.
+	template <class ImageRange>
+	std::size_t enroll(const ImageRange& images);
+
+	// Sets the number of logged enrollments which triggers compaction (zero disables automatic compaction)
+	void setCompactionThreshold(std::size_t compactionThreshold);
+
+	// Merges the enrollment log into the database file, which is rewritten in the background. An error which occurs meanwhile
+	// is rethrown by the next operation waiting for compaction (i.e. compact(), create(), load(), save(), or enroll()).
+	void compact();
+
+	// Clears the database and detaches it from the file
 	void clear();
 
+	// Sets the backend for approximate search, which is only supported for L2 metrics. The index is built for the stored descriptors
+	// right away; afterwards it is loaded, built, and updated along with the database. A null pointer restores the exhaustive search.
+	void setSearchIndex(std::unique_ptr<SearchIndex> searchIndex);
+
+	// Sets the number of best candidates found by an approximate search which are re-ranked by exact distances
+	void setRerankSize(std::size_t rerankSize);
+
+	// Estimates the fraction of the true k nearest neighbors found by the approximate search for a sample of stored descriptors.
+	// Each sample is searched exhaustively as well, which takes a while in large databases. The exact search always yields 1.
+	double estimateRecall(std::size_t k) const;
+
 	std::pair<std::string, double> find(const std::string& filePath);		// non-const since it calls descriptorComputer()
+
+	// Returns up to k best matches sorted by dissimilarity. If uniqueLabels is true, each label is reported at most once.
+	// It can be called from multiple threads at once as long as the database is not modified and the descriptor computer is thread-safe.
+	std::vector<std::pair<std::string, double>> findTopK(const std::string& filePath, std::size_t k, bool uniqueLabels = false);
+
+	// Finds the best matches for each of the input files. An empty list is returned for a file if its descriptor cannot be computed.
+	std::vector<std::vector<std::pair<std::string, double>>> findBatch(const std::vector<std::filesystem::path>& files, 
+		std::size_t k = 1, bool uniqueLabels = false);
+
+	// Streams the best matches for the input files to the consumer block by block as soon as they are found, so the results need not
+	// be kept in memory. The consumer is called with the index of the first file of the block and a vector of the lists of matches.
+	template <class BlockConsumer>
+	void findBatch(const std::vector<std::filesystem::path>& files, std::size_t k, bool uniqueLabels, BlockConsumer&& consumer);
+
+	// Finds the best matches for every face in the image rather than for the most confident detection only. The faces are detected in 
+	// a single pass over the image, and the database is searched for all of them at once. The descriptor computer must provide
+	// computeFaces() returning the boxes and the descriptors of the faces.
+	std::vector<FaceMatches> findFaces(const std::string& filePath, std::size_t k = 1, bool uniqueLabels = false);
+
+	// Streams the best matches for every face of the input files to the consumer block by block like findBatch(). The consumer is called 
+	// with the index of the first file of the block and a vector of the lists of faces found in each file.
+	template <class BlockConsumer>
+	void findFacesBatch(const std::vector<std::filesystem::path>& files, std::size_t k, bool uniqueLabels, BlockConsumer&& consumer);
+
+	// Writes the binary database file. Descriptors can be written in portions, so the whole database need not reside in memory.
+	// Tools which produce descriptors without computing them (e.g. synthetic galleries) can use it to write database files directly.
+	class BinaryWriter
+	{
+	public:
+		explicit BinaryWriter(std::ostream& db);
+
+		// Continues writing the descriptor block of a partially written file positioned at its end
+		BinaryWriter(std::ostream& db, std::size_t dimension, std::vector<std::uint32_t> descriptorLabels);
+
+		// The offset of the descriptor block following the header and the descriptor computer type id
+		static std::uint64_t descriptorOffset() noexcept;
+
+		// The size of the file written so far (the maximum value if it does not fit in 64 bits)
+		std::uint64_t size() const noexcept;
+
+		void write(const float* descriptors, const std::uint32_t* descriptorLabels, std::size_t count, std::size_t dimension);
+
+		// Writes the label indices and the label table, and updates the header
+		void finish(const LabelTable& labels);
+
+	private:
+		std::ostream& db;
+		FileHeader header = {};
+		std::vector<std::uint32_t> descriptorLabels;	// written after the descriptor block
+	};	// BinaryWriter
 	
 private:
 
+	static constexpr bool isPackedMetric = std::is_invocable_r_v<double, const DescriptorMetric&, const float*, const float*, std::size_t>;
+	static constexpr bool isSquaredMetric = isPackedMetric && HasSquaredDistance<DescriptorMetric>::value;
+	static constexpr bool isL2Metric = std::is_base_of_v<L2Distance<float>, DescriptorMetric>;
+
+	// Queries are processed in blocks to limit memory usage
+	static constexpr std::size_t queryBlockSize = 256;
+
+	// The gallery is split into blocks of this size for parallel processing
+	static constexpr std::size_t galleryBlockSize = 1024;
+
+	// The number of files processed at once while creating the database
+	static constexpr std::size_t datasetChunkSize = 4096;
+
+	// The state of database creation restored from the manifest
+	struct Checkpoint
+	{
+		LabelTable labels;
+		std::vector<std::uint32_t> descriptorLabels;
+		std::vector<std::string> processedFiles;	// sorted relative paths of the processed files
+		FileIndex files;
+		std::size_t dimension = 0;
+		std::uint64_t fileSize = 0;		// the size of the partially written database file
+		std::uint64_t manifestSize = 0;	// the size of the manifest up to the last checkpoint
+	};	// Checkpoint
+
+	static constexpr char manifestSignature[] = "FACEDB-MANIFEST";
+	static constexpr int manifestVersion = 2;
+
+	static std::string manifestPath(const std::string& databasePath) { return databasePath + ".manifest"; }
+
+	// Returns std::nullopt if there is no valid checkpoint for the database
+	static std::optional<Checkpoint> loadCheckpoint(const std::string& databasePath);
+
 	static void dummyReporter(const std::string&) noexcept {};
 
+	static bool isBinaryFile(const std::string& databasePath);
+
+	void loadText(const std::string& databasePath);
+
+	void loadBinary(const std::string& databasePath);
+
+	void saveText(std::ostream& db) const;
+
+	void saveBinary(std::ostream& db) const;
+
+	void addDescriptor(const Descriptor& descriptor, std::size_t label);
+
+	void buildIndex();
+
+	// Copies of the database share the index until one of them modifies it
+	SearchIndex& mutableIndex();
+
+	bool isApproximate() const noexcept { return this->searchIndex != nullptr; }
+
+	static std::vector<std::size_t> makeBlocks(std::size_t count, std::size_t blockSize);
+
+	std::vector<std::pair<std::string, double>> match(const Descriptor& query, std::size_t k, bool uniqueLabels) const;
+
+	// Returns the distance (squared for squared metrics) between the i-th stored descriptor and the query
+	double distanceTo(std::size_t i, const float* queryData, const Descriptor& query) const;
+
+	// The search functions return indices of the nearest descriptors
+	std::vector<NearestNeighbors::Neighbor> findExact(const float* queryData, const Descriptor& query, std::size_t k, bool uniqueLabels) const;
+
+	std::vector<NearestNeighbors::Neighbor> findApproximate(const float* queryData, const Descriptor& query, std::size_t k, bool uniqueLabels) const;
+
+	std::vector<std::vector<std::pair<std::string, double>>> matchBatch(const std::vector<std::optional<Descriptor>>& queries, 
+		std::size_t k, bool uniqueLabels);
+
+	// Chooses between the batched and the separate search for the queries
+	std::vector<std::vector<std::pair<std::string, double>>> matchQueries(const std::vector<std::optional<Descriptor>>& queries, 
+		std::size_t k, bool uniqueLabels);
+
+	std::vector<std::pair<std::string, double>> toMatches(std::vector<NearestNeighbors::Neighbor> nearest) const;
+
+	template <class Distance>
+	std::vector<NearestNeighbors::Neighbor> findNearest(std::size_t count, std::size_t k, bool uniqueLabels, Distance distance) const;
+
 	DescriptorComputer descriptorComputer;
 	const DescriptorMetric descriptorMetric;
 	Reporter reporter = &dummyReporter;		// does not throw if initialized by a function pointer
-	std::vector<std::string> labels;
-	std::vector<std::pair<Descriptor, std::size_t>> faceMap;	
+	LabelTable labels;
+	DescriptorStore store;
+	std::shared_ptr<SearchIndex> searchIndex;		// null for the exhaustive search
+	FileIndex files;		// the dataset files the descriptors were computed from
+	EnrollmentLog log;		// copies of the database are not attached to the file
+	std::size_t compactionThreshold = 1024;
+	std::size_t rerankSize = 100;
 };	// FaceDb
 
 
 
 
 template <class DescriptorComputer, class DescriptorMetric>
-void FaceDb<DescriptorComputer, DescriptorMetric>::create(const std::string& datasetPath)
+void FaceDb<DescriptorComputer, DescriptorMetric>::create(const std::string& datasetPath, const std::string& databasePath, bool resume)
 {
 	this->reporter("Creating the database from " + datasetPath);
 
-	this->faceMap.clear();
+	if (resume && databasePath.empty())
+		throw std::invalid_argument("Database creation can only be resumed if the database file is specified.");
+
+	this->log.close();
+	this->store.clear();
 	this->labels.clear();
+	this->files.clear();
+
+	// The descriptors are streamed to a temporary file, so the existing database stays intact in case of a failure. The manifest lists
+	// the labels and the processed files. A chunk is committed by a checkpoint line appended to the manifest after the descriptors 
+	// have been written, so anything written after the last checkpoint is discarded when creation is resumed.
+	std::string tempPath = databasePath + ".tmp";
+	std::ofstream db, manifest;
+	std::optional<BinaryWriter> writer;
+	std::optional<Checkpoint> checkpoint;
+	std::uint64_t descriptorCount = 0;		// the position of the next descriptor in the database
+	if (!databasePath.empty())
+	{
+		db.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+		manifest.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+		if (resume && (checkpoint = loadCheckpoint(databasePath)))
+		{
+			// Drop the descriptors and the records of an uncommitted chunk
+			std::filesystem::resize_file(tempPath, checkpoint->fileSize);
+			std::filesystem::resize_file(manifestPath(databasePath), checkpoint->manifestSize);
+
+			db.open(tempPath, std::ios::in | std::ios::out | std::ios::binary);
+			db.seekp(0, std::ios::end);
+			descriptorCount = checkpoint->descriptorLabels.size();
+			writer.emplace(db, checkpoint->dimension, std::move(checkpoint->descriptorLabels));
+			manifest.open(manifestPath(databasePath), std::ios::out | std::ios::app);
+			manifest << '\n';
+			this->labels = std::move(checkpoint->labels);
+			this->files = std::move(checkpoint->files);
+
+			this->reporter("Resuming from the checkpoint with " + std::to_string(checkpoint->processedFiles.size()) + " processed files");
+		}
+		else
+		{
+			db.open(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+			writer.emplace(db);
+			manifest.open(manifestPath(databasePath), std::ios::out | std::ios::trunc);
+			manifest << manifestSignature << ' ' << manifestVersion << ' ' << std::quoted(DescriptorComputerType<DescriptorComputer>::id) << '\n';
+		}
+	}	// database path specified
 
-	std::size_t label = 0;
-	std::vector<std::filesystem::path> fileEntries;
-	std::vector<std::size_t> fileLabels;
+	std::vector<std::filesystem::path> chunkFiles;
+	std::vector<std::string> chunkNames;	// relative paths recorded in the manifest
+	std::vector<std::size_t> chunkLabels;
+	std::size_t numFiles = 0, numDescriptors = 0;
+	auto processChunk = [this, &chunkFiles, &chunkNames, &chunkLabels, &db, &manifest, &writer, &numFiles, &numDescriptors, &descriptorCount]
+		{
+			auto descriptors = this->descriptorComputer(chunkFiles);
+			std::size_t firstEntry = this->files.size();
+			for (std::size_t i = 0; i < descriptors.size(); ++i)
+			{
+				auto entry = FileIndex::stat(chunkFiles[i], chunkNames[i]);
+				entry.hash = FileIndex::hashFile(chunkFiles[i]);
+				if (descriptors[i])
+				{
+					addDescriptor(*descriptors[i], chunkLabels[i]);
+					entry.descriptor = descriptorCount++;
+				}
+				this->files.add(std::move(entry));
+			}
 
-	// Scan the dataset directory adding files to the processing list and subfolder names to the list of labels
-	for (const auto& dirEntry : std::filesystem::directory_iterator(datasetPath))
+			numFiles += chunkFiles.size();
+			numDescriptors += std::count_if(descriptors.cbegin(), descriptors.cend(), [](const auto& d) { return d.has_value(); });
+			this->reporter("Processed " + std::to_string(numFiles) + " files, " + std::to_string(numDescriptors) + " faces found");
+
+			if (writer)		// the store only serves as a buffer for the chunk
+			{
+				{
+					Metrics::Timer timer(Metrics::Stage::DatabaseIo, this->store.size());
+					writer->write(this->store.data(), this->store.labels(), this->store.size(), this->store.dimension());
+					db.flush();
+				}
+				this->store.clear();
+
+				for (std::size_t i = 0; i < chunkNames.size(); ++i)
+				{
+					const auto& entry = this->files[firstEntry + i];
+					manifest << "F " << descriptors[i].has_value() << ' ' << chunkLabels[i] << ' ' << entry.size << ' ' << entry.modified
+						<< ' ' << entry.hash << ' ' << std::quoted(entry.path) << '\n';
+				}
+				manifest << "C " << writer->size() << '\n';
+				manifest.flush();
+			}
+
+			chunkFiles.clear();
+			chunkNames.clear();
+			chunkLabels.clear();
+		};	// processChunk
+
+	try
 	{
-		if (dirEntry.is_directory())
+		// Walk the dataset directory lazily adding subfolder names to the list of labels and files to the current chunk
+		for (const auto& dirEntry : std::filesystem::directory_iterator(datasetPath))
 		{
-			auto dirIt = std::filesystem::directory_iterator(dirEntry);
-			std::copy_if(std::filesystem::begin(dirIt), std::filesystem::end(dirIt), std::back_inserter(fileEntries),
-				[](const auto& entry) {	return entry.is_regular_file();	});
+			if (!dirEntry.is_directory())
+				continue;
 
-			std::fill_n(std::back_inserter(fileLabels), fileEntries.size() - fileLabels.size(), label);
+			std::string labelName = dirEntry.path().filename().string();
+			auto [labelIdx, inserted] = this->labels.insert(labelName);
+			if (inserted && writer)
+				manifest << "L " << std::quoted(labelName) << '\n';
 
-			this->labels.push_back(dirEntry.path().filename().string());
-			++label;
-		}	// is directory
-	}	// for dirEntry
+			for (const auto& fileEntry : std::filesystem::directory_iterator(dirEntry))
+			{
+				if (!fileEntry.is_regular_file())
+					continue;
+
+				std::string name = labelName + '/' + fileEntry.path().filename().string();
+				if (checkpoint && std::binary_search(checkpoint->processedFiles.cbegin(), checkpoint->processedFiles.cend(), name))
+					continue;	// processed before the checkpoint
 
-	assert(fileEntries.size() == fileLabels.size());
+				chunkFiles.push_back(fileEntry.path());
+				chunkNames.push_back(std::move(name));
+				chunkLabels.push_back(labelIdx);
+				if (chunkFiles.size() == datasetChunkSize)
+					processChunk();
+			}	// for fileEntry
+		}	// for dirEntry
 
-	// Compute descriptors for each file
-	this->reporter("Processing " + std::to_string(fileEntries.size()) + " files in " + std::to_string(this->labels.size()) + " directories...");
-	auto descriptors = this->descriptorComputer(fileEntries);
+		if (!chunkFiles.empty())
+			processChunk();
 
-	// Add the descriptors and labels to the database	
-	this->faceMap.reserve(descriptors.size());
-	for (std::size_t i = 0; i < descriptors.size(); ++i)
+		this->reporter("Processed " + std::to_string(numFiles) + " files in " + std::to_string(this->labels.size()) + " directories.");
+
+		if (writer)
+		{
+			writer->finish(this->labels);
+			db.close();
+			manifest.close();
+			std::filesystem::rename(tempPath, databasePath);
+			std::filesystem::remove(manifestPath(databasePath));
+			loadBinary(databasePath);	// the descriptors are mapped rather than kept in memory
+			this->files.save(databasePath + FileIndex::fileExtension(), this->store);
+			this->log.reset(databasePath, this->store);
+			this->reporter("The database has been saved to " + databasePath);
+		}
+	}	// try
+	catch (const std::ios_base::failure& e)
 	{
-		if (descriptors[i])
-			this->faceMap.emplace_back(*std::move(descriptors[i]), fileLabels[i]);	// constexpr T&& optional::operator*() &&
+		// The temporary file and the manifest are kept, so creation can be resumed
+		throw std::ios_base::failure("Failed to save the database file " + databasePath, e.code());
+	}
+
+	if (this->searchIndex)
+	{
+		buildIndex();
+		if (!databasePath.empty())
+			this->searchIndex->save(databasePath + this->searchIndex->fileExtension());
 	}
 
 	this->reporter("The database has been created.");
 }	// create
 
 
+template <class DescriptorComputer, class DescriptorMetric>
+auto FaceDb<DescriptorComputer, DescriptorMetric>::loadCheckpoint(const std::string& databasePath) -> std::optional<Checkpoint>
+{
+	std::ifstream manifest(manifestPath(databasePath));
+	std::string signature, typeId;
+	int version = 0;
+	if (!(manifest >> signature >> version >> std::quoted(typeId)) || signature != manifestSignature || version != manifestVersion
+		|| typeId != DescriptorComputerType<DescriptorComputer>::id)
+		return std::nullopt;
+
+	// Records following the last checkpoint belong to a chunk which has not been committed
+	Checkpoint checkpoint;
+	std::vector<std::string> labels;
+	std::vector<std::uint32_t> descriptorLabels;
+	std::vector<FileIndex::Entry> files;
+	std::size_t committedLabels = 0, committedDescriptors = 0, committedFiles = 0;
+	for (std::string tag; manifest >> tag; )
+	{
+		if (tag == "L")
+		{
+			std::string label;
+			if (!(manifest >> std::quoted(label)))
+				break;
+			labels.push_back(std::move(label));
+		}
+		else if (tag == "F")
+		{
+			bool found = false;
+			std::size_t label = 0;
+			FileIndex::Entry entry;
+			if (!(manifest >> found >> label >> entry.size >> entry.modified >> entry.hash >> std::quoted(entry.path)) || label >= labels.size())
+				break;
+			if (found)
+			{
+				entry.descriptor = descriptorLabels.size();
+				descriptorLabels.push_back(static_cast<std::uint32_t>(label));
+			}
+			files.push_back(std::move(entry));
+		}
+		else if (tag == "C")
+		{
+			if (!(manifest >> checkpoint.fileSize) || manifest.peek() != '\n')
+				break;		// the number may have been cut off
+			checkpoint.manifestSize = static_cast<std::uint64_t>(manifest.tellg());
+			committedLabels = labels.size();
+			committedDescriptors = descriptorLabels.size();
+			committedFiles = files.size();
+		}
+		else break;		// a partially written line
+	}	// for tag
+
+	labels.resize(committedLabels);
+	for (const auto& label : labels)
+		checkpoint.labels.push_back(label);
+	descriptorLabels.resize(committedDescriptors);
+	checkpoint.descriptorLabels = std::move(descriptorLabels);
+	files.erase(files.begin() + committedFiles, files.end());
+	for (auto& entry : files)
+	{
+		checkpoint.processedFiles.push_back(entry.path);
+		checkpoint.files.add(std::move(entry));
+	}
+
+	// Make sure that the temporary database file holds all committed descriptors, and derive their dimension from its size
+	std::error_code ec;
+	auto fileSize = std::filesystem::file_size(databasePath + ".tmp", ec);
+	std::uint64_t blockSize = checkpoint.fileSize - std::min(checkpoint.fileSize, BinaryWriter::descriptorOffset());
+	std::uint64_t rowSize = checkpoint.descriptorLabels.empty() ? 0 : blockSize / checkpoint.descriptorLabels.size();
+	if (ec || fileSize < checkpoint.fileSize || checkpoint.fileSize < BinaryWriter::descriptorOffset()
+		|| rowSize * checkpoint.descriptorLabels.size() != blockSize || rowSize % sizeof(float) != 0)
+		return std::nullopt;
+
+	checkpoint.dimension = static_cast<std::size_t>(rowSize / sizeof(float));
+	std::sort(checkpoint.processedFiles.begin(), checkpoint.processedFiles.end());
+	return checkpoint;
+}	// loadCheckpoint
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::update(const std::string& datasetPath)
+{
+	this->reporter("Updating the database from " + datasetPath);
+
+	this->log.close();		// the log is based on the descriptors which are going to be replaced
+
+	if (this->files.empty() && !this->store.empty())
+		this->reporter("The database has no file index, so all files will be processed.");
+
+	// Known files are looked up by their paths relative to the dataset directory
+	std::unordered_map<std::string, const FileIndex::Entry*> known;
+	for (const auto& entry : this->files)
+		known.emplace(entry.path, &entry);
+
+	// Descriptors of unchanged files are copied to the new store right away, the others are computed afterwards
+	LabelTable labels;
+	DescriptorStore store;
+	FileIndex files;
+	std::vector<std::filesystem::path> pendingFiles;
+	std::vector<FileIndex::Entry> pendingEntries;
+	std::vector<std::size_t> pendingLabels;
+	std::size_t numUnchanged = 0, numChanged = 0;
+	for (const auto& dirEntry : std::filesystem::directory_iterator(datasetPath))
+	{
+		if (!dirEntry.is_directory())
+			continue;
+
+		std::string labelName = dirEntry.path().filename().string();
+		std::size_t labelIdx = labels.push_back(labelName);
+
+		for (const auto& fileEntry : std::filesystem::directory_iterator(dirEntry))
+		{
+			if (!fileEntry.is_regular_file())
+				continue;
+
+			auto entry = FileIndex::stat(fileEntry.path(), labelName + '/' + fileEntry.path().filename().string());
+			auto it = known.find(entry.path);
+			if (it != known.end() && it->second->size == entry.size
+				&& (it->second->modified == entry.modified || (entry.hash = FileIndex::hashFile(fileEntry.path())) == it->second->hash))
+			{
+				entry.hash = it->second->hash;
+				if (it->second->descriptor != FileIndex::noDescriptor)
+				{
+					entry.descriptor = store.size();
+					store.push_back(this->store.descriptor(static_cast<std::size_t>(it->second->descriptor)), this->store.dimension(), 
+						static_cast<std::uint32_t>(labelIdx));
+				}
+
+				files.add(std::move(entry));
+				++numUnchanged;
+			}	// unchanged file
+			else
+			{
+				numChanged += it != known.end();
+				pendingFiles.push_back(fileEntry.path());
+				pendingEntries.push_back(std::move(entry));
+				pendingLabels.push_back(labelIdx);
+			}	// new or modified file
+		}	// for fileEntry
+	}	// for dirEntry
+
+	std::size_t numAdded = pendingFiles.size() - numChanged, numDeleted = this->files.size() - numUnchanged - numChanged;
+	this->reporter(std::to_string(numAdded) + " new, " + std::to_string(numChanged) + " modified, " + std::to_string(numDeleted)
+		+ " deleted, and " + std::to_string(numUnchanged) + " unchanged files found.");
+
+	// The database is only modified once all descriptors have been computed
+	for (std::size_t first = 0; first < pendingFiles.size(); first += datasetChunkSize)
+	{
+		std::size_t last = std::min(first + datasetChunkSize, pendingFiles.size());
+		auto descriptors = this->descriptorComputer(std::vector<std::filesystem::path>(pendingFiles.begin() + first, pendingFiles.begin() + last));
+		for (std::size_t i = first; i < last; ++i)
+		{
+			auto& entry = pendingEntries[i];
+			entry.hash = FileIndex::hashFile(pendingFiles[i]);
+			if (const auto& descriptor = descriptors[i - first])
+			{
+				entry.descriptor = store.size();
+				DescriptorData<Descriptor>::copy(*descriptor, store.append(DescriptorData<Descriptor>::size(*descriptor), 
+					static_cast<std::uint32_t>(pendingLabels[i])));
+			}
+			files.add(std::move(entry));
+		}
+
+		this->reporter("Processed " + std::to_string(last) + " of " + std::to_string(pendingFiles.size()) + " files");
+	}	// for first
+
+	this->labels = std::move(labels);
+	this->store = std::move(store);
+	this->files = std::move(files);
+
+	// Removed descriptors invalidate the positions stored in the index
+	if (this->searchIndex)
+		buildIndex();
+
+	this->reporter("The database has been updated.");
+}	// update
+
+
 template <class DescriptorComputer, class DescriptorMetric>
 void FaceDb<DescriptorComputer, DescriptorMetric>::load(const std::string& databasePath)
 {
-	try
+	this->reporter("Loading the database from " + databasePath);
+
+	this->log.close();
+
 	{
-		this->reporter("Loading the database from " + databasePath);
+		Metrics::Timer timer(Metrics::Stage::DatabaseIo);
+		if (isBinaryFile(databasePath))
+			loadBinary(databasePath);
+		else
+			loadText(databasePath);
+		timer.setItems(this->store.size());
+	}
+
+	if (!this->files.load(databasePath + FileIndex::fileExtension(), this->store))
+		this->files.clear();	// the database cannot be updated incrementally
+
+	if (this->searchIndex)
+	{
+		if (mutableIndex().load(databasePath + this->searchIndex->fileExtension(), this->store))
+			this->reporter("The " + this->searchIndex->name() + " has been loaded.");
+		else
+			buildIndex();		// the index has not been saved or is outdated
+	}
+
+	// Replay the enrollments logged since the database file was written
+	auto records = this->log.open(databasePath, this->store);
+	for (const auto& record : records)
+	{
+		std::size_t labelIdx = this->labels.insert(record.label).first;
+		this->store.push_back(record.descriptor.data(), record.descriptor.size(), static_cast<std::uint32_t>(labelIdx));
+	}
+
+	if (!records.empty())
+	{
+		if (this->searchIndex)
+			mutableIndex().update(this->store);
+		this->reporter("Replayed " + std::to_string(records.size()) + " enrollments from the log.");
+	}
+
+	this->reporter("The database has been loaded.");
+}	// load
 
+
+template <class DescriptorComputer, class DescriptorMetric>
+bool FaceDb<DescriptorComputer, DescriptorMetric>::isBinaryFile(const std::string& databasePath)
+{
+	char magic[sizeof(FileHeader::signature)] = {};
+	std::ifstream db(databasePath, std::ios::in | std::ios::binary);
+	if (!db)
+		throw std::ios_base::failure("Failed to open the database file " + databasePath);
+
+	db.read(magic, sizeof(magic));
+	return db.gcount() == sizeof(magic) && std::equal(std::cbegin(magic), std::cend(magic), std::cbegin(FileHeader::signature));
+}	// isBinaryFile
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::loadText(const std::string& databasePath)
+{
+	try
+	{
 		std::ifstream db(databasePath, std::ios::in);
 
 		// Set the mask of error states on occurrence of which the stream throws an exception of type failure
@@ -185,58 +809,137 @@ void FaceDb<DescriptorComputer, DescriptorMetric>::load(const std::string& datab
 		// Load labels
 		std::size_t numLabels;
 		db >> numLabels;
-		this->labels.resize(numLabels);
+		this->labels.clear();
 		for (std::size_t i = 0; i < numLabels; ++i)
-			db >> std::quoted(this->labels[i]);		// read each label string removing quotes
+		{
+			std::string label;
+			db >> std::quoted(label);		// read each label string removing quotes
+			this->labels.push_back(label);
+		}
 
 		// Load descriptors 
 		std::size_t numDescriptors = 0;
 		db >> numDescriptors;
-		this->faceMap.clear();
-		this->faceMap.reserve(numDescriptors);
+		this->store.clear();
+		this->store.reserve(numDescriptors);
 		for (std::size_t i = 0; i < numDescriptors; ++i)
 		{
 			Descriptor d;		// descriptors must be default-constructible
 			std::size_t label;
 			db >> label >> d;		// descriptors must be deserializable by means of >> operator
-			this->faceMap.emplace_back(std::move(d), label);	// add the descriptor and the label to the map
+			addDescriptor(d, label);	// add the descriptor and the label to the store
 		}	// i
-
-		this->reporter("The database has been loaded.");
 	}	// try
 	catch (const std::ios_base::failure& e)
 	{
 		throw std::ios_base::failure("Failed to load the database file " + databasePath, e.code());
 	}
-}	// load
+}	// loadText
 
 
 template <class DescriptorComputer, class DescriptorMetric>
-void FaceDb<DescriptorComputer, DescriptorMetric>::save(const std::string& databasePath)
+void FaceDb<DescriptorComputer, DescriptorMetric>::loadBinary(const std::string& databasePath)
+{
+	auto file = std::make_shared<const MappedFile>(databasePath);
+
+	binaryio::MemoryReader reader(file->data(), file->size());
+	auto header = reader.read<FileHeader>();
+	if (header.byteOrderMark != binaryio::byteOrderMark)
+		throw std::runtime_error("The database file was saved on a platform with different byte order.");
+	if (header.version != FileHeader::currentVersion)
+		throw std::runtime_error("Unsupported version of the database file: " + std::to_string(header.version));
+
+	// Make sure that the database was saved for the same type of descriptor computer
+	if (reader.readString() != DescriptorComputerType<DescriptorComputer>::id)
+		throw std::runtime_error("The database file was saved for another descriptor type.");
+
+	// The descriptor block and the label indices must fit in the file. The bounds are checked by division, so a corrupted header 
+	// cannot overflow the products.
+	if (header.numLabels > std::numeric_limits<std::uint32_t>::max() || header.descriptorOffset > file->size()
+		|| header.numDescriptors > file->size() / sizeof(std::uint32_t)
+		|| (header.dimension > 0 && header.numDescriptors > (file->size() - header.descriptorOffset) / sizeof(float) / header.dimension))
+		throw std::runtime_error("The database file is corrupted.");
+
+	// The descriptors and the label indices are read in place, and the mapping starts at a page boundary, so their offsets must be 
+	// aligned as written (the vectorized kernels rely on the alignment of the descriptor block)
+	if (header.descriptorOffset % FileHeader::alignment != 0 || header.labelIndexOffset % alignof(std::uint32_t) != 0)
+		throw std::runtime_error("The database file is corrupted.");
+
+	auto dimension = static_cast<std::size_t>(header.dimension);
+	auto count = static_cast<std::size_t>(header.numDescriptors);
+
+	// The descriptor block is aligned, so the floats can be accessed directly in the mapped memory
+	reader.seek(static_cast<std::size_t>(header.descriptorOffset));
+	auto descriptors = reinterpret_cast<const float*>(reader.view(count * dimension * sizeof(float)));
+
+	reader.seek(static_cast<std::size_t>(header.labelIndexOffset));
+	auto descriptorLabels = reinterpret_cast<const std::uint32_t*>(reader.view(count * sizeof(std::uint32_t)));
+	if (std::any_of(descriptorLabels, descriptorLabels + count, [&header](std::uint32_t label) { return label >= header.numLabels; }))
+		throw std::runtime_error("The database file is corrupted.");
+
+	// Labels are few compared to descriptors, so they are simply copied
+	reader.seek(static_cast<std::size_t>(header.labelTableOffset));
+	auto numLabels = static_cast<std::size_t>(header.numLabels);
+	const char* offsets = reader.view((numLabels + 1) * sizeof(std::uint64_t));
+	std::size_t base = reader.tell();
+	std::uint64_t numChars;
+	std::memcpy(&numChars, offsets + numLabels * sizeof(std::uint64_t), sizeof(numChars));
+	LabelTable labels;
+	labels.reserve(numLabels, static_cast<std::size_t>(std::min<std::uint64_t>(numChars, file->size())));
+	for (std::size_t i = 0; i < numLabels; ++i)
+	{
+		std::uint64_t head, tail;
+		std::memcpy(&head, offsets + i * sizeof(std::uint64_t), sizeof(head));
+		std::memcpy(&tail, offsets + (i + 1) * sizeof(std::uint64_t), sizeof(tail));
+		if (head > tail || tail > file->size())
+			throw std::runtime_error("The database file is corrupted.");
+
+		reader.seek(base + static_cast<std::size_t>(head));
+		labels.push_back(std::string_view(reader.view(static_cast<std::size_t>(tail - head)), static_cast<std::size_t>(tail - head)));
+	}	// i
+
+	this->labels = std::move(labels);
+	this->store.map(std::move(file), descriptors, descriptorLabels, count, dimension);
+}	// loadBinary
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::save(const std::string& databasePath, FaceDbFormat format)
 {
 	try
 	{
 		this->reporter("Saving the database to " + databasePath);
 
-		std::ofstream db(databasePath, std::ios::out);
-		db.exceptions(std::ios_base::badbit | std::ios_base::failbit);
-
-		// Save the type of the descriptor computer used for computing face descriptors, so it can be checked when loading
-		db << std::quoted(DescriptorComputerType<DescriptorComputer>::id) << std::endl;
+		this->log.close();		// wait for the compaction, which may be writing the same file
 
-		// Save labels
-		db << this->labels.size() << std::endl;
-		for (const auto& label : labels)
+		// Write to a temporary file first, so the existing database (which may currently be mapped) stays intact in case of a failure
+		std::string tempPath = databasePath + ".tmp";
 		{
-			db << std::quoted(label) << std::endl;		// quote the labels just in case there is a space
+			Metrics::Timer timer(Metrics::Stage::DatabaseIo, this->store.size());
+			std::ofstream db(tempPath, std::ios::out | std::ios::trunc | 
+				(format == FaceDbFormat::Binary ? std::ios::binary : std::ios::openmode{}));
+			db.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+
+			if (format == FaceDbFormat::Binary)
+				saveBinary(db);
+			else
+				saveText(db);
 		}
 
-		// Save descriptors
-		db << this->faceMap.size() << std::endl;
-		for (const auto& [descriptor, label] : this->faceMap)
-		{
-			db << label << std::endl << descriptor << std::endl;
-		}
+		std::filesystem::rename(tempPath, databasePath);
+
+		if (!this->files.empty())
+			this->files.save(databasePath + FileIndex::fileExtension(), this->store);
+
+		if (this->searchIndex)
+			this->searchIndex->save(databasePath + this->searchIndex->fileExtension());
+
+		// The file holds all enrolled descriptors now. Values in the text format are rounded, so enrollments are only logged
+		// for the binary one.
+		if (format == FaceDbFormat::Binary)
+			this->log.reset(databasePath, this->store);
+		else
+			std::filesystem::remove(databasePath + EnrollmentLog::fileExtension());
 
 		this->reporter("The database has been saved.");
 	} // try
@@ -247,80 +950,592 @@ void FaceDb<DescriptorComputer, DescriptorMetric>::save(const std::string& datab
 }	// save
 
 
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::saveText(std::ostream& db) const
+{
+	// Save the type of the descriptor computer used for computing face descriptors, so it can be checked when loading
+	db << std::quoted(DescriptorComputerType<DescriptorComputer>::id) << std::endl;
+
+	// Save labels
+	db << this->labels.size() << std::endl;
+	for (std::size_t i = 0; i < this->labels.size(); ++i)
+	{
+		db << std::quoted(this->labels[i]) << std::endl;		// quote the labels just in case there is a space
+	}
+
+	// Save descriptors
+	db << this->store.size() << std::endl;
+	for (std::size_t i = 0; i < this->store.size(); ++i)
+	{
+		db << this->store.label(i) << std::endl 
+			<< DescriptorData<Descriptor>::make(this->store.descriptor(i), this->store.dimension()) << std::endl;
+	}
+}	// saveText
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::saveBinary(std::ostream& db) const
+{
+	BinaryWriter writer(db);
+	writer.write(this->store.data(), this->store.labels(), this->store.size(), this->store.dimension());
+	writer.finish(this->labels);
+}	// saveBinary
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+FaceDb<DescriptorComputer, DescriptorMetric>::BinaryWriter::BinaryWriter(std::ostream& db)
+	: db(db)
+{
+	std::copy(std::cbegin(FileHeader::signature), std::cend(FileHeader::signature), this->header.magic);
+	this->header.version = FileHeader::currentVersion;
+	this->header.byteOrderMark = binaryio::byteOrderMark;
+	binaryio::write(db, this->header);	// the counts and offsets are updated when we know them
+	binaryio::writeString(db, DescriptorComputerType<DescriptorComputer>::id);
+
+	// Descriptors are written as one packed block, which can be searched without parsing
+	this->header.descriptorOffset = binaryio::pad(db, FileHeader::alignment);
+	assert(this->header.descriptorOffset == descriptorOffset());
+}	// BinaryWriter
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+FaceDb<DescriptorComputer, DescriptorMetric>::BinaryWriter::BinaryWriter(std::ostream& db, std::size_t dimension, 
+	std::vector<std::uint32_t> descriptorLabels)
+	: db(db)
+	, descriptorLabels(std::move(descriptorLabels))
+{
+	std::copy(std::cbegin(FileHeader::signature), std::cend(FileHeader::signature), this->header.magic);
+	this->header.version = FileHeader::currentVersion;
+	this->header.byteOrderMark = binaryio::byteOrderMark;
+	this->header.dimension = dimension;
+	this->header.numDescriptors = this->descriptorLabels.size();
+	this->header.descriptorOffset = descriptorOffset();
+}	// BinaryWriter
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::uint64_t FaceDb<DescriptorComputer, DescriptorMetric>::BinaryWriter::descriptorOffset() noexcept
+{
+	// The type id is written as a 64-bit length followed by characters
+	return binaryio::alignUp(sizeof(FileHeader) + sizeof(std::uint64_t) + DescriptorComputerType<DescriptorComputer>::id.size(), 
+		FileHeader::alignment);
+}	// descriptorOffset
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::uint64_t FaceDb<DescriptorComputer, DescriptorMetric>::BinaryWriter::size() const noexcept
+{
+	std::uint64_t offset = descriptorOffset(), dimension = this->header.dimension, count = this->header.numDescriptors;
+	if (dimension > 0 && count > (std::numeric_limits<std::uint64_t>::max() - offset) / sizeof(float) / dimension)
+		return std::numeric_limits<std::uint64_t>::max();
+
+	return offset + count * dimension * sizeof(float);
+}	// size
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::BinaryWriter::write(const float* descriptors, const std::uint32_t* descriptorLabels, 
+	std::size_t count, std::size_t dimension)
+{
+	if (count == 0)
+		return;
+
+	if (this->header.numDescriptors == 0)
+		this->header.dimension = dimension;
+	else if (dimension != this->header.dimension)
+		throw std::runtime_error("The size of the descriptor does not match the other descriptors in the database.");
+
+	binaryio::write(this->db, descriptors, count * dimension);
+	this->descriptorLabels.insert(this->descriptorLabels.end(), descriptorLabels, descriptorLabels + count);
+	this->header.numDescriptors += count;
+}	// write
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::BinaryWriter::finish(const LabelTable& labels)
+{
+	if (labels.size() > std::numeric_limits<std::uint32_t>::max())
+		throw std::runtime_error("Too many labels for the binary database format.");
+
+	this->header.numLabels = labels.size();
+
+	this->header.labelIndexOffset = binaryio::pad(this->db, FileHeader::alignment);
+	binaryio::write(this->db, this->descriptorLabels.data(), this->descriptorLabels.size());
+
+	// The label table consists of offsets relative to the end of the offset array followed by label strings, i.e. it is written
+	// exactly as the labels are kept in memory
+	this->header.labelTableOffset = binaryio::pad(this->db, FileHeader::alignment);
+	binaryio::write(this->db, labels.offsetData().data(), labels.offsetData().size());
+	this->db.write(labels.data().data(), static_cast<std::streamsize>(labels.data().size()));
+
+	this->db.seekp(0);
+	binaryio::write(this->db, this->header);
+}	// finish
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::addDescriptor(const Descriptor& descriptor, std::size_t label)
+{
+	if (label > std::numeric_limits<std::uint32_t>::max())
+		throw std::runtime_error("Too many labels in the database.");
+
+	DescriptorData<Descriptor>::copy(descriptor, this->store.append(DescriptorData<Descriptor>::size(descriptor), static_cast<std::uint32_t>(label)));
+}	// addDescriptor
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::buildIndex()
+{
+	this->reporter("Building the " + this->searchIndex->name() + " for " + std::to_string(this->store.size()) + " descriptors...");
+	mutableIndex().build(this->store);
+}	// buildIndex
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+SearchIndex& FaceDb<DescriptorComputer, DescriptorMetric>::mutableIndex()
+{
+	assert(this->searchIndex);
+	if (this->searchIndex.use_count() > 1)
+		this->searchIndex = this->searchIndex->clone();
+
+	return *this->searchIndex;
+}	// mutableIndex
+
+
 
 template <class DescriptorComputer, class DescriptorMetric>
 std::pair<std::string, double> FaceDb<DescriptorComputer, DescriptorMetric>::find(const std::string& imageFile)
+{
+	auto matches = findTopK(imageFile, 1);
+	return matches.empty() ? std::make_pair(std::string(), std::numeric_limits<double>::infinity()) : std::move(matches.front());
+}	// find
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<std::pair<std::string, double>> FaceDb<DescriptorComputer, DescriptorMetric>::findTopK(const std::string& imageFile, 
+	std::size_t k, bool uniqueLabels)
 {
 	this->reporter("Identifying the person in " + imageFile);
 	std::optional<Descriptor> query = this->descriptorComputer(imageFile);
 	if (!query)
 	{
 		this->reporter("Could not compute the descriptor for " + imageFile);
-		return { "", std::numeric_limits<double>::infinity() };
+		return {};
 	}
 
-#ifdef PARALLEL_EXECUTION
-	const auto &executionPolicy = std::execution::par;
-#else
-	const auto &executionPolicy = std::execution::seq;
-#endif
-	
-	std::exception_ptr eptr;	// a default-constructed std::exception_ptr is a null pointer; it does not point to an exception object
-	std::atomic<bool> eflag{ false };	// exception occurrence flag
-	auto best = std::transform_reduce(executionPolicy, this->faceMap.cbegin(), this->faceMap.cend(),
-		std::make_pair(0, std::numeric_limits<double>::infinity()),
-		[](const std::pair<std::size_t, double>& x, const std::pair<std::size_t, double>& y) noexcept	// reduce
+	return match(*query, k, uniqueLabels);
+}	// findTopK
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<std::vector<std::pair<std::string, double>>> FaceDb<DescriptorComputer, DescriptorMetric>::findBatch(
+	const std::vector<std::filesystem::path>& files, std::size_t k, bool uniqueLabels)
+{
+	std::vector<std::vector<std::pair<std::string, double>>> results;
+	results.reserve(files.size());
+
+	findBatch(files, k, uniqueLabels, [&results](std::size_t, std::vector<std::vector<std::pair<std::string, double>>>& blockResults)
 		{
-			return x.second < y.second ? x : y;
+			std::move(blockResults.begin(), blockResults.end(), std::back_inserter(results));
+		});
+
+	return results;
+}	// findBatch
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+template <class BlockConsumer>
+void FaceDb<DescriptorComputer, DescriptorMetric>::findBatch(const std::vector<std::filesystem::path>& files, std::size_t k, 
+	bool uniqueLabels, BlockConsumer&& consumer)
+{
+	this->reporter("Identifying people in " + std::to_string(files.size()) + " files...");
+
+	std::vector<std::optional<Descriptor>> queries(queryBlockSize);
+	std::vector<std::vector<std::pair<std::string, double>>> blockResults;
+	for (std::size_t head = 0; head < files.size(); head += queryBlockSize)
+	{
+		// The descriptor computer splits the block into batches of its own size
+		std::size_t tail = std::min(head + queryBlockSize, files.size());
+		queries.resize(tail - head);
+		this->descriptorComputer(files.cbegin() + head, files.cbegin() + tail, queries.begin());
+
+		blockResults = matchQueries(queries, k, uniqueLabels);
+		consumer(head, blockResults);
+	}	// head
+
+	this->reporter("Done.");
+}	// findBatch
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<FaceMatches> FaceDb<DescriptorComputer, DescriptorMetric>::findFaces(const std::string& imageFile, std::size_t k, 
+	bool uniqueLabels)
+{
+	this->reporter("Identifying the people in " + imageFile);
+	auto faces = this->descriptorComputer.computeFaces(imageFile);
+	if (faces.empty())
+	{
+		this->reporter("No faces have been found in " + imageFile);
+		return {};
+	}
+
+	std::vector<std::optional<Descriptor>> queries;
+	queries.reserve(faces.size());
+	for (auto& face : faces)
+		queries.emplace_back(std::move(face.second));
+
+	auto matches = matchQueries(queries, k, uniqueLabels);
+
+	std::vector<FaceMatches> results;
+	results.reserve(faces.size());
+	for (std::size_t i = 0; i < faces.size(); ++i)
+		results.emplace_back(faces[i].first, std::move(matches[i]));
+
+	return results;
+}	// findFaces
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+template <class BlockConsumer>
+void FaceDb<DescriptorComputer, DescriptorMetric>::findFacesBatch(const std::vector<std::filesystem::path>& files, std::size_t k, 
+	bool uniqueLabels, BlockConsumer&& consumer)
+{
+	this->reporter("Identifying people in " + std::to_string(files.size()) + " files...");
+
+	std::vector<decltype(this->descriptorComputer.computeFaces(std::string()))> faces(queryBlockSize);
+	std::vector<std::optional<Descriptor>> queries;
+	std::vector<std::vector<FaceMatches>> blockResults;
+	for (std::size_t head = 0; head < files.size(); head += queryBlockSize)
+	{
+		std::size_t tail = std::min(head + queryBlockSize, files.size());
+		faces.resize(tail - head);
+		this->descriptorComputer.computeFaces(files.cbegin() + head, files.cbegin() + tail, faces.begin());
+
+		// The faces of all files in the block are searched for at once
+		queries.clear();
+		for (auto& fileFaces : faces)
+		{
+			for (auto& face : fileFaces)
+				queries.emplace_back(std::move(face.second));
+		}
+
+		auto matches = matchQueries(queries, k, uniqueLabels);
+
+		blockResults.assign(faces.size(), {});
+		for (std::size_t i = 0, j = 0; i < faces.size(); ++i)
+		{
+			for (const auto& face : faces[i])
+				blockResults[i].emplace_back(face.first, std::move(matches[j++]));
+		}
+
+		consumer(head, blockResults);
+	}	// head
+
+	this->reporter("Done.");
+}	// findFacesBatch
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<std::vector<std::pair<std::string, double>>> FaceDb<DescriptorComputer, DescriptorMetric>::matchQueries(
+	const std::vector<std::optional<Descriptor>>& queries, std::size_t k, bool uniqueLabels)
+{
+	// Approximate searches process each query separately
+	if (isL2Metric && !isApproximate())
+		return matchBatch(queries, k, uniqueLabels);
+
+	std::vector<std::vector<std::pair<std::string, double>>> results;
+	results.reserve(queries.size());
+	for (const auto& query : queries)
+		results.push_back(query ? match(*query, k, uniqueLabels) : std::vector<std::pair<std::string, double>>{});
+
+	return results;
+}	// matchQueries
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<std::pair<std::string, double>> FaceDb<DescriptorComputer, DescriptorMetric>::match(const Descriptor& query, 
+	std::size_t k, bool uniqueLabels) const
+{
+	Metrics::Timer timer(Metrics::Stage::Search);
+	std::vector<NearestNeighbors::Neighbor> nearest;
+	if (!this->store.empty())
+	{
+		if (DescriptorData<Descriptor>::size(query) != this->store.dimension())
+			throw std::runtime_error("The size of the query descriptor does not match the database.");
+
+		std::vector<float> queryData(this->store.dimension());
+		DescriptorData<Descriptor>::copy(query, queryData.data());
+
+		if (isApproximate())
+			nearest = findApproximate(queryData.data(), query, k, uniqueLabels);
+		else
+			nearest = findExact(queryData.data(), query, k, uniqueLabels);
+
+		// Replace the descriptor indices by their labels
+		for (auto& neighbor : nearest)
+			neighbor.first = this->store.label(neighbor.first);
+	}	// not empty
+
+	return toMatches(std::move(nearest));
+}	// match
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+double FaceDb<DescriptorComputer, DescriptorMetric>::distanceTo(std::size_t i, const float* queryData, const Descriptor& query) const
+{
+	// The descriptors are compared directly in the store if the metric supports packed vectors.
+	// The descriptor metric must not create a race.
+	if constexpr (isSquaredMetric)
+		return this->descriptorMetric.squared(this->store.descriptor(i), queryData, this->store.dimension());
+	else if constexpr (isPackedMetric)
+		return this->descriptorMetric(this->store.descriptor(i), queryData, this->store.dimension());
+	else
+		return this->descriptorMetric(DescriptorData<Descriptor>::make(this->store.descriptor(i), this->store.dimension()), query);
+}	// distanceTo
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<NearestNeighbors::Neighbor> FaceDb<DescriptorComputer, DescriptorMetric>::findExact(const float* queryData, 
+	const Descriptor& query, std::size_t k, bool uniqueLabels) const
+{
+	auto nearest = findNearest(this->store.size(), k, uniqueLabels, [queryData, &query, this](std::size_t i)
+		{
+			return std::make_tuple(i, distanceTo(i, queryData, query), static_cast<std::size_t>(this->store.label(i)));
+		});
+
+	if constexpr (isSquaredMetric)
+	{
+		for (auto& neighbor : nearest)
+			neighbor.second = std::sqrt(neighbor.second);
+	}
+
+	return nearest;
+}	// findExact
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<NearestNeighbors::Neighbor> FaceDb<DescriptorComputer, DescriptorMetric>::findApproximate(const float* queryData, 
+	const Descriptor& query, std::size_t k, bool uniqueLabels) const
+{
+	assert(this->searchIndex && this->searchIndex->size() == this->store.size());
+	auto candidates = this->searchIndex->search(this->store, queryData, std::max(k, this->rerankSize), uniqueLabels);
+
+	// Re-rank them by exact distances. Only the pages of the float descriptors holding the candidates are touched.
+	for (auto& [i, distance] : candidates)
+	{
+		distance = distanceTo(i, queryData, query);
+		if constexpr (isSquaredMetric)
+			distance = std::sqrt(distance);
+	}
+
+	std::stable_sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+	if (candidates.size() > k)
+		candidates.resize(k);
+
+	return candidates;
+}	// findApproximate
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+double FaceDb<DescriptorComputer, DescriptorMetric>::estimateRecall(std::size_t k) const
+{
+	if (!isApproximate())
+		return 1.0;
+
+	constexpr std::size_t maxSamples = 100;
+	std::size_t numSamples = std::min(maxSamples, this->store.size()), found = 0, total = 0;
+	for (std::size_t s = 0; s < numSamples; ++s)
+	{
+		// Stored descriptors are used as queries, so the test does not require computing new descriptors
+		std::size_t i = s * this->store.size() / numSamples;
+		const float* queryData = this->store.descriptor(i);
+		Descriptor query = DescriptorData<Descriptor>::make(queryData, this->store.dimension());
+
+		auto exact = findExact(queryData, query, k, false);
+		auto approximate = findApproximate(queryData, query, k, false);
+		for (const auto& neighbor : exact)
+		{
+			found += std::any_of(approximate.cbegin(), approximate.cend(), 
+				[&neighbor](const auto& candidate) { return candidate.first == neighbor.first; });
+		}
+
+		total += exact.size();
+	}	// s
+
+	return total > 0 ? static_cast<double>(found) / total : 1.0;
+}	// estimateRecall
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<std::vector<std::pair<std::string, double>>> FaceDb<DescriptorComputer, DescriptorMetric>::matchBatch(
+	const std::vector<std::optional<Descriptor>>& queries, std::size_t k, bool uniqueLabels)
+{
+	std::vector<std::vector<std::pair<std::string, double>>> results(queries.size());
+	if (this->store.empty())
+		return results;
+
+	// Pack the successfully computed query descriptors into a matrix
+	std::size_t dim = this->store.dimension();
+	std::vector<float> queryData;
+	std::vector<std::size_t> queryIndices;
+	queryData.reserve(queries.size() * dim);
+	for (std::size_t i = 0; i < queries.size(); ++i)
+	{
+		if (!queries[i])
+			continue;
+
+		if (DescriptorData<Descriptor>::size(*queries[i]) != dim)
+			throw std::runtime_error("The size of the query descriptor does not match the database.");
+
+		queryData.resize(queryData.size() + dim);
+		DescriptorData<Descriptor>::copy(*queries[i], queryData.data() + queryData.size() - dim);
+		queryIndices.push_back(i);
+	}	// i
+
+	std::size_t numQueries = queryIndices.size();
+	if (numQueries == 0)
+		return results;
+
+	Metrics::Timer timer(Metrics::Stage::Search, numQueries);
+
+	// Squared L2 distances are expanded as |q|^2 + |g|^2 - 2*q.g, so the bulk of work is a matrix multiplication of 
+	// the query block by the gallery block, which reuses every loaded value for several queries
+	auto squaredDistance = l2kernels::select();
+	auto innerProducts = l2kernels::selectInnerProducts();
+	std::vector<float> queryNorms(numQueries), zero(dim, 0.0f);
+	for (std::size_t i = 0; i < numQueries; ++i)
+		queryNorms[i] = squaredDistance(queryData.data() + i * dim, zero.data(), dim);
+
+	const float* galleryNorms = this->store.squaredNorms();		// computed by the first query, which the others wait for
+
+	// The blocks are large enough to be processed one at a time
+	auto blocks = makeBlocks(this->store.size(), galleryBlockSize);
+	auto nearest = parallel::transformReduce(blocks.cbegin(), blocks.cend(), 
+		std::vector<NearestNeighbors>(numQueries, NearestNeighbors(k, uniqueLabels)),
+		[](std::vector<NearestNeighbors> x, const std::vector<NearestNeighbors>& y)	// reduce
+		{
+			for (std::size_t i = 0; i < x.size() && i < y.size(); ++i)
+				x[i].merge(y[i]);
+			return x;
 		},
-		[&query = *query, &eptr, &eflag, this](const std::pair<Descriptor, std::size_t>& p)	// transform
+		[&, galleryNorms](std::size_t head)	// transform
 		{
-			try
-			{
-				// The descriptor metric must not create a race
-				return std::make_pair(p.second, this->descriptorMetric(p.first, query));	// may throw an exception
-				//return std::make_pair(p.second, DescriptorMetric{ this->descriptorMetric }(p.first, query));	// may throw an exception
-			}
-			catch (...)
+			std::vector<NearestNeighbors> blockNearest(numQueries, NearestNeighbors(k, uniqueLabels));
+
+			std::size_t rows = std::min(galleryBlockSize, this->store.size() - head);
+			std::vector<float> products(numQueries * rows);
+			innerProducts(queryData.data(), numQueries, this->store.descriptor(head), rows, dim, products.data());
+
+			for (std::size_t i = 0; i < numQueries; ++i)
 			{
-				// Atomically check whether the exception flag has already been set and take care of memory consistency
-				if (!eflag.exchange(true, std::memory_order_acq_rel))
-					eptr = std::current_exception();
+				for (std::size_t j = 0; j < rows; ++j)
+				{
+					// Rounding errors may produce tiny negative values for nearly identical vectors
+					float d = std::max(0.0f, queryNorms[i] + galleryNorms[head + j] - 2 * products[i * rows + j]);
+					blockNearest[i].push(head + j, d, this->store.label(head + j));
+				}
+			}	// i
+
+			return blockNearest;
+		}, 1);	// transformReduce
+
+	// The expanded form loses precision for nearly identical vectors, so the distances to the best candidates are computed exactly
+	for (std::size_t i = 0; i < numQueries; ++i)
+	{
+		auto neighbors = nearest[i].sorted();
+		for (auto& [id, distance] : neighbors)
+		{
+			distance = std::sqrt(squaredDistance(this->store.descriptor(id), queryData.data() + i * dim, dim));
+			id = this->store.label(id);
+		}
+
+		std::stable_sort(neighbors.begin(), neighbors.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+		results[queryIndices[i]] = toMatches(std::move(neighbors));
+	}
+
+	return results;
+}	// matchBatch
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<std::pair<std::string, double>> FaceDb<DescriptorComputer, DescriptorMetric>::toMatches(
+	std::vector<NearestNeighbors::Neighbor> nearest) const
+{
+	std::vector<std::pair<std::string, double>> matches;
+	matches.reserve(nearest.size());
+	for (const auto& [label, distance] : nearest)
+		matches.emplace_back(std::string(this->labels.at(label)), distance);
+
+	return matches;
+}	// toMatches
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+std::vector<std::size_t> FaceDb<DescriptorComputer, DescriptorMetric>::makeBlocks(std::size_t count, std::size_t blockSize)
+{
+	std::vector<std::size_t> blocks((count + blockSize - 1) / blockSize);
+	for (std::size_t i = 0; i < blocks.size(); ++i)
+		blocks[i] = i * blockSize;
 
-				// std::pair does not throw exceptions unless one of the specified operations (e.g. constructor of an element) throws;
-				// std::numeric_limits<double>::infinity() is noexcept.
-				return std::make_pair(p.second, std::numeric_limits<double>::infinity());
+	return blocks;
+}	// makeBlocks
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+template <class Distance>
+std::vector<NearestNeighbors::Neighbor> FaceDb<DescriptorComputer, DescriptorMetric>::findNearest(std::size_t count, std::size_t k, 
+	bool uniqueLabels, Distance distance) const
+{
+	// The entries are processed in blocks, so there is no need to allocate an index for each of them. Every block keeps its own
+	// bounded heap of the nearest neighbors, and then these heaps are merged. An exception thrown by the distance function stops
+	// the search and is rethrown.
+	constexpr std::size_t blockSize = galleryBlockSize;
+	auto blocks = makeBlocks(count, blockSize);
+	auto nearest = parallel::transformReduce(blocks.cbegin(), blocks.cend(), NearestNeighbors(k, uniqueLabels),
+		[](NearestNeighbors x, const NearestNeighbors& y)	// reduce
+		{
+			x.merge(y);
+			return x;
+		},
+		[count, k, uniqueLabels, &distance](std::size_t head)	// transform
+		{
+			NearestNeighbors blockNearest(k, uniqueLabels);
+			for (std::size_t i = head, tail = std::min(head + blockSize, count); i < tail; ++i)
+			{
+				// The distance function returns an id and a distance, and optionally a group
+				std::apply([&blockNearest](auto... item) { blockNearest.push(item...); }, distance(i));
 			}
-		});	// transform_reduce
 
-	if (eptr)
-		std::rethrow_exception(eptr);
+			return blockNearest;
+		}, 1);	// transformReduce
 
-	return { this->labels.at(best.first), best.second };
-}	// find
+	return nearest.sorted();
+}	// findNearest
 
 
 template <class DescriptorComputer, class DescriptorMetric>
 bool FaceDb<DescriptorComputer, DescriptorMetric>::enroll(const std::string& imageFile, const std::string& label)
 {
-	std::size_t labelIdx;
-	auto it = std::find(this->labels.cbegin(), this->labels.cend(), label);
-	if (it == this->labels.end())	// label not found
-	{
+	if (this->log.isCompacted())
+		this->log.finishCompaction();	// drop the records merged into the database file
+
+	auto [labelIdx, inserted] = this->labels.insert(label);
+	if (inserted)	// label not found
 		this->reporter("Enrolling a new person labeled " + label);
-		labelIdx = this->labels.size();
-		this->labels.push_back(label);
-	}
 	else	// this label already exists
-	{
 		this->reporter("Adding a new face image for " + label);
-		labelIdx = it - this->labels.cbegin();
-	}
 
 	if (auto descriptor = this->descriptorComputer(imageFile))
 	{
-		this->faceMap.emplace_back(*std::move(descriptor), labelIdx);
+		addDescriptor(*descriptor, labelIdx);		// a mapped store is copied on the first modification
+		if (this->log.isOpen())
+			this->log.append(label, this->store.descriptor(this->store.size() - 1), this->store.dimension());
+		if (this->searchIndex)
+			mutableIndex().update(this->store);		// the new descriptor is added to the existing index
 		this->reporter("The descriptor for " + imageFile + " has been added to the database.");
+
+		if (this->compactionThreshold > 0 && this->log.size() >= this->compactionThreshold && !this->log.isCompacting())
+			compact();
 		return true;
 	}
 	else
@@ -330,13 +1545,141 @@ bool FaceDb<DescriptorComputer, DescriptorMetric>::enroll(const std::string& ima
 	}
 }	// enroll
 
+
+template <class DescriptorComputer, class DescriptorMetric>
+template <class ImageRange>
+std::size_t FaceDb<DescriptorComputer, DescriptorMetric>::enroll(const ImageRange& images)
+{
+	if (this->log.isCompacted())
+		this->log.finishCompaction();	// drop the records merged into the database file
+
+	std::vector<std::filesystem::path> chunkFiles;
+	std::vector<std::string> chunkLabels;
+	std::size_t numImages = 0, numEnrolled = 0;
+	auto enrollChunk = [this, &chunkFiles, &chunkLabels, &numImages, &numEnrolled]
+		{
+			auto descriptors = this->descriptorComputer(chunkFiles);
+			for (std::size_t i = 0; i < descriptors.size(); ++i)
+			{
+				if (!descriptors[i])
+					continue;
+
+				addDescriptor(*descriptors[i], this->labels.insert(chunkLabels[i]).first);
+				if (this->log.isOpen())
+					this->log.append(chunkLabels[i], this->store.descriptor(this->store.size() - 1), this->store.dimension());
+				++numEnrolled;
+			}
+
+			if (this->searchIndex)
+				mutableIndex().update(this->store);		// the chunk is added to the index at once
+
+			numImages += chunkFiles.size();
+			this->reporter("Processed " + std::to_string(numImages) + " images, " + std::to_string(numEnrolled) + " faces enrolled");
+			chunkFiles.clear();
+			chunkLabels.clear();
+
+			if (this->compactionThreshold > 0 && this->log.size() >= this->compactionThreshold && !this->log.isCompacting())
+				compact();
+		};	// enrollChunk
+
+	for (const auto& image : images)
+	{
+		chunkFiles.emplace_back(std::get<0>(image));
+		chunkLabels.emplace_back(std::get<1>(image));
+		if (chunkFiles.size() == datasetChunkSize)
+			enrollChunk();
+	}
+
+	if (!chunkFiles.empty())
+		enrollChunk();
+
+	return numEnrolled;
+}	// enroll
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::setCompactionThreshold(std::size_t compactionThreshold)
+{
+	this->compactionThreshold = compactionThreshold;
+}	// setCompactionThreshold
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::compact()
+{
+	if (!this->log.isOpen())
+		throw std::runtime_error("The database is not attached to a file.");
+
+	this->log.finishCompaction();	// wait for the previous compaction
+
+	const std::string& databasePath = this->log.databasePath();
+	this->reporter("Compacting the enrollment log of " + databasePath);
+
+	// The snapshot is written by a background thread, so enrollment can go on meanwhile. The copy of the store shares the descriptor
+	// buffer, which new descriptors are appended to without touching the copied ones, and copies of the search index share it until 
+	// the database modifies its own one.
+	auto task = [labels = this->labels, store = this->store, files = this->files, searchIndex = this->searchIndex, databasePath]
+		{
+			try
+			{
+				std::string tempPath = databasePath + ".tmp";
+				{
+					Metrics::Timer timer(Metrics::Stage::DatabaseIo, store.size());
+					std::ofstream db(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+					db.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+
+					BinaryWriter writer(db);
+					writer.write(store.data(), store.labels(), store.size(), store.dimension());
+					writer.finish(labels);
+				}
+
+				std::filesystem::rename(tempPath, databasePath);
+
+				if (!files.empty())
+					files.save(databasePath + FileIndex::fileExtension(), store);
+
+				if (searchIndex)
+					searchIndex->save(databasePath + searchIndex->fileExtension());
+			}	// try
+			catch (const std::ios_base::failure& e)
+			{
+				throw std::ios_base::failure("Failed to compact the database file " + databasePath, e.code());
+			}
+		};	// task
+
+	this->log.compact(std::move(task), this->store);
+}	// compact
+
+
 template <class DescriptorComputer, class DescriptorMetric>
 void FaceDb<DescriptorComputer, DescriptorMetric>::clear()
 {
+	this->log.close();
 	this->labels.clear();
-	this->faceMap.clear();
+	this->store.clear();
+	this->files.clear();
+	if (this->searchIndex)
+		mutableIndex().clear();
 	this->reporter("The database has been cleared.");
 }	// clear
 
 
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::setSearchIndex(std::unique_ptr<SearchIndex> searchIndex)
+{
+	if (!isL2Metric && searchIndex)
+		throw std::runtime_error("Approximate search is only supported for L2 metrics.");
+
+	this->searchIndex = std::move(searchIndex);
+	if (this->searchIndex && !this->store.empty())
+		buildIndex();
+}	// setSearchIndex
+
+
+template <class DescriptorComputer, class DescriptorMetric>
+void FaceDb<DescriptorComputer, DescriptorMetric>::setRerankSize(std::size_t rerankSize)
+{
+	this->rerankSize = rerankSize;		// the number of candidates is never less than the number of requested matches
+}	// setRerankSize
+
+
 #endif	// FACEDB_H
@@ -1,16 +1,36 @@
 #ifndef FACEDESCRIPTORCOMPUTER_H
 #define FACEDESCRIPTORCOMPUTER_H
 
+#include "facebox.h"
+#include "threadpool.h"
+
 #include <optional>
 #include <string>
 #include <filesystem>
 #include <tuple>
+#include <utility>
 #include <exception>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cassert>
 
 
 /*
 * FaceDescriptorComputer defines a common interface and provides generic implementation for computing face descriptors.
 * It is designed to be used as a base class for specific face descriptor computers and cannot be instantiated directly.
+* 
+* Descriptors for a range of files are computed by a pipeline of three stages: decoding images, detecting and aligning faces, 
+* and recognizing the faces in batches. The stages are run by tasks on the global thread pool, so face detection and inference 
+* overlap rather than alternate, and the pipeline shares the workers with the parallel loops of the recognizer instead of adding
+* threads of its own. The face extractor must provide decode() and extractAll() functions for the first two stages, and the face 
+* recognizer must be safe to call from multiple threads.
+*
+* By default only the most confident detection in each image is recognized. computeFaces() recognizes every face instead and reports
+* its bounding box. The faces of an image are detected in a single pass over it, and their descriptors are computed in the same 
+* batches as the faces of other images.
 */
 
 template <class FaceExtractor, class FaceRecognizer>
@@ -56,6 +76,45 @@ public:
 	template <class InputIterator, class OutputIterator>
 	OutputIterator operator()(InputIterator inHead, InputIterator inTail, OutputIterator outHead);	// may throw
 
+	// The descriptors of the faces found in an image along with their bounding boxes in the order of the detector's confidence
+	using Faces = std::vector<std::pair<FaceBox, Descriptor>>;
+
+	Faces computeFaces(const std::string& file);
+
+	std::vector<Faces> computeFaces(const std::vector<std::filesystem::path>& files)
+	{
+		std::vector<Faces> faces(files.size());	// may throw
+		auto tail = computeFaces(files.cbegin(), files.cend(), faces.begin());
+		assert(faces.end() == tail);
+		return faces;
+	}
+
+	// Writes the faces of each input file to the output sequence
+	template <class InputIterator, class OutputIterator>
+	OutputIterator computeFaces(InputIterator inHead, InputIterator inTail, OutputIterator outHead);	// may throw
+
+	// The maximum number of pool tasks running each stage of the pipeline at once
+	struct PipelineWorkers
+	{
+		std::size_t decoders;		// load image files
+		std::size_t extractors;		// detect and align faces
+		std::size_t recognizers;	// compute descriptors for batches of faces
+	};
+
+	const PipelineWorkers& getPipelineWorkers() const noexcept { return this->pipelineWorkers; }
+
+	void setPipelineWorkers(const PipelineWorkers& pipelineWorkers)
+	{
+		if (pipelineWorkers.decoders == 0 || pipelineWorkers.extractors == 0 || pipelineWorkers.recognizers == 0)
+			throw std::invalid_argument("Each stage of the pipeline requires at least one worker.");
+
+		this->pipelineWorkers = pipelineWorkers;
+	}
+
+	// The larger side of the downscaled images faces are detected in (zero for the full resolution)
+	std::size_t getMaxDetectionSide() const noexcept { return this->faceExtractor.getMaxDetectionSide(); }
+	void setMaxDetectionSide(std::size_t maxDetectionSide) noexcept { this->faceExtractor.setMaxDetectionSide(maxDetectionSide); }
+
 	std::size_t getMaxBatchSize() const noexcept { return this->maxBatchSize; }
     
 	void setMaxBatchSize(std::size_t maxBatchSize) 
@@ -80,12 +139,35 @@ protected:
 
 	FaceDescriptorComputer& operator = (const FaceDescriptorComputer & other) = default;
 	FaceDescriptorComputer& operator = (FaceDescriptorComputer && other) = default;
+
+	// Lets descendants tune the face recognizer
+	FaceRecognizer& getFaceRecognizer() noexcept { return this->faceRecognizer; }
+	const FaceRecognizer& getFaceRecognizer() const noexcept { return this->faceRecognizer; }
     
 private:
 
+	// Runs the pipeline for count files. The extractors keep up to maxFaces faces of each image (all of them if it is zero) and pass
+	// their boxes to found(i, boxes) before the faces are queued for recognition. recognized(i, j, descriptor) receives the descriptor 
+	// of the j-th face of the i-th file. The callbacks are called concurrently, but never for the same face.
+	template <class InputIterator, class Found, class Recognized>
+	void run(InputIterator inHead, std::size_t count, std::size_t maxFaces, Found&& found, Recognized&& recognized);
+
+	static PipelineWorkers getDefaultPipelineWorkers() noexcept
+	{
+#ifdef PARALLEL_EXECUTION
+		// Face detection is the most expensive stage, while the recognizer parallelizes inference on its own. The stages share
+		// the workers of the pool, so the limits do not add up to more threads.
+		std::size_t numThreads = ThreadPool::globalSize();
+		return { std::max<std::size_t>(numThreads / 4, 1), numThreads, 1 };
+#else
+		return { 1, 1, 1 };
+#endif	// PARALLEL_EXECUTION
+	}
+
 	FaceExtractor faceExtractor;
 	FaceRecognizer faceRecognizer;
 	std::size_t maxBatchSize = 64;
+	PipelineWorkers pipelineWorkers = getDefaultPipelineWorkers();
 };	// FaceDescriptorComputer
 
 
@@ -96,55 +178,258 @@ OutputIterator FaceDescriptorComputer<FaceExtractor, FaceRecognizer>::operator()
 {
 	assert(inTail >= inHead);
 
-	std::vector<std::optional<typename FaceExtractor::Output>> faces(this->maxBatchSize);
-	std::vector<typename FaceExtractor::Output> inBatch(this->maxBatchSize);
-	std::vector<std::optional<Descriptor>> outBatch(this->maxBatchSize);
-	std::vector<std::size_t> pos(this->maxBatchSize);	// idices of corresponding items: faces -> batchIn/batchOut
+	const auto count = static_cast<std::size_t>(inTail - inHead);
+	if (count == 0)
+		return outHead;
+
+	run(inHead, count, 1, 
+		[outHead](std::size_t i, std::vector<FaceBox>&& boxes)
+		{
+			if (boxes.empty())
+				*(outHead + i) = std::nullopt;		// no face has been found
+		},
+		[outHead](std::size_t i, std::size_t, std::optional<Descriptor>&& descriptor)
+		{
+			*(outHead + i) = std::move(descriptor);
+		});
+
+	return outHead + count;
+}	// operator ()
+
+
+template <class FaceExtractor, class FaceRecognizer>
+typename FaceDescriptorComputer<FaceExtractor, FaceRecognizer>::Faces FaceDescriptorComputer<FaceExtractor, FaceRecognizer>::computeFaces(
+	const std::string& file)
+{
+	auto extracted = this->faceExtractor.extractAll(this->faceExtractor.decode(file));
+
+	std::vector<typename FaceExtractor::Output> inBatch;
+	inBatch.reserve(extracted.size());
+	for (auto& face : extracted)
+		inBatch.push_back(std::move(face.second));
+
+	// All faces of the image are recognized in one batch
+	std::vector<std::optional<Descriptor>> outBatch(inBatch.size());
+	auto outBatchTail = this->faceRecognizer(inBatch.cbegin(), inBatch.cend(), outBatch.begin());
+	assert(outBatchTail == outBatch.end());
+
+	Faces faces;
+	for (std::size_t j = 0; j < outBatch.size(); ++j)
+	{
+		if (outBatch[j])
+			faces.emplace_back(extracted[j].first, *std::move(outBatch[j]));
+	}
+
+	return faces;
+}	// computeFaces
+
+
+template <class FaceExtractor, class FaceRecognizer>
+template <class InputIterator, class OutputIterator>
+OutputIterator FaceDescriptorComputer<FaceExtractor, FaceRecognizer>::computeFaces(InputIterator inHead, InputIterator inTail, OutputIterator outHead)
+{
+	assert(inTail >= inHead);
+
+	const auto count = static_cast<std::size_t>(inTail - inHead);
+	if (count == 0)
+		return outHead;
+
+	// The faces of a file may be recognized in different batches, so the descriptors are collected first. The vectors of a file
+	// are sized by the extractor before any of its faces is queued, and the recognizers fill in different elements.
+	std::vector<std::vector<FaceBox>> boxes(count);
+	std::vector<std::vector<std::optional<Descriptor>>> descriptors(count);
+	run(inHead, count, 0,
+		[&boxes, &descriptors](std::size_t i, std::vector<FaceBox>&& fileBoxes)
+		{
+			descriptors[i].resize(fileBoxes.size());
+			boxes[i] = std::move(fileBoxes);
+		},
+		[&descriptors](std::size_t i, std::size_t j, std::optional<Descriptor>&& descriptor)
+		{
+			descriptors[i][j] = std::move(descriptor);
+		});
 
-	for (InputIterator batchTail; inHead < inTail; inHead = batchTail)
+	for (std::size_t i = 0; i < count; ++i, ++outHead)
 	{
-		// Make sure that the batch boundaries never exceed the range of the input sequence
-		auto batchSize = std::min(this->maxBatchSize, static_cast<std::size_t>(inTail - inHead));
-		batchTail = inHead + batchSize;
-
-		// Preprocess input images and extract faces
-		faces.resize(batchSize);
-		this->faceExtractor(inHead, batchTail, faces.begin());
-
-		// Select successfully extracted faces to prepare an input batch for face recognition. For each input file keep the corresponding
-		// position of a face in the input batch (which is the same as the position of a face descriptor in the output batch).
-		assert(faces.size() == batchSize);
-		inBatch.clear();
-		pos.clear();
-		for (std::size_t i = 0, j = 0; i < faces.size(); ++i)
+		Faces faces;
+		for (std::size_t j = 0; j < descriptors[i].size(); ++j)
 		{
-			pos.push_back(j);	// indices of non-null faces/descriptors in batchIn/batchOut
+			if (descriptors[i][j])
+				faces.emplace_back(boxes[i][j], *std::move(descriptors[i][j]));
+		}
+
+		*outHead = std::move(faces);
+	}	// i
+
+	return outHead;
+}	// computeFaces
+
+
+template <class FaceExtractor, class FaceRecognizer>
+template <class InputIterator, class Found, class Recognized>
+void FaceDescriptorComputer<FaceExtractor, FaceRecognizer>::run(InputIterator inHead, std::size_t count, std::size_t maxFaces, 
+	Found&& found, Recognized&& recognized)
+{
+	using Image = typename FaceExtractor::DecodedImage;
+	using Face = typename FaceExtractor::Output;
+	enum class Stage { None, Decode, Extract, Recognize };
 
-			if (faces[i])
+	// Items are tagged with their positions in the input sequence (and faces with their positions in the image), so descriptors can 
+	// be stored in order regardless of the order of processing
+	struct State
+	{
+		std::mutex mutex;
+		std::size_t next = 0;		// the next file to decode
+		std::deque<std::pair<std::size_t, Image>> images;
+		std::deque<std::tuple<std::size_t, std::size_t, Face>> faces;
+		std::size_t decoding = 0, extracting = 0, recognizing = 0;		// the number of tasks running each stage
+		std::size_t tasks = 0;
+		std::exception_ptr eptr;
+	} state;
+
+	const PipelineWorkers limits = this->pipelineWorkers;
+#ifdef PARALLEL_EXECUTION
+	const std::size_t maxTasks = limits.decoders + limits.extractors + limits.recognizers;
+#else
+	const std::size_t maxTasks = 1;		// the calling thread runs all stages
+#endif	// PARALLEL_EXECUTION
+
+	// Chooses the work for a task. Later stages take precedence, and the earlier ones wait while the next queue is full, so at most 
+	// twice as many images as extractors and twice the batch size of faces are kept in memory. The rest of the faces is recognized 
+	// once no more faces can come.
+	auto select = [this, count, &limits, &state]() noexcept
+	{
+		if (state.eptr)
+			return Stage::None;		// the pipeline has failed
+
+		bool exhausted = state.next == count && state.decoding == 0 && state.images.empty() && state.extracting == 0;
+		if (state.recognizing < limits.recognizers && (state.faces.size() >= this->maxBatchSize || (exhausted && !state.faces.empty())))
+			return Stage::Recognize;
+		else if (state.extracting < limits.extractors && !state.images.empty() && state.faces.size() < 2 * this->maxBatchSize)
+			return Stage::Extract;
+		else if (state.decoding < limits.decoders && state.next < count && state.images.size() + state.decoding < 2 * limits.extractors)
+			return Stage::Decode;
+		else return Stage::None;
+	};	// select
+
+	// The stages are run by tasks on the thread pool. A task does not wait for the next item of its stage, but takes whatever work 
+	// is available when it finishes a piece, and quits if there is none. Every piece of work is followed by a new choice, so the work 
+	// made available by a piece is never left behind. While there is more work than the running tasks can take, they start new ones.
+	TaskGroup group;
+	std::function<void()> pump;
+	pump = [this, inHead, maxFaces, &found, &recognized, &state, &select, &group, &pump, maxTasks]
+	{
+		std::unique_lock<std::mutex> lock(state.mutex);
+		for (Stage stage = select(); stage != Stage::None; stage = select())
+		{
+			std::size_t i = 0;
+			std::optional<std::pair<std::size_t, Image>> image;
+			std::vector<std::tuple<std::size_t, std::size_t, Face>> batch;
+			switch (stage)
+			{
+			case Stage::Decode:
+				++state.decoding;
+				i = state.next++;
+				break;
+			case Stage::Extract:
+				++state.extracting;
+				image = std::move(state.images.front());
+				state.images.pop_front();
+				break;
+			default:
+				++state.recognizing;
+				for (std::size_t j = 0; j < this->maxBatchSize && !state.faces.empty(); ++j)
+				{
+					batch.push_back(std::move(state.faces.front()));
+					state.faces.pop_front();
+				}
+			}	// switch
+
+			if (state.tasks < maxTasks && select() != Stage::None)
 			{
-				inBatch.push_back(*std::move(faces[i]));	// a moved-from optional still contains a value, but the value itself is moved from
-				++j;
+				try
+				{
+					group.run(pump);
+					++state.tasks;
+				}
+				catch (...)
+				{
+					// failed to start a task; the work will be done by the running ones
+				}
 			}
-		}	// for i
 
-		// Recognize the faces
-		outBatch.resize(inBatch.size());
-		auto outBatchTail = this->faceRecognizer(inBatch.cbegin(), inBatch.cend(), outBatch.begin());
-		assert(outBatchTail == outBatch.end());
-
-		// Arrange the computed face descriptors according to the input files
-		outHead = std::transform(faces.cbegin(), faces.cend(), pos.cbegin(), outHead,
-			[&outBatch](const std::optional<typename FaceExtractor::Output>& face, std::size_t idx) -> std::optional<Descriptor>
+			lock.unlock();
+			try
+			{
+				switch (stage)
+				{
+				case Stage::Decode:
+				{
+					auto decoded = this->faceExtractor.decode(*(inHead + i));
+					lock.lock();
+					state.images.emplace_back(i, std::move(decoded));
+					--state.decoding;
+					break;
+				}
+				case Stage::Extract:
+				{
+					auto extracted = this->faceExtractor.extractAll(image->second, maxFaces);
+					std::vector<FaceBox> boxes;
+					boxes.reserve(extracted.size());
+					for (const auto& face : extracted)
+						boxes.push_back(face.first);
+
+					found(image->first, std::move(boxes));
+
+					lock.lock();
+					std::size_t j = 0;
+					for (auto& face : extracted)
+						state.faces.emplace_back(image->first, j++, std::move(face.second));
+					--state.extracting;
+					break;
+				}
+				default:
+				{
+					std::vector<Face> inBatch;
+					inBatch.reserve(batch.size());
+					for (auto& item : batch)
+						inBatch.push_back(std::move(std::get<2>(item)));
+
+					std::vector<std::optional<Descriptor>> outBatch(inBatch.size());
+					auto outBatchTail = this->faceRecognizer(inBatch.cbegin(), inBatch.cend(), outBatch.begin());
+					assert(outBatchTail == outBatch.end());
+
+					// Arrange the computed face descriptors according to the input files
+					for (std::size_t j = 0; j < batch.size(); ++j)
+						recognized(std::get<0>(batch[j]), std::get<1>(batch[j]), std::move(outBatch[j]));
+
+					lock.lock();
+					--state.recognizing;
+				}
+				}	// switch
+			}	// try
+			catch (...)
 			{
-				assert(!face || idx < outBatch.size());
-				return face ? std::move(outBatch[idx]) : std::optional<Descriptor>(std::nullopt);
-			});
+				// The other tasks quit after finishing their current work
+				if (!lock.owns_lock())
+					lock.lock();
+				if (!state.eptr)
+					state.eptr = std::current_exception();
+				break;
+			}
+		}	// for stage
 
-	}	// while
+		--state.tasks;
+	};	// pump
 
-	assert(inHead == inTail);
-	return outHead;
-}	// operator ()
+	// The calling thread runs the pipeline too
+	state.tasks = 1;
+	pump();
+	group.wait();
+
+	if (state.eptr)
+		std::rethrow_exception(state.eptr);
+}	// run
 
 
 /*
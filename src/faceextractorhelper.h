@@ -1,16 +1,22 @@
 #ifndef FACEEXTRACTORHELPER_H
 #define FACEEXTRACTORHELPER_H
 
+#include "facebox.h"
+#include "metrics.h"
+#include "parallel.h"
+
 #include <functional>
 #include <optional>
-#include <atomic>
-#include <execution>
-#include <exception>
 #include <string>
+#include <vector>
 #include <filesystem>
+#include <algorithm>
+#include <cmath>
 
+#include <dlib/array2d.h>
 #include <dlib/image_io.h>
 #include <dlib/image_processing.h>
+#include <dlib/image_transforms.h>
 #include <dlib/image_processing/frontal_face_detector.h>
 #include <dlib/image_processing/shape_predictor.h>
 
@@ -36,6 +42,12 @@ public:
     template <class InputIterator, class OutputIterator>
     OutputIterator operator()(InputIterator inHead, InputIterator inTail, OutputIterator outHead);
 
+    // Faces are detected in a copy of the image downscaled to this size of the larger side unless it is zero. The landmarks are 
+    // still found in the original image, so alignment keeps its precision, but faces smaller than about 80 pixels after scaling 
+    // are missed.
+    std::size_t getMaxDetectionSide() const noexcept { return this->maxDetectionSide; }
+    void setMaxDetectionSide(std::size_t maxDetectionSide) noexcept { this->maxDetectionSide = maxDetectionSide; }
+
 protected:
 
     // This class is auxiliary and is not supposed to be directly constructed
@@ -51,8 +63,16 @@ protected:
     FaceExtractorHelper& operator = (const FaceExtractorHelper& other) = default;
     FaceExtractorHelper& operator = (FaceExtractorHelper&& other) = default;
 
+    // Detects the faces in the image and finds the landmarks of each of them. The detector scans the image once, and the faces are 
+    // listed in the order of its confidence. If maxFaces is positive, the landmarks are only found for the first maxFaces faces.
     template <class DlibImage>
-    dlib::full_object_detection getLandmarks(DlibImage&& image);		// face detection is a non-const operation
+    std::vector<dlib::full_object_detection> getLandmarks(const DlibImage& image, std::size_t maxFaces = 0);   // face detection is a non-const operation
+
+    static FaceBox getFaceBox(const dlib::full_object_detection& landmarks) noexcept
+    {
+        const dlib::rectangle& rect = landmarks.get_rect();
+        return { rect.left(), rect.top(), rect.right(), rect.bottom() };
+    }
 
 private:
 
@@ -66,6 +86,7 @@ private:
     // http://dlib.net/dlib/image_processing/shape_predictor_abstract.h.html
     dlib::shape_predictor landmarkDetector;
     ExtractFaceCallback extractFaceCallback = nullptr;
+    std::size_t maxDetectionSide = 0;       // full resolution
 };  // FaceExtractorHelper
 
 
@@ -75,49 +96,52 @@ OutputIterator FaceExtractorHelper<OutputImage>::operator()(InputIterator inHead
 {
     assert(inHead <= inTail);
 
-#ifdef PARALLEL_EXECUTION
-    const auto& executionPolicy = std::execution::par;
-#else
-    const auto& executionPolicy = std::execution::seq;
-#endif  // !PARALLEL_EXECUTION
-    std::atomic_flag eflag{ false };
-    std::exception_ptr eptr;
-    outHead = std::transform(executionPolicy, inHead, inTail, outHead,    
-        [this, &eflag, &eptr](const auto& filePath) -> std::optional<Output>
+    // Images vary in size and in the number of faces, so they are taken one at a time
+    return parallel::transform(inHead, inTail, outHead, 
+        [this](const auto& filePath) -> std::optional<Output>
         {
-            try
-            {
-                return (*this)(filePath);
-            }
-            catch (...)
-            {
-                // Prevent racing when multiple threads catch an exception
-                if (!eflag.test_and_set(std::memory_order_acq_rel))     // noexcept
-                    eptr = std::current_exception();
-            }
-
-            return std::nullopt;
-        });	// transform
-
-    if (eptr)
-        std::rethrow_exception(eptr);
-
-    return outHead;
+            return (*this)(filePath);
+        }, 1);
 }   // operator ()
 
 template <class OutputImage>
 template <class DlibImage>
-dlib::full_object_detection FaceExtractorHelper<OutputImage>::getLandmarks(DlibImage&& image)	// face detection is a non-const operation
+std::vector<dlib::full_object_detection> FaceExtractorHelper<OutputImage>::getLandmarks(const DlibImage& image, std::size_t maxFaces)
 {
     thread_local auto faceDetector = getFaceDetector();     // shared by all instances running in the same thread
 
-    if (auto faces = faceDetector(image); faces.empty())		// no faces detected in this image
-        return dlib::full_object_detection{};
-    else
-        return this->landmarkDetector(std::forward<DlibImage>(image), faces.front());  // the landmark detector is thread-safe
-}   // getLandmarks
+    std::vector<dlib::rectangle> faces;
+    {
+        Metrics::Timer timer(Metrics::Stage::Detection);
+        long rows = dlib::num_rows(image), columns = dlib::num_columns(image);
+        if (this->maxDetectionSide > 0 && static_cast<std::size_t>(std::max(rows, columns)) > this->maxDetectionSide)
+        {
+            // The cost of the HOG pyramid is proportional to the number of pixels, so detection in a downscaled copy is much faster.
+            // The boxes are mapped back to the original image.
+            double scale = static_cast<double>(this->maxDetectionSide) / std::max(rows, columns);
+            dlib::array2d<dlib::pixel_type_t<DlibImage>> smallImage(std::max(std::lround(rows * scale), 1L), std::max(std::lround(columns * scale), 1L));
+            dlib::resize_image(image, smallImage);
+
+            faces = faceDetector(smallImage);
+            for (auto& face : faces)
+                face = dlib::scale_rect(face, 1 / scale);
+        }
+        else faces = faceDetector(image);
+    }
 
-#endif	// FACEEXTRACTORHELPER_H
+    if (maxFaces > 0 && faces.size() > maxFaces)
+        faces.resize(maxFaces);
 
+    std::vector<dlib::full_object_detection> landmarks;
+    if (faces.empty())		// no faces detected in this image
+        return landmarks;
 
+    Metrics::Timer timer(Metrics::Stage::Landmarks, faces.size());
+    landmarks.reserve(faces.size());
+    for (const auto& face : faces)
+        landmarks.push_back(this->landmarkDetector(image, face));  // the landmark detector is thread-safe
 
+    return landmarks;
+}   // getLandmarks
+
+#endif	// FACEEXTRACTORHELPER_H
@@ -0,0 +1,98 @@
+#include "fileindex.h"
+#include "binaryio.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+
+
+FileIndex::Entry FileIndex::stat(const std::filesystem::path& filePath, std::string path)
+{
+	Entry entry;
+	entry.path = std::move(path);
+	entry.size = std::filesystem::file_size(filePath);
+	entry.modified = static_cast<std::int64_t>(std::filesystem::last_write_time(filePath).time_since_epoch().count());
+	return entry;
+}	// stat
+
+std::uint64_t FileIndex::hashFile(const std::filesystem::path& filePath)
+{
+	std::ifstream file(filePath, std::ios::in | std::ios::binary);
+	if (!file)
+		throw std::ios_base::failure("Failed to open the file " + filePath.string());
+
+	std::uint64_t hash = 14695981039346656037ull;
+	char buffer[64 * 1024];
+	do
+	{
+		file.read(buffer, sizeof(buffer));
+		for (std::streamsize i = 0; i < file.gcount(); ++i)
+			hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+	} while (file);
+
+	if (file.bad())
+		throw std::ios_base::failure("Failed to read the file " + filePath.string());
+
+	return hash;
+}	// hashFile
+
+void FileIndex::save(const std::string& filePath, const DescriptorStore& store) const
+{
+	FileHeader header = {};
+	binaryio::initHeader(header);
+	header.count = this->entries.size();
+	header.numDescriptors = store.size();
+	header.fingerprint = store.fingerprint();
+
+	binaryio::atomicWrite(filePath, [&](std::ostream& file)
+		{
+			binaryio::write(file, header);
+			for (const auto& entry : this->entries)
+			{
+				binaryio::writeString(file, entry.path);
+				binaryio::write(file, entry.size);
+				binaryio::write(file, entry.modified);
+				binaryio::write(file, entry.hash);
+				binaryio::write(file, entry.descriptor);
+			}
+		});
+}	// save
+
+bool FileIndex::load(const std::string& filePath, const DescriptorStore& store)
+{
+	std::vector<Entry> entries;
+	bool loaded = binaryio::tryRead(filePath, [&](std::istream& file)
+		{
+			auto header = binaryio::read<FileHeader>(file);
+			if (!binaryio::checkHeader(header))
+				return false;
+
+			// The positions of descriptors are only valid for the store the index was saved with
+			if (header.numDescriptors != store.size() || header.fingerprint != store.fingerprint())
+				return false;
+
+			for (std::uint64_t i = 0; i < header.count; ++i)
+			{
+				Entry entry;
+				entry.path = binaryio::readString(file);
+				entry.size = binaryio::read<std::uint64_t>(file);
+				entry.modified = binaryio::read<std::int64_t>(file);
+				entry.hash = binaryio::read<std::uint64_t>(file);
+				entry.descriptor = binaryio::read<std::uint64_t>(file);
+				if (entry.descriptor != noDescriptor && entry.descriptor >= store.size())
+					return false;
+
+				entries.push_back(std::move(entry));
+			}	// i
+
+			return true;
+		});	// tryRead
+
+	if (!loaded)
+		return false;
+
+	this->entries = std::move(entries);
+	return true;
+}	// load
@@ -0,0 +1,89 @@
+#ifndef FILEINDEX_H
+#define FILEINDEX_H
+
+#include "descriptorstore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/*
+* FileIndex records which files of the dataset the descriptors in a DescriptorStore were computed from. Each entry holds the path
+* of an image file relative to the dataset directory, its size, last write time, and a hash of its contents, along with the position
+* of the descriptor in the store (images without a face are recorded too, so they are not processed again).
+*
+* It allows to update the database incrementally: a file whose size and last write time have not changed is considered intact.
+* If only the time differs, the contents are hashed to tell a modified file from a touched or copied one.
+*
+* The index is saved to a file next to the database. The file keeps a fingerprint of the descriptor store, so it is rejected when
+* loaded for a database which has been changed by other means.
+*/
+
+class FileIndex
+{
+public:
+
+	static constexpr std::uint64_t noDescriptor = std::numeric_limits<std::uint64_t>::max();
+
+	struct Entry
+	{
+		std::string path;		// the label and the file name separated by a slash
+		std::uint64_t size = 0;
+		std::int64_t modified = 0;	// the last write time in ticks of the file clock
+		std::uint64_t hash = 0;		// a hash of the file contents
+		std::uint64_t descriptor = noDescriptor;	// the position of the descriptor in the store or noDescriptor if no face was found
+	};	// Entry
+
+	// The suffix appended to the database path to make the name of the index file
+	static std::string fileExtension() { return ".files"; }
+
+	// Reads the size and the last write time of the file. The hash is not computed.
+	static Entry stat(const std::filesystem::path& filePath, std::string path);
+
+	// Computes an FNV-1a hash of the file contents
+	static std::uint64_t hashFile(const std::filesystem::path& filePath);
+
+	std::size_t size() const noexcept { return this->entries.size(); }
+
+	bool empty() const noexcept { return this->entries.empty(); }
+
+	const Entry& operator[](std::size_t i) const noexcept { return this->entries[i]; }
+
+	auto begin() const noexcept { return this->entries.cbegin(); }
+	auto end() const noexcept { return this->entries.cend(); }
+
+	void add(Entry entry) { this->entries.push_back(std::move(entry)); }
+
+	void save(const std::string& filePath, const DescriptorStore& store) const;
+
+	// Loads the index from a file. Returns false if the file does not exist or was saved for a different store.
+	bool load(const std::string& filePath, const DescriptorStore& store);
+
+	void clear() noexcept { this->entries.clear(); }
+
+private:
+
+	// Binary file header
+	struct FileHeader
+	{
+		static constexpr char signature[8] = { 'F', 'A', 'C', 'E', 'F', 'I', 'L', 'E' };
+		static constexpr std::uint32_t currentVersion = 1;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byteOrderMark;
+		std::uint64_t count;
+		std::uint64_t numDescriptors;
+		std::uint64_t fingerprint;
+	};	// FileHeader
+
+	std::vector<Entry> entries;
+};	// FileIndex
+
+
+#endif	// FILEINDEX_H
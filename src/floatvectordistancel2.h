@@ -0,0 +1,39 @@
+#ifndef FLOATVECTORDISTANCEL2_H
+#define FLOATVECTORDISTANCEL2_H
+
+#include "l2kernels.h"
+
+#include <cstddef>
+#include <cmath>
+
+template <typename T>
+struct L2Distance;
+
+
+/*
+* L2Distance<float> computes the Euclidean distance between two packed float vectors of the same length. It is used for searching 
+* descriptors stored in a binary database file in place, i.e. without converting them to descriptor objects. 
+* 
+* The vectorized kernel is chosen once on construction depending on the instruction sets supported by the CPU. Since the square root
+* is monotonic, candidates can be compared by their squared distances, so the root has to be taken only for the best ones.
+*/
+
+template <>
+struct L2Distance<float>
+{
+	double operator()(const float* v1, const float* v2, std::size_t n) const noexcept
+	{
+		return std::sqrt(squared(v1, v2, n));
+	}
+
+	double squared(const float* v1, const float* v2, std::size_t n) const noexcept
+	{
+		return this->kernel(v1, v2, n);
+	}
+
+private:
+	l2kernels::SquaredDistance kernel = l2kernels::select();
+};	// L2Distance
+
+
+#endif	// FLOATVECTORDISTANCEL2_H
@@ -0,0 +1,314 @@
+#include "facedb.h"
+#include "syntheticgallery.h"
+#include "syntheticdescriptorcomputer.h"
+#include "groundtruth.h"
+#include "searchbackend.h"
+#include "parallel.h"
+#include "labeltable.h"
+#include "enrollmentlog.h"
+#include "fileindex.h"
+#include "resnetfacedescriptorcomputer.h"
+#include "resnetfacedescriptormetric.h"
+#include "dlibmatrixdata.h"
+#include "openfacedescriptorcomputer.h"
+#include "openfacedescriptormetric.h"
+#include "openfacedescriptordata.h"
+
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+
+
+// The shape of the generated gallery
+struct GallerySettings
+{
+	std::size_t numDescriptors = 1000000;
+	std::size_t numLabels = 0;			// a tenth of the number of descriptors if zero
+	std::size_t numQueries = 1000;
+	std::size_t numNeighbors = 10;		// the number of exact nearest neighbors stored for each query
+	std::uint64_t seed = 0;
+	double separation = 1.0;			// the expected distance between the centers of two labels
+	double spread = 0.45;				// the expected distance between two descriptors of the same label
+};
+
+// Both ResNet and OpenFace models compute 128-dimensional descriptors
+constexpr std::size_t descriptorSize = 128;
+
+// The number of descriptors generated and written at once
+constexpr std::size_t chunkSize = 1 << 16;
+
+
+// Writes a binary database of synthetic descriptors, which has the type id of the imitated descriptor computer, and the ground truth
+// for the queries next to it
+template <class DescriptorComputer>
+void generate(const std::string& databasePath, const GallerySettings& settings)
+{
+	using SyntheticFaceDb = FaceDb<SyntheticDescriptorComputer<DescriptorComputer>>;
+
+	std::size_t numLabels = settings.numLabels > 0 ? settings.numLabels : std::max(settings.numDescriptors / 10, std::size_t(1));
+	if (numLabels > std::numeric_limits<std::uint32_t>::max())
+		throw std::invalid_argument("Too many labels for the binary database format.");
+
+	SyntheticGallery gallery(numLabels, descriptorSize, settings.seed, settings.separation, settings.spread);
+
+	// The labels are inserted in order, so the index of a label in the table is the label of the gallery
+	LabelTable labels;
+	for (std::size_t label = 0; label < numLabels; ++label)
+		labels.insert(SyntheticGallery::labelName(label));
+
+	GroundTruth truth(settings.numNeighbors, descriptorSize);
+	std::vector<float> descriptors(chunkSize * descriptorSize);
+	for (std::size_t i = 0; i < settings.numQueries; ++i)
+	{
+		gallery.query(i, descriptors.data());
+		truth.addQuery(descriptors.data(), static_cast<std::uint32_t>(gallery.labelOf(i)));
+	}
+
+	std::cout << "Generating " << settings.numDescriptors << " descriptors of " << numLabels << " labels and "
+		<< settings.numQueries << " queries..." << std::endl;
+
+	std::string tempPath = databasePath + ".tmp";
+	{
+		std::ofstream db(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+		db.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+
+		typename SyntheticFaceDb::BinaryWriter writer(db);
+		std::vector<std::uint32_t> descriptorLabels(chunkSize);
+		for (std::size_t head = 0; head < settings.numDescriptors; head += chunkSize)
+		{
+			std::size_t count = std::min(chunkSize, settings.numDescriptors - head);
+			parallel::forRange(count, 0, [&gallery, &descriptors, &descriptorLabels, head](std::size_t first, std::size_t last)
+				{
+					for (std::size_t i = first; i < last; ++i)
+					{
+						gallery.descriptor(head + i, descriptors.data() + i * descriptorSize);
+						descriptorLabels[i] = static_cast<std::uint32_t>(gallery.labelOf(head + i));
+					}
+				});
+
+			writer.write(descriptors.data(), descriptorLabels.data(), count, descriptorSize);
+			truth.addGallery(descriptors.data(), count);
+			std::cout << "\r" << head + count << " / " << settings.numDescriptors << std::flush;
+		}	// head
+
+		writer.finish(labels);
+		std::cout << std::endl;
+	}
+
+	std::filesystem::rename(tempPath, databasePath);
+
+	// Side files of a database previously written to the same path are not valid for the new one
+	std::filesystem::remove(databasePath + EnrollmentLog::fileExtension());
+	std::filesystem::remove(databasePath + FileIndex::fileExtension());
+
+	truth.save(databasePath + GroundTruth::fileExtension());
+	std::cout << "The database has been written to " << databasePath << " and the ground truth to "
+		<< databasePath + GroundTruth::fileExtension() << std::endl;
+}	// generate
+
+
+// Searches the database for the queries of the ground truth and reports the recall of the k nearest neighbors
+template <class DescriptorComputer>
+void evaluate(const std::string& databasePath, const SearchSettings& searchSettings)
+{
+	auto truth = std::make_shared<GroundTruth>();
+	truth->load(databasePath + GroundTruth::fileExtension());
+
+	// Queries are named by their positions in the ground truth file
+	typename SyntheticDescriptorComputer<DescriptorComputer>::Source source = [truth](const std::string& name, float* descriptor)
+		{
+			std::size_t i = std::stoull(name.substr(1));
+			std::copy_n(truth->query(i), truth->dimension(), descriptor);
+		};
+
+	FaceDb<SyntheticDescriptorComputer<DescriptorComputer>> faceDb{ SyntheticDescriptorComputer<DescriptorComputer>(truth->dimension(), source) };
+	faceDb.setReporter([](const std::string& message) { std::cout << message << std::endl; });
+	faceDb.setSearchIndex(makeSearchIndex(searchSettings));
+	faceDb.setRerankSize(searchSettings.rerankSize);
+	faceDb.load(databasePath);
+
+	std::vector<std::filesystem::path> queries;
+	for (std::size_t i = 0; i < truth->size(); ++i)
+		queries.emplace_back("q" + std::to_string(i));
+
+	auto start = std::chrono::steady_clock::now();
+	auto results = faceDb.findBatch(queries, truth->neighborCount());
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double recall = 0;
+	std::size_t identified = 0;
+	std::vector<double> distances;
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		distances.clear();
+		for (const auto& match : results[i])
+			distances.push_back(match.second);
+
+		recall += truth->recall(i, distances);
+		identified += !results[i].empty() && results[i].front().first == SyntheticGallery::labelName(truth->label(i));
+	}	// i
+
+	std::size_t numQueries = std::max(results.size(), std::size_t(1));
+	std::cout << std::fixed << std::setprecision(4)
+		<< "Search backend: " << searchSettings.backend << std::endl
+		<< "Recall@" << truth->neighborCount() << ": " << recall / static_cast<double>(numQueries) << std::endl
+		<< "Top-1 label accuracy: " << static_cast<double>(identified) / static_cast<double>(numQueries) << std::endl
+		<< std::setprecision(1) << "Queries per second: " << (seconds > 0 ? static_cast<double>(results.size()) / seconds : 0.0) << std::endl;
+}	// evaluate
+
+
+void printUsage()
+{
+	std::cout << "Usage: doppelganger_gallery [-h]"
+		" --out=<database file>"
+		" [--algorithm=<ResNet or OpenFace>]"
+		" [--descriptors=<the number of descriptors>]"
+		" [--labels=<the number of labels>]"
+		" [--queries=<the number of queries>]"
+		" [--neighbors=<the number of nearest neighbors>]"
+		" [--seed=<an integer>]"
+		" [--threads=<the number of threads of parallel computations>]"
+		" [--separation=<the distance between labels>]"
+		" [--spread=<the distance between faces of a label>]"
+		" [--evaluate]"
+		" [--search=<exhaustive, quantized, ivfpq, or hnsw>]"
+		" [--lists=<the number of inverted lists>]"
+		" [--probes=<the number of inverted lists to probe>]"
+		" [--ef=<the size of the HNSW candidate list>]"
+		" [--rerank=<the number of candidates to re-rank>]"
+		" [--reproducible]" << std::endl;
+}	// printUsage
+
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		static const cv::String keys =
+			"{help h usage ?        |       | Print the help message  }"
+			"{out                   |<none> | The binary database file to write (or to evaluate); the ground truth is written next to it }"
+			"{algorithm             |ResNet | The face recognition algorithm whose databases are imitated (ResNet or OpenFace) }"
+			"{descriptors           |1000000 | The number of descriptors in the gallery }"
+			"{labels                |0      | The number of labels (a tenth of the number of descriptors if zero) }"
+			"{queries               |1000   | The number of queries stored with the ground truth }"
+			"{neighbors             |10     | The number of exact nearest neighbors found for each query }"
+			"{seed                  |0      | The seed of the generator; the same seed produces the same gallery }"
+			"{threads               |0      | The number of threads running parallel computations (the number of hardware threads if zero) }"
+			"{separation            |1.0    | The expected distance between the centers of two labels }"
+			"{spread                |0.45   | The expected distance between two descriptors of the same label }"
+			"{evaluate              |       | Search the existing database for the queries and report the recall instead of generating it }"
+			"{search                |exhaustive | The search backend to evaluate: exhaustive, quantized, ivfpq, or hnsw }"
+			"{lists                 |0      | The number of inverted lists in the IVF-PQ index (chosen automatically if zero) }"
+			"{probes                |8      | The number of inverted lists probed for each query }"
+			"{ef                    |64     | The size of the candidate list of the HNSW search }"
+			"{rerank                |100    | The number of candidates found by an approximate search which are re-ranked by exact distances }"
+			"{reproducible          |       | Build the search index so that it does not depend on thread scheduling (the HNSW graph is built sequentially) }";
+
+		cv::CommandLineParser parser(argc, argv, keys);
+		parser.about("Doppelganger synthetic gallery generator");
+
+		if (parser.has("help"))
+		{
+			printUsage();
+			return 0;
+		}
+
+		std::string out = parser.get<std::string>("out");
+		std::string algorithm = parser.get<std::string>("algorithm");
+		double numDescriptors = parser.get<double>("descriptors");
+		double numLabels = parser.get<double>("labels");
+		int numQueries = parser.get<int>("queries");
+		int numNeighbors = parser.get<int>("neighbors");
+		double seed = parser.get<double>("seed");
+		int threads = parser.get<int>("threads");
+		double separation = parser.get<double>("separation");
+		double spread = parser.get<double>("spread");
+		bool evaluation = parser.has("evaluate");
+		std::string backend = parser.get<std::string>("search");
+		int numLists = parser.get<int>("lists");
+		int numProbes = parser.get<int>("probes");
+		int efSearch = parser.get<int>("ef");
+		int rerankSize = parser.get<int>("rerank");
+		bool reproducible = parser.has("reproducible");
+
+		if (!parser.check())
+		{
+			parser.printErrors();
+			printUsage();
+			return -1;
+		}
+
+		if (numDescriptors < 1 || numLabels < 0 || numQueries < 0 || numNeighbors <= 0 || seed < 0)
+			throw std::invalid_argument("The number of descriptors and neighbors must be positive, and the number of labels, queries, "
+				"and the seed cannot be negative.");
+
+		if (separation <= 0 || spread <= 0)
+			throw std::invalid_argument("The separation and the spread must be positive.");
+
+		if (threads < 0)
+			throw std::invalid_argument("The number of threads cannot be negative.");
+
+		ThreadPool::configure({ static_cast<std::size_t>(threads) });
+
+		if (numLists < 0 || numProbes <= 0 || efSearch <= 0 || rerankSize < 0)
+			throw std::invalid_argument("The number of inverted lists and candidates cannot be negative, and the number of probes and "
+				"the size of the HNSW candidate list must be positive.");
+
+		// Large counts are parsed as floating-point numbers, so they can be written like 1e7
+		GallerySettings settings;
+		settings.numDescriptors = static_cast<std::size_t>(numDescriptors);
+		settings.numLabels = static_cast<std::size_t>(numLabels);
+		settings.numQueries = static_cast<std::size_t>(numQueries);
+		settings.numNeighbors = static_cast<std::size_t>(numNeighbors);
+		settings.seed = static_cast<std::uint64_t>(seed);
+		settings.separation = separation;
+		settings.spread = spread;
+
+		std::transform(backend.cbegin(), backend.cend(), backend.begin(), static_cast<int (*)(int)>(&std::tolower));
+		SearchSettings searchSettings{ backend, static_cast<std::size_t>(numLists), static_cast<std::size_t>(numProbes),
+			static_cast<std::size_t>(efSearch), static_cast<std::size_t>(rerankSize), reproducible };
+		makeSearchIndex(searchSettings);	// fail early if the backend is not supported
+
+		std::transform(algorithm.cbegin(), algorithm.cend(), algorithm.begin(), static_cast<int (*)(int)>(&std::tolower));
+		if (algorithm == "resnet")
+		{
+			if (evaluation)
+				evaluate<ResNetFaceDescriptorComputer>(out, searchSettings);
+			else
+				generate<ResNetFaceDescriptorComputer>(out, settings);
+		}
+		else if (algorithm == "openface")
+		{
+			// The application uses the outerEyesAndNose alignment for OpenFace
+			using OpenFaceComputer = OpenFaceDescriptorComputer<OpenFaceAlignment::OuterEyesAndNose>;
+			if (evaluation)
+				evaluate<OpenFaceComputer>(out, searchSettings);
+			else
+				generate<OpenFaceComputer>(out, settings);
+		}
+		else throw std::invalid_argument("Unsupported algorithm: " + algorithm);
+	}	// try
+	catch (const std::bad_alloc& e)
+	{
+		std::cerr << e.what() << std::endl << "There is not enough memory for the gallery. Try fewer labels or queries." << std::endl;
+		return -3;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -4;
+	}
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+#include "groundtruth.h"
+#include "binaryio.h"
+#include "floatvectordistancel2.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+
+
+GroundTruth::GroundTruth(std::size_t k, std::size_t dimension)
+	: k(k > 0 ? k : throw std::invalid_argument("The number of nearest neighbors must be positive."))
+	, dim(dimension > 0 ? dimension : throw std::invalid_argument("The dimension of descriptors must be positive."))
+{
+}
+
+void GroundTruth::addQuery(const float* query, std::uint32_t label)
+{
+	if (this->numDescriptors > 0)
+		throw std::logic_error("Queries must be added before the gallery.");
+
+	this->queries.insert(this->queries.end(), query, query + this->dim);
+	this->queryLabels.push_back(label);
+	this->nearest.emplace_back(this->k);
+}	// addQuery
+
+void GroundTruth::addGallery(const float* descriptors, std::size_t count)
+{
+	// Every query scans the whole block, which is enough work for a thread
+	parallel::forRange(size(), 1, [this, descriptors, count, distance = L2Distance<float>()](std::size_t head, std::size_t tail)
+		{
+			for (std::size_t i = head; i < tail; ++i)
+			{
+				NearestNeighbors& nearest = this->nearest[i];
+				const float* q = query(i);
+				for (std::size_t j = 0; j < count; ++j)
+					nearest.push(this->numDescriptors + j, distance.squared(q, descriptors + j * this->dim, this->dim));
+			}
+		});
+
+	this->numDescriptors += count;
+}	// addGallery
+
+std::vector<GroundTruth::Neighbor> GroundTruth::neighbors(std::size_t i) const
+{
+	std::vector<Neighbor> neighbors = this->nearest[i].sorted();
+	for (auto& neighbor : neighbors)
+		neighbor.second = std::sqrt(neighbor.second);
+
+	return neighbors;
+}	// neighbors
+
+double GroundTruth::recall(std::size_t i, const std::vector<double>& distances) const
+{
+	std::vector<Neighbor> truth = neighbors(i);
+	if (truth.empty())
+		return 1;
+
+	// Allow for rounding errors of distances computed by other means (e.g. from descriptor objects)
+	double bound = truth.back().second * (1 + 1e-4) + 1e-6;
+	std::size_t hits = std::count_if(distances.cbegin(), distances.cend(), [bound](double d) { return d <= bound; });
+	return static_cast<double>(std::min(hits, truth.size())) / static_cast<double>(truth.size());
+}	// recall
+
+void GroundTruth::save(const std::string& filePath) const
+{
+	FileHeader header = {};
+	binaryio::initHeader(header);
+	header.numQueries = size();
+	header.k = this->k;
+	header.dimension = this->dim;
+	header.numDescriptors = this->numDescriptors;
+
+	binaryio::atomicWrite(filePath, [&](std::ostream& file)
+		{
+			binaryio::write(file, header);
+			binaryio::write(file, this->queries.data(), this->queries.size());
+			binaryio::write(file, this->queryLabels.data(), this->queryLabels.size());
+
+			// Each query has exactly k neighbors unless the gallery is smaller than k; missing ones are marked by an invalid index
+			std::vector<std::uint64_t> indices(this->k);
+			std::vector<float> distances(this->k);
+			for (std::size_t i = 0; i < size(); ++i)
+			{
+				std::vector<Neighbor> neighbors = this->neighbors(i);
+				std::fill(indices.begin(), indices.end(), std::numeric_limits<std::uint64_t>::max());
+				std::fill(distances.begin(), distances.end(), std::numeric_limits<float>::infinity());
+				for (std::size_t j = 0; j < neighbors.size(); ++j)
+				{
+					indices[j] = neighbors[j].first;
+					distances[j] = static_cast<float>(neighbors[j].second);
+				}
+
+				binaryio::write(file, indices.data(), indices.size());
+				binaryio::write(file, distances.data(), distances.size());
+			}	// i
+		});
+}	// save
+
+void GroundTruth::load(const std::string& filePath)
+{
+	std::ifstream file(filePath, std::ios::in | std::ios::binary);
+	if (!file)
+		throw std::ios_base::failure("Failed to open the ground truth file " + filePath);
+
+	file.exceptions(std::ios_base::badbit | std::ios_base::failbit | std::ios_base::eofbit);
+
+	auto header = binaryio::read<FileHeader>(file);
+	if (!std::equal(std::cbegin(header.magic), std::cend(header.magic), std::cbegin(FileHeader::signature)))
+		throw std::runtime_error("Not a ground truth file: " + filePath);
+
+	if (header.version != FileHeader::currentVersion)
+		throw std::runtime_error("Unsupported ground truth file version: " + std::to_string(header.version));
+
+	if (header.byteOrderMark != binaryio::byteOrderMark)
+		throw std::runtime_error("The ground truth file has incompatible byte order.");
+
+	GroundTruth truth(header.k, header.dimension);
+	truth.numDescriptors = header.numDescriptors;
+	truth.queries.resize(header.numQueries * header.dimension);
+	binaryio::read(file, truth.queries.data(), truth.queries.size());
+	truth.queryLabels.resize(header.numQueries);
+	binaryio::read(file, truth.queryLabels.data(), truth.queryLabels.size());
+
+	std::vector<std::uint64_t> indices(truth.k);
+	std::vector<float> distances(truth.k);
+	truth.nearest.assign(header.numQueries, NearestNeighbors(truth.k));
+	for (auto& nearest : truth.nearest)
+	{
+		binaryio::read(file, indices.data(), indices.size());
+		binaryio::read(file, distances.data(), distances.size());
+		for (std::size_t j = 0; j < truth.k && indices[j] != std::numeric_limits<std::uint64_t>::max(); ++j)
+			nearest.push(indices[j], static_cast<double>(distances[j]) * distances[j]);
+	}
+
+	*this = std::move(truth);
+}	// load
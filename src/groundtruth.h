@@ -0,0 +1,92 @@
+#ifndef GROUNDTRUTH_H
+#define GROUNDTRUTH_H
+
+#include "nearestneighbors.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/*
+* GroundTruth holds a set of queries along with their exact nearest neighbors in a gallery, so the results of approximate search
+* can be checked for recall.
+*
+* The queries are added first. The gallery is then streamed through in consecutive blocks, and the k nearest descriptors of every
+* query are found by exhaustive L2 search, i.e. the gallery never has to reside in memory at once. Gallery descriptors are identified
+* by their positions in the stream, which are the positions in the database file written from the same stream.
+*
+* The ground truth is saved to a binary file next to the database. Queries are stored with their descriptors, so the file is
+* sufficient to evaluate search without regenerating the queries.
+*/
+
+class GroundTruth
+{
+public:
+
+	using Neighbor = NearestNeighbors::Neighbor;	// gallery index and L2 distance
+
+	static std::string fileExtension() { return ".truth"; }
+
+	GroundTruth() = default;
+
+	GroundTruth(std::size_t k, std::size_t dimension);
+
+	std::size_t size() const noexcept { return this->queryLabels.size(); }
+
+	std::size_t neighborCount() const noexcept { return this->k; }
+
+	std::size_t dimension() const noexcept { return this->dim; }
+
+	// The number of gallery descriptors searched so far
+	std::uint64_t gallerySize() const noexcept { return this->numDescriptors; }
+
+	void addQuery(const float* query, std::uint32_t label);
+
+	const float* query(std::size_t i) const noexcept { return this->queries.data() + i * this->dim; }
+
+	// The index of the label of the query in the label table of the database
+	std::uint32_t label(std::size_t i) const noexcept { return this->queryLabels[i]; }
+
+	// Searches the next block of the gallery for the nearest neighbors of the queries. Queries are processed in parallel.
+	void addGallery(const float* descriptors, std::size_t count);
+
+	// The nearest neighbors of the query sorted by distance in ascending order
+	std::vector<Neighbor> neighbors(std::size_t i) const;
+
+	// The share of the true k nearest neighbors of the query found by a search which returned matches at the specified distances.
+	// Matches are compared by distance rather than by identity, so equidistant descriptors are interchangeable.
+	double recall(std::size_t i, const std::vector<double>& distances) const;
+
+	void save(const std::string& filePath) const;
+
+	// Throws std::ios_base::failure if the file cannot be read and std::runtime_error if it is not a ground truth file
+	void load(const std::string& filePath);
+
+private:
+
+	struct FileHeader
+	{
+		static constexpr char signature[8] = { 'F', 'A', 'C', 'E', 'T', 'R', 'U', 'E' };
+		static constexpr std::uint32_t currentVersion = 1;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byteOrderMark;
+		std::uint64_t numQueries;
+		std::uint64_t k;
+		std::uint64_t dimension;
+		std::uint64_t numDescriptors;
+	};	// FileHeader
+
+	std::size_t k = 0;
+	std::size_t dim = 0;
+	std::uint64_t numDescriptors = 0;
+	std::vector<float> queries;		// numQueries x dim
+	std::vector<std::uint32_t> queryLabels;
+	std::vector<NearestNeighbors> nearest;	// squared distances
+};	// GroundTruth
+
+
+#endif	// GROUNDTRUTH_H
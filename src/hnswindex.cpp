@@ -0,0 +1,419 @@
+#include "hnswindex.h"
+#include "binaryio.h"
+#include "l2kernels.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+
+
+
+namespace
+{
+	float squaredDistance(const float* a, const float* b, std::size_t n) noexcept
+	{
+		static const auto kernel = l2kernels::select();
+		return kernel(a, b, n);
+	}
+
+	// Each thread keeps marks of the visited nodes. A new tag is used for every search, so the marks don't have to be cleared.
+	struct VisitedNodes
+	{
+		std::vector<std::uint32_t> marks;
+		std::uint32_t tag = 0;
+	};
+}	// anonymous namespace
+
+
+void HnswIndex::build(const DescriptorStore& store)
+{
+	clear();
+	update(store);
+}	// build
+
+void HnswIndex::update(const DescriptorStore& store)
+{
+	if (store.size() < size() || (!empty() && store.dimension() != this->dim))
+		clear();	// the graph does not correspond to the store, so it is rebuilt
+
+	if (store.size() > std::numeric_limits<std::uint32_t>::max())
+		throw std::runtime_error("Too many descriptors for the HNSW index.");
+
+	if (this->parameters.maxLinks < 2)
+		throw std::invalid_argument("The number of links per node of the HNSW graph must be at least 2.");
+
+	std::size_t first = size(), n = store.size();
+	this->dim = store.dimension();
+
+	// Space for the links of new nodes is allocated before inserting any of them, so it does not move while the graph is updated concurrently
+	this->levels.resize(n);
+	this->bottomLinks.resize(n * (maxLinksAt(0) + 1), 0);
+	this->upperLinks.resize(n);
+	for (std::size_t i = first; i < n; ++i)
+	{
+		this->levels[i] = static_cast<std::uint8_t>(randomLevel());
+		this->upperLinks[i].assign(this->levels[i] * (this->parameters.maxLinks + 1), 0);
+	}
+
+	if (first == 0 && n > 0)	// the first node becomes the entry point
+	{
+		this->entryPoint = 0;
+		this->maxLevel = this->levels[0];
+		first = 1;
+	}
+
+	std::vector<std::uint32_t> nodes(n > first ? n - first : 0);
+	std::iota(nodes.begin(), nodes.end(), static_cast<std::uint32_t>(first));
+
+	try
+	{
+		if (this->parameters.sequential)
+		{
+			for (std::uint32_t node : nodes)
+				insert(store, node);
+		}
+		else parallel::forEach(nodes.cbegin(), nodes.cend(), [this, &store](std::uint32_t node) { insert(store, node); });
+	}
+	catch (...)
+	{
+		clear();	// the graph may be inconsistent
+		throw;
+	}
+
+	this->storeFingerprint = store.fingerprint();
+}	// update
+
+std::size_t HnswIndex::randomLevel()
+{
+	// The probability of a node to reach the next level is 1/maxLinks
+	double u = std::uniform_real_distribution<double>(0.0, 1.0)(this->random);
+	double level = -std::log(1.0 - u) / std::log(static_cast<double>(this->parameters.maxLinks));
+	return std::min(static_cast<std::size_t>(level), levelLimit);
+}	// randomLevel
+
+std::uint32_t* HnswIndex::linksAt(std::size_t node, std::size_t level) noexcept
+{
+	return level == 0 ? this->bottomLinks.data() + node * (maxLinksAt(0) + 1)
+		: this->upperLinks[node].data() + (level - 1) * (this->parameters.maxLinks + 1);
+}
+
+const std::uint32_t* HnswIndex::linksAt(std::size_t node, std::size_t level) const noexcept
+{
+	return level == 0 ? this->bottomLinks.data() + node * (maxLinksAt(0) + 1)
+		: this->upperLinks[node].data() + (level - 1) * (this->parameters.maxLinks + 1);
+}
+
+void HnswIndex::insert(const DescriptorStore& store, std::uint32_t node)
+{
+	const float* x = store.descriptor(node);
+	std::size_t level = this->levels[node];
+
+	// Nodes which raise the top level of the graph are inserted exclusively, because they become the new entry point
+	std::unique_lock<std::mutex> entryLock(this->locks.entryMutex);
+	std::uint32_t entry = this->entryPoint;
+	std::size_t top = this->maxLevel;
+	if (level <= top)
+		entryLock.unlock();
+
+	if (top > level)
+		entry = descend(store, x, entry, top, level, true);
+
+	for (std::size_t l = std::min(level, top) + 1; l-- > 0; )
+	{
+		auto candidates = searchLevel(store, x, entry, this->parameters.efConstruction, l, true);
+		candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [node](const Candidate& c) { return c.second == node; }),
+			candidates.end());
+		if (candidates.empty())
+			continue;
+
+		auto neighbors = selectNeighbors(store, candidates, this->parameters.maxLinks);
+		{
+			std::lock_guard<std::mutex> lock(this->locks[node]);
+			std::uint32_t* links = linksAt(node, l);
+			links[0] = static_cast<std::uint32_t>(neighbors.size());
+			std::copy(neighbors.cbegin(), neighbors.cend(), links + 1);
+		}
+
+		for (auto neighbor : neighbors)
+			link(store, neighbor, node, l);
+
+		entry = candidates.front().second;
+	}	// l
+
+	if (level > top)
+	{
+		this->entryPoint = node;
+		this->maxLevel = level;
+	}
+}	// insert
+
+void HnswIndex::link(const DescriptorStore& store, std::uint32_t node, std::uint32_t neighbor, std::size_t level)
+{
+	std::lock_guard<std::mutex> lock(this->locks[node]);
+	std::uint32_t* links = linksAt(node, level);
+	std::size_t count = links[0], maxLinks = maxLinksAt(level);
+	if (count < maxLinks)
+	{
+		links[1 + count] = neighbor;
+		++links[0];
+		return;
+	}
+
+	// The node is full, so the new link competes with the existing ones
+	const float* x = store.descriptor(node);
+	std::vector<Candidate> candidates;
+	candidates.reserve(count + 1);
+	candidates.emplace_back(squaredDistance(x, store.descriptor(neighbor), this->dim), neighbor);
+	for (std::size_t i = 1; i <= count; ++i)
+		candidates.emplace_back(squaredDistance(x, store.descriptor(links[i]), this->dim), links[i]);
+
+	std::sort(candidates.begin(), candidates.end());
+	auto selected = selectNeighbors(store, candidates, maxLinks);
+	links[0] = static_cast<std::uint32_t>(selected.size());
+	std::copy(selected.cbegin(), selected.cend(), links + 1);
+}	// link
+
+std::vector<std::uint32_t> HnswIndex::selectNeighbors(const DescriptorStore& store, const std::vector<Candidate>& candidates,
+	std::size_t maxLinks) const
+{
+	// A candidate is skipped if it is closer to one of the selected neighbors than to the base node: the selected neighbor already
+	// leads in that direction
+	std::vector<std::uint32_t> selected;
+	selected.reserve(maxLinks);
+	for (const auto& [distance, candidate] : candidates)
+	{
+		if (selected.size() >= maxLinks)
+			break;
+
+		const float* c = store.descriptor(candidate);
+		if (std::all_of(selected.cbegin(), selected.cend(), [&, distance = distance](std::uint32_t s)
+			{
+				return squaredDistance(c, store.descriptor(s), this->dim) >= distance;
+			}))
+		{
+			selected.push_back(candidate);
+		}
+	}	// candidate
+
+	return selected;
+}	// selectNeighbors
+
+std::uint32_t HnswIndex::descend(const DescriptorStore& store, const float* query, std::uint32_t entry, std::size_t fromLevel,
+	std::size_t toLevel, bool lock) const
+{
+	float distance = squaredDistance(query, store.descriptor(entry), this->dim);
+	std::vector<std::uint32_t> links;
+	for (std::size_t level = fromLevel; level > toLevel; --level)
+	{
+		for (bool changed = true; changed; )
+		{
+			changed = false;
+			{
+				std::unique_lock<std::mutex> nodeLock;
+				if (lock)
+					nodeLock = std::unique_lock<std::mutex>(this->locks[entry]);
+
+				const std::uint32_t* p = linksAt(entry, level);
+				links.assign(p + 1, p + 1 + p[0]);
+			}
+
+			for (auto neighbor : links)
+			{
+				float d = squaredDistance(query, store.descriptor(neighbor), this->dim);
+				if (d < distance)
+				{
+					distance = d;
+					entry = neighbor;
+					changed = true;
+				}
+			}	// neighbor
+		}	// changed
+	}	// level
+
+	return entry;
+}	// descend
+
+std::vector<HnswIndex::Candidate> HnswIndex::searchLevel(const DescriptorStore& store, const float* query, std::uint32_t entry,
+	std::size_t ef, std::size_t level, bool lock) const
+{
+	thread_local VisitedNodes visited;
+	if (visited.marks.size() < size())
+		visited.marks.resize(size(), 0);
+	if (++visited.tag == 0)		// the tags have wrapped around
+	{
+		std::fill(visited.marks.begin(), visited.marks.end(), 0);
+		visited.tag = 1;
+	}
+
+	// The closest candidates are explored first, while the farthest result is dropped when a closer node is found
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+	std::priority_queue<Candidate> results;
+
+	float d = squaredDistance(query, store.descriptor(entry), this->dim);
+	candidates.emplace(d, entry);
+	results.emplace(d, entry);
+	visited.marks[entry] = visited.tag;
+
+	std::vector<std::uint32_t> links;
+	while (!candidates.empty())
+	{
+		auto [distance, node] = candidates.top();
+		if (results.size() >= ef && distance > results.top().first)
+			break;		// all remaining candidates are farther than the results
+
+		candidates.pop();
+		{
+			std::unique_lock<std::mutex> nodeLock;
+			if (lock)
+				nodeLock = std::unique_lock<std::mutex>(this->locks[node]);
+
+			const std::uint32_t* p = linksAt(node, level);
+			links.assign(p + 1, p + 1 + p[0]);
+		}
+
+		for (auto neighbor : links)
+		{
+			if (visited.marks[neighbor] == visited.tag)
+				continue;
+
+			visited.marks[neighbor] = visited.tag;
+			float dn = squaredDistance(query, store.descriptor(neighbor), this->dim);
+			if (results.size() < ef || dn < results.top().first)
+			{
+				candidates.emplace(dn, neighbor);
+				results.emplace(dn, neighbor);
+				if (results.size() > ef)
+					results.pop();
+			}
+		}	// neighbor
+	}	// while
+
+	std::vector<Candidate> nearest(results.size());
+	for (auto it = nearest.rbegin(); it != nearest.rend(); ++it, results.pop())
+		*it = results.top();
+
+	return nearest;
+}	// searchLevel
+
+std::vector<NearestNeighbors::Neighbor> HnswIndex::search(const DescriptorStore& store, const float* query, std::size_t k,
+	bool uniqueLabels) const
+{
+	if (empty())
+		return {};
+
+	std::uint32_t entry = descend(store, query, this->entryPoint, this->maxLevel, 0, false);
+	auto candidates = searchLevel(store, query, entry, std::max(this->parameters.efSearch, k), 0, false);
+
+	NearestNeighbors nearest(k, uniqueLabels);
+	for (const auto& [distance, node] : candidates)
+		nearest.push(node, distance, store.label(node));
+
+	return nearest.sorted();
+}	// search
+
+void HnswIndex::save(const std::string& filePath) const
+{
+	FileHeader header = {};
+	binaryio::initHeader(header);
+	header.dimension = this->dim;
+	header.count = size();
+	header.maxLinks = this->parameters.maxLinks;
+	header.efConstruction = this->parameters.efConstruction;
+	header.entryPoint = this->entryPoint;
+	header.maxLevel = this->maxLevel;
+	header.fingerprint = this->storeFingerprint;
+
+	binaryio::atomicWrite(filePath, [&](std::ostream& file)
+		{
+			binaryio::write(file, header);
+			binaryio::write(file, this->levels.data(), this->levels.size());
+			binaryio::write(file, this->bottomLinks.data(), this->bottomLinks.size());
+			for (const auto& links : this->upperLinks)
+				binaryio::write(file, links.data(), links.size());
+		});
+}	// save
+
+bool HnswIndex::load(const std::string& filePath, const DescriptorStore& store)
+{
+	HnswIndex index(this->parameters);
+	bool loaded = binaryio::tryRead(filePath, [&](std::istream& file)
+		{
+			auto header = binaryio::read<FileHeader>(file);
+			if (!binaryio::checkHeader(header))
+				return false;
+
+			// The graph is only valid for the descriptors it was built for
+			if (header.dimension != store.dimension() || header.count != store.size() || header.fingerprint != store.fingerprint())
+				return false;
+
+			if (header.maxLinks < 2 || header.maxLinks > std::numeric_limits<std::uint32_t>::max() || header.maxLevel > levelLimit
+				|| (header.count > 0 && header.entryPoint >= header.count))
+				return false;
+
+			// The graph structure is defined by the parameters it was built with
+			index.parameters.maxLinks = static_cast<std::size_t>(header.maxLinks);
+			index.parameters.efConstruction = static_cast<std::size_t>(header.efConstruction);
+			index.dim = store.dimension();
+			index.entryPoint = static_cast<std::uint32_t>(header.entryPoint);
+			index.maxLevel = static_cast<std::size_t>(header.maxLevel);
+			index.storeFingerprint = header.fingerprint;
+
+			std::size_t n = store.size();
+			index.levels.resize(n);
+			index.bottomLinks.resize(n * (index.maxLinksAt(0) + 1));
+			index.upperLinks.resize(n);
+			binaryio::read(file, index.levels.data(), n);
+			binaryio::read(file, index.bottomLinks.data(), index.bottomLinks.size());
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				if (index.levels[i] > index.maxLevel)
+					return false;
+
+				index.upperLinks[i].resize(index.levels[i] * (index.parameters.maxLinks + 1));
+				binaryio::read(file, index.upperLinks[i].data(), index.upperLinks[i].size());
+			}	// i
+
+			// Searches start from the entry point on the top level
+			if (n > 0 && index.levels[index.entryPoint] != index.maxLevel)
+				return false;
+
+			// Make sure that links don't point outside the graph
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				for (std::size_t level = 0; level <= index.levels[i]; ++level)
+				{
+					const std::uint32_t* links = index.linksAt(i, level);
+					if (links[0] > index.maxLinksAt(level) || std::any_of(links + 1, links + 1 + links[0],
+						[n, &index, level](std::uint32_t node) { return node >= n || index.levels[node] < level; }))
+						return false;
+				}
+			}	// i
+
+			return true;
+		});	// tryRead
+
+	if (!loaded)
+		return false;
+
+	// Nodes added later get random levels, which don't have to repeat the original sequence
+	index.random = this->random;
+	*this = std::move(index);
+	return true;
+}	// load
+
+void HnswIndex::clear() noexcept
+{
+	this->levels.clear();
+	this->bottomLinks.clear();
+	this->upperLinks.clear();
+	this->entryPoint = 0;
+	this->maxLevel = 0;
+	this->dim = 0;
+	this->storeFingerprint = 0;
+	this->random.seed(100);
+}	// clear
@@ -0,0 +1,146 @@
+#ifndef HNSWINDEX_H
+#define HNSWINDEX_H
+
+#include "searchindex.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/*
+* HnswIndex is a hierarchical navigable small world graph (HNSW) for approximate nearest neighbor search with low latency.
+*
+* Every descriptor is a node of a multi-layer proximity graph. The bottom layer contains all nodes, and each upper layer contains
+* an exponentially decreasing random subset of the nodes below. A search descends greedily from the entry point through the sparse
+* upper layers and then explores the bottom layer keeping a list of the ef best candidates. Thus, only a tiny fraction of the gallery
+* is compared to the query. Neighbors of a node are selected by a heuristic which prefers diverse directions over the closest nodes.
+*
+* Distances are computed to the float descriptors in the DescriptorStore, so the graph only holds the links. Nodes are inserted
+* incrementally, i.e. the graph can be updated without rebuilding. Insertions of a batch of descriptors are performed in parallel
+* with per-node locks, so the links depend on the order in which threads happen to insert the nodes. If the graph has to be
+* reproducible (e.g. to compare recall between runs), the nodes can be inserted sequentially instead.
+*/
+
+class HnswIndex : public SearchIndex
+{
+public:
+
+	struct Parameters
+	{
+		std::size_t maxLinks = 16;			// the maximum number of links per node on upper layers (twice as many on the bottom layer)
+		std::size_t efConstruction = 100;	// the size of the candidate list used for inserting nodes
+		std::size_t efSearch = 64;			// the size of the candidate list used for searching (increased to k if needed)
+		bool sequential = false;			// insert nodes one by one, which makes the graph reproducible, but takes longer
+	};
+
+	HnswIndex() = default;
+
+	explicit HnswIndex(const Parameters& parameters)
+		: parameters(parameters) {}
+
+	std::unique_ptr<SearchIndex> clone() const override { return std::make_unique<HnswIndex>(*this); }
+
+	std::string name() const override { return "HNSW index"; }
+
+	std::string fileExtension() const override { return ".hnsw"; }
+
+	std::size_t size() const noexcept override { return this->levels.size(); }
+
+	// The size of the candidate list for searching can be changed at any time
+	void setEf(std::size_t efSearch) noexcept { this->parameters.efSearch = efSearch; }
+
+	void build(const DescriptorStore& store) override;
+
+	void update(const DescriptorStore& store) override;
+
+	std::vector<NearestNeighbors::Neighbor> search(const DescriptorStore& store, const float* query, std::size_t k,
+		bool uniqueLabels) const override;
+
+	void save(const std::string& filePath) const override;
+
+	bool load(const std::string& filePath, const DescriptorStore& store) override;
+
+	void clear() noexcept override;
+
+private:
+
+	// Binary file header
+	struct FileHeader
+	{
+		static constexpr char signature[8] = { 'F', 'A', 'C', 'E', 'H', 'N', 'S', 'W' };
+		static constexpr std::uint32_t currentVersion = 1;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byteOrderMark;
+		std::uint64_t dimension;
+		std::uint64_t count;
+		std::uint64_t maxLinks;
+		std::uint64_t efConstruction;
+		std::uint64_t entryPoint;
+		std::uint64_t maxLevel;
+		std::uint64_t fingerprint;
+	};	// FileHeader
+
+	// Mutexes are neither copyable nor movable, so a copy of the index gets its own set of them
+	struct Locks
+	{
+		static constexpr std::size_t count = 4096;	// nodes share mutexes by the remainder of their index
+
+		Locks() : nodeMutexes(std::make_unique<std::mutex[]>(count)) {}
+		Locks(const Locks&) : Locks() {}
+		Locks& operator = (const Locks&) noexcept { return *this; }
+
+		std::mutex& operator[](std::size_t node) const noexcept { return this->nodeMutexes[node % count]; }
+
+		std::unique_ptr<std::mutex[]> nodeMutexes;
+		std::mutex entryMutex;
+	};	// Locks
+
+	using Candidate = std::pair<float, std::uint32_t>;	// distance and node
+
+	static constexpr std::size_t levelLimit = 32;	// the highest level a node can reach
+
+	std::size_t maxLinksAt(std::size_t level) const noexcept { return level == 0 ? 2 * this->parameters.maxLinks : this->parameters.maxLinks; }
+
+	// Returns a pointer to the link count of the node on the specified level followed by the links
+	std::uint32_t* linksAt(std::size_t node, std::size_t level) noexcept;
+	const std::uint32_t* linksAt(std::size_t node, std::size_t level) const noexcept;
+
+	std::size_t randomLevel();
+
+	void insert(const DescriptorStore& store, std::uint32_t node);
+
+	// Descends greedily from the entry point to the specified level
+	std::uint32_t descend(const DescriptorStore& store, const float* query, std::uint32_t entry, std::size_t fromLevel, std::size_t toLevel,
+		bool lock) const;
+
+	// Returns up to ef nodes on the level closest to the query sorted by distance
+	std::vector<Candidate> searchLevel(const DescriptorStore& store, const float* query, std::uint32_t entry, std::size_t ef,
+		std::size_t level, bool lock) const;
+
+	// Selects up to maxLinks diverse neighbors among the candidates sorted by distance
+	std::vector<std::uint32_t> selectNeighbors(const DescriptorStore& store, const std::vector<Candidate>& candidates, std::size_t maxLinks) const;
+
+	void link(const DescriptorStore& store, std::uint32_t node, std::uint32_t neighbor, std::size_t level);
+
+	Parameters parameters;
+	std::size_t dim = 0;
+	std::vector<std::uint8_t> levels;		// the top level of each node
+	std::vector<std::uint32_t> bottomLinks;	// the link count and maxLinksAt(0) slots for each node
+	std::vector<std::vector<std::uint32_t>> upperLinks;		// the link count and maxLinks slots per level above the bottom one
+	std::uint32_t entryPoint = 0;
+	std::size_t maxLevel = 0;
+	std::mt19937 random{ 100 };		// a fixed seed makes the levels of nodes reproducible; the links are not unless inserted sequentially
+	std::uint64_t storeFingerprint = 0;
+	mutable Locks locks;
+};	// HnswIndex
+
+
+#endif	// HNSWINDEX_H
@@ -0,0 +1,350 @@
+#include "ivfpqindex.h"
+#include "binaryio.h"
+#include "l2kernels.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+
+
+void IvfPqIndex::build(const DescriptorStore& store)
+{
+	clear();
+	if (store.empty())
+		return;
+
+	this->dim = store.dimension();
+	std::size_t n = store.size();
+
+	// Roughly sqrt(N) lists balance the cost of probing the coarse centroids against the cost of scanning the lists
+	std::size_t numLists = this->parameters.numLists > 0 ? this->parameters.numLists : static_cast<std::size_t>(std::lround(std::sqrt(n)));
+	numLists = std::clamp<std::size_t>(numLists, 1, n);
+
+	if (this->parameters.numSubspaces > 0)
+	{
+		if (this->dim % this->parameters.numSubspaces != 0)
+			throw std::invalid_argument("The number of subspaces must divide the descriptor dimension.");
+		this->numSubspaces = this->parameters.numSubspaces;
+	}
+	else
+	{
+		// Subspaces of 4 elements compress a float descriptor 16 times
+		this->numSubspaces = std::max<std::size_t>(this->dim / 4, 1);
+		while (this->dim % this->numSubspaces != 0)
+			--this->numSubspaces;
+	}
+
+	this->subDim = this->dim / this->numSubspaces;
+
+	// Train on an evenly spaced sample of descriptors, which is large enough for both the coarse quantizer and the codebooks
+	constexpr std::size_t samplesPerCentroid = 64, maxCodebookSize = 256, iterations = 16;
+	std::size_t numSamples = std::min(n, std::max(numLists, maxCodebookSize) * samplesPerCentroid);
+	std::vector<float> samples(numSamples * this->dim);
+	for (std::size_t i = 0; i < numSamples; ++i)
+		std::copy_n(store.descriptor(i * n / numSamples), this->dim, samples.data() + i * this->dim);
+
+	this->centroids = kmeans(samples.data(), numSamples, this->dim, numLists, iterations);
+
+	// The codebooks are trained on residuals grouped by subspaces
+	this->numCentroids = std::min(maxCodebookSize, numSamples);
+	std::vector<std::vector<float>> subvectors(this->numSubspaces, std::vector<float>(numSamples * this->subDim));
+	for (std::size_t i = 0; i < numSamples; ++i)
+	{
+		const float* x = samples.data() + i * this->dim;
+		const float* c = this->centroids.data() + nearest(this->centroids.data(), numLists, x, this->dim) * this->dim;
+		for (std::size_t j = 0; j < this->dim; ++j)
+			subvectors[j / this->subDim][i * this->subDim + j % this->subDim] = x[j] - c[j];
+	}	// i
+
+	this->codebooks.resize(this->numSubspaces * this->numCentroids * this->subDim);
+	for (std::size_t m = 0; m < this->numSubspaces; ++m)
+	{
+		auto codebook = kmeans(subvectors[m].data(), numSamples, this->subDim, this->numCentroids, iterations);
+		std::copy(codebook.cbegin(), codebook.cend(), this->codebooks.begin() + m * this->numCentroids * this->subDim);
+	}
+
+	this->lists.resize(numLists);
+	this->trainedCount = n;
+	update(store);
+}	// build
+
+void IvfPqIndex::update(const DescriptorStore& store)
+{
+	// The quantizers trained on a small gallery (e.g. the first enrolled face) do not represent a larger one, so the index is rebuilt
+	// once the store has doubled in size
+	if (this->lists.empty() || store.size() < this->count || store.dimension() != this->dim || store.size() >= 2 * this->trainedCount)
+	{
+		build(store);		// the index does not correspond to the store
+		return;
+	}
+
+	if (store.size() > std::numeric_limits<std::uint32_t>::max())
+		throw std::runtime_error("Too many descriptors for the IVF-PQ index.");
+
+	// Assign and encode the new descriptors in parallel, then append them to the lists in order
+	std::vector<std::size_t> indices(store.size() - this->count), assignments(indices.size());
+	std::vector<std::uint8_t> codes(indices.size() * this->numSubspaces);
+	std::iota(indices.begin(), indices.end(), std::size_t(0));
+	parallel::forEach(indices.cbegin(), indices.cend(), [this, &store, &assignments, &codes](std::size_t i)
+		{
+			const float* descriptor = store.descriptor(this->count + i);
+			assignments[i] = nearest(this->centroids.data(), this->lists.size(), descriptor, this->dim);
+			encode(descriptor, assignments[i], codes.data() + i * this->numSubspaces);
+		});
+
+	for (std::size_t i = 0; i < indices.size(); ++i)
+	{
+		auto& list = this->lists[assignments[i]];
+		list.ids.push_back(static_cast<std::uint32_t>(this->count + i));
+		list.codes.insert(list.codes.end(), codes.cbegin() + i * this->numSubspaces, codes.cbegin() + (i + 1) * this->numSubspaces);
+	}
+
+	this->count = store.size();
+	this->storeFingerprint = store.fingerprint();
+}	// update
+
+void IvfPqIndex::encode(const float* descriptor, std::size_t list, std::uint8_t* code) const
+{
+	const float* c = this->centroids.data() + list * this->dim;
+	std::vector<float> residual(this->dim);
+	for (std::size_t j = 0; j < this->dim; ++j)
+		residual[j] = descriptor[j] - c[j];
+
+	for (std::size_t m = 0; m < this->numSubspaces; ++m)
+	{
+		code[m] = static_cast<std::uint8_t>(nearest(this->codebooks.data() + m * this->numCentroids * this->subDim,
+			this->numCentroids, residual.data() + m * this->subDim, this->subDim));
+	}
+}	// encode
+
+std::vector<NearestNeighbors::Neighbor> IvfPqIndex::search(const DescriptorStore& store, const float* query, std::size_t k,
+	bool uniqueLabels) const
+{
+	if (empty())
+		return {};
+
+	static const auto squaredDistance = l2kernels::select();
+
+	// Find the lists with the closest centroids
+	std::vector<std::pair<float, std::size_t>> coarse(this->lists.size());
+	for (std::size_t i = 0; i < this->lists.size(); ++i)
+		coarse[i] = { squaredDistance(query, this->centroids.data() + i * this->dim, this->dim), i };
+
+	std::size_t numProbes = std::clamp<std::size_t>(this->parameters.numProbes, 1, this->lists.size());
+	std::partial_sort(coarse.begin(), coarse.begin() + numProbes, coarse.end());
+	coarse.resize(numProbes);
+
+	auto nearest = parallel::transformReduce(coarse.cbegin(), coarse.cend(), NearestNeighbors(k, uniqueLabels),
+		[](NearestNeighbors x, const NearestNeighbors& y)	// reduce
+		{
+			x.merge(y);
+			return x;
+		},
+		[&, this](const std::pair<float, std::size_t>& probe)	// transform
+		{
+			NearestNeighbors listNearest(k, uniqueLabels);
+			const auto& list = this->lists[probe.second];
+			const float* c = this->centroids.data() + probe.second * this->dim;
+			std::vector<float> residual(this->dim);
+			for (std::size_t j = 0; j < this->dim; ++j)
+				residual[j] = query[j] - c[j];
+
+			// Distances from the query residual to all codebook centroids of each subspace
+			std::vector<float> table(this->numSubspaces * this->numCentroids);
+			for (std::size_t m = 0; m < this->numSubspaces; ++m)
+			{
+				for (std::size_t j = 0; j < this->numCentroids; ++j)
+				{
+					table[m * this->numCentroids + j] = squaredDistance(residual.data() + m * this->subDim,
+						this->codebooks.data() + (m * this->numCentroids + j) * this->subDim, this->subDim);
+				}
+			}	// m
+
+			for (std::size_t t = 0; t < list.ids.size(); ++t)
+			{
+				const std::uint8_t* code = list.codes.data() + t * this->numSubspaces;
+				float d = 0;
+				for (std::size_t m = 0; m < this->numSubspaces; ++m)
+					d += table[m * this->numCentroids + code[m]];
+
+				listNearest.push(list.ids[t], d, store.label(list.ids[t]));
+			}
+
+			return listNearest;
+		}, 1);	// transformReduce
+
+	return nearest.sorted();
+}	// search
+
+void IvfPqIndex::save(const std::string& filePath) const
+{
+	FileHeader header = {};
+	binaryio::initHeader(header);
+	header.dimension = this->dim;
+	header.count = this->count;
+	header.trainedCount = this->trainedCount;
+	header.numLists = this->lists.size();
+	header.numSubspaces = this->numSubspaces;
+	header.numCentroids = this->numCentroids;
+	header.fingerprint = this->storeFingerprint;
+
+	binaryio::atomicWrite(filePath, [&](std::ostream& file)
+		{
+			binaryio::write(file, header);
+			binaryio::write(file, this->centroids.data(), this->centroids.size());
+			binaryio::write(file, this->codebooks.data(), this->codebooks.size());
+			for (const auto& list : this->lists)
+			{
+				binaryio::write<std::uint64_t>(file, list.ids.size());
+				binaryio::write(file, list.ids.data(), list.ids.size());
+				binaryio::write(file, list.codes.data(), list.codes.size());
+			}
+		});
+}	// save
+
+bool IvfPqIndex::load(const std::string& filePath, const DescriptorStore& store)
+{
+	IvfPqIndex index(this->parameters);
+	bool loaded = binaryio::tryRead(filePath, [&](std::istream& file)
+		{
+			auto header = binaryio::read<FileHeader>(file);
+			if (!binaryio::checkHeader(header))
+				return false;
+
+			// The index is only valid for the descriptors it was built for
+			if (header.dimension != store.dimension() || header.count != store.size() || header.fingerprint != store.fingerprint())
+				return false;
+
+			if (header.numLists == 0 || header.numLists > header.count || header.numSubspaces == 0 || header.dimension % header.numSubspaces != 0
+				|| header.numCentroids == 0 || header.numCentroids > 256 || header.trainedCount == 0 || header.trainedCount > header.count)
+				return false;
+
+			index.dim = store.dimension();
+			index.count = store.size();
+			index.trainedCount = static_cast<std::size_t>(header.trainedCount);
+			index.numSubspaces = static_cast<std::size_t>(header.numSubspaces);
+			index.subDim = index.dim / index.numSubspaces;
+			index.numCentroids = static_cast<std::size_t>(header.numCentroids);
+			index.storeFingerprint = header.fingerprint;
+			index.centroids.resize(static_cast<std::size_t>(header.numLists) * index.dim);
+			index.codebooks.resize(index.numSubspaces * index.numCentroids * index.subDim);
+			binaryio::read(file, index.centroids.data(), index.centroids.size());
+			binaryio::read(file, index.codebooks.data(), index.codebooks.size());
+
+			std::size_t total = 0;
+			index.lists.resize(static_cast<std::size_t>(header.numLists));
+			for (auto& list : index.lists)
+			{
+				auto size = binaryio::read<std::uint64_t>(file);
+				if (size > index.count - total)
+					return false;
+
+				list.ids.resize(static_cast<std::size_t>(size));
+				list.codes.resize(list.ids.size() * index.numSubspaces);
+				binaryio::read(file, list.ids.data(), list.ids.size());
+				binaryio::read(file, list.codes.data(), list.codes.size());
+				total += list.ids.size();
+
+				if (std::any_of(list.ids.cbegin(), list.ids.cend(), [&index](std::uint32_t id) { return id >= index.count; })
+					|| std::any_of(list.codes.cbegin(), list.codes.cend(), [&index](std::uint8_t code) { return code >= index.numCentroids; }))
+					return false;
+			}	// list
+
+			if (total != index.count)
+				return false;
+
+			return true;
+		});	// tryRead
+
+	if (!loaded)
+		return false;
+
+	*this = std::move(index);
+	return true;
+}	// load
+
+void IvfPqIndex::clear() noexcept
+{
+	this->centroids.clear();
+	this->codebooks.clear();
+	this->lists.clear();
+	this->dim = this->numSubspaces = this->subDim = this->numCentroids = this->count = this->trainedCount = 0;
+	this->storeFingerprint = 0;
+}	// clear
+
+std::size_t IvfPqIndex::nearest(const float* centroids, std::size_t k, const float* x, std::size_t dim) noexcept
+{
+	static const auto squaredDistance = l2kernels::select();
+
+	std::size_t best = 0;
+	float bestDistance = std::numeric_limits<float>::infinity();
+	for (std::size_t i = 0; i < k; ++i)
+	{
+		float d = squaredDistance(x, centroids + i * dim, dim);
+		if (d < bestDistance)
+		{
+			bestDistance = d;
+			best = i;
+		}
+	}	// i
+
+	return best;
+}	// nearest
+
+std::vector<float> IvfPqIndex::kmeans(const float* data, std::size_t n, std::size_t dim, std::size_t k, std::size_t iterations)
+{
+	// Initialize the centroids by evenly spaced points; the fixed seed makes training reproducible
+	std::vector<float> centroids(k * dim);
+	for (std::size_t i = 0; i < k; ++i)
+		std::copy_n(data + (i * n / k) * dim, dim, centroids.data() + i * dim);
+
+	std::mt19937 random(12345);
+	std::vector<std::size_t> indices(n), assignments(n, k);
+	std::iota(indices.begin(), indices.end(), std::size_t(0));
+	std::vector<double> sums(k * dim);
+	std::vector<std::size_t> counts(k);
+	for (std::size_t iteration = 0; iteration < iterations; ++iteration)
+	{
+		std::atomic<bool> changed{ false };
+		parallel::forEach(indices.cbegin(), indices.cend(), [&](std::size_t i)
+			{
+				std::size_t c = nearest(centroids.data(), k, data + i * dim, dim);
+				if (c != assignments[i])
+				{
+					assignments[i] = c;
+					changed.store(true, std::memory_order_relaxed);
+				}
+			});
+
+		if (!changed)
+			break;
+
+		std::fill(sums.begin(), sums.end(), 0.0);
+		std::fill(counts.begin(), counts.end(), 0);
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			double* sum = sums.data() + assignments[i] * dim;
+			for (std::size_t j = 0; j < dim; ++j)
+				sum[j] += data[i * dim + j];
+			++counts[assignments[i]];
+		}	// i
+
+		for (std::size_t c = 0; c < k; ++c)
+		{
+			// An empty cluster is restarted from a random point
+			if (counts[c] == 0)
+				std::copy_n(data + std::uniform_int_distribution<std::size_t>(0, n - 1)(random) * dim, dim, centroids.data() + c * dim);
+			else
+				std::transform(sums.cbegin() + c * dim, sums.cbegin() + (c + 1) * dim, centroids.begin() + c * dim,
+					[count = counts[c]](double sum) { return static_cast<float>(sum / count); });
+		}	// c
+	}	// iteration
+
+	return centroids;
+}	// kmeans
@@ -0,0 +1,120 @@
+#ifndef IVFPQINDEX_H
+#define IVFPQINDEX_H
+
+#include "searchindex.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/*
+* IvfPqIndex is an inverted-file index with product quantization (IVF-PQ) for approximate nearest neighbor search in large galleries.
+*
+* Descriptors are clustered by k-means into a number of inverted lists. Each descriptor is added to the list of its nearest centroid
+* and stored as a short code: the residual (the descriptor minus the centroid) is split into subspaces, and every subvector is replaced
+* by the index of the nearest centroid of a subspace codebook (also trained by k-means). A query is only compared to the descriptors
+* in a few lists with the closest centroids. The distances are computed asymmetrically: the query is not quantized, and for each probed
+* list a lookup table of distances from the query residual to all codebook centroids is built, so a distance to a code takes one
+* table lookup per subspace.
+*
+* The index refers to descriptors by their positions in the DescriptorStore it was built for. New descriptors are encoded with
+* the existing centroids and codebooks until the store doubles in size, at which point the index is retrained, so a gallery
+* which grows from a few enrollments does not keep a degenerate quantizer. The index can be saved to a file and loaded later; 
+* the file keeps the store's fingerprint to detect that the database has changed.
+*/
+
+class IvfPqIndex : public SearchIndex
+{
+public:
+
+	struct Parameters
+	{
+		std::size_t numLists = 0;		// the number of inverted lists; zero to choose it depending on the gallery size
+		std::size_t numSubspaces = 0;	// must divide the descriptor dimension; zero to use subspaces of 4 elements (if possible)
+		std::size_t numProbes = 8;		// the number of lists probed for each query
+	};
+
+	IvfPqIndex() = default;
+
+	explicit IvfPqIndex(const Parameters& parameters) noexcept
+		: parameters(parameters) {}
+
+	std::unique_ptr<SearchIndex> clone() const override { return std::make_unique<IvfPqIndex>(*this); }
+
+	std::string name() const override { return "IVF-PQ index"; }
+
+	std::string fileExtension() const override { return ".ivfpq"; }
+
+	std::size_t size() const noexcept override { return this->count; }
+
+	std::size_t numLists() const noexcept { return this->lists.size(); }
+
+	// The number of probes can be changed at any time
+	void setProbes(std::size_t numProbes) noexcept { this->parameters.numProbes = numProbes; }
+
+	// Trains the coarse quantizer and the codebooks on the descriptors in the store and adds all of them to the index
+	void build(const DescriptorStore& store) override;
+
+	void update(const DescriptorStore& store) override;
+
+	std::vector<NearestNeighbors::Neighbor> search(const DescriptorStore& store, const float* query, std::size_t k,
+		bool uniqueLabels) const override;
+
+	void save(const std::string& filePath) const override;
+
+	bool load(const std::string& filePath, const DescriptorStore& store) override;
+
+	void clear() noexcept override;
+
+private:
+
+	// Binary file header
+	struct FileHeader
+	{
+		static constexpr char signature[8] = { 'F', 'A', 'C', 'E', 'I', 'V', 'F', '\n' };
+		static constexpr std::uint32_t currentVersion = 2;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byteOrderMark;
+		std::uint64_t dimension;
+		std::uint64_t count;
+		std::uint64_t trainedCount;
+		std::uint64_t numLists;
+		std::uint64_t numSubspaces;
+		std::uint64_t numCentroids;
+		std::uint64_t fingerprint;
+	};	// FileHeader
+
+	struct InvertedList
+	{
+		std::vector<std::uint32_t> ids;		// descriptor indices in the store
+		std::vector<std::uint8_t> codes;	// numSubspaces bytes per descriptor
+	};
+
+	// Clusters n vectors of the specified dimension by Lloyd's algorithm and returns k centroids
+	static std::vector<float> kmeans(const float* data, std::size_t n, std::size_t dim, std::size_t k, std::size_t iterations);
+
+	// Returns the index of the centroid nearest to the vector
+	static std::size_t nearest(const float* centroids, std::size_t k, const float* x, std::size_t dim) noexcept;
+
+	void encode(const float* descriptor, std::size_t list, std::uint8_t* code) const;
+
+	Parameters parameters;
+	std::size_t dim = 0;
+	std::size_t numSubspaces = 0;
+	std::size_t subDim = 0;		// the number of elements in a subspace
+	std::size_t numCentroids = 0;	// the number of centroids in each codebook (at most 256)
+	std::vector<float> centroids;	// numLists x dim
+	std::vector<float> codebooks;	// numSubspaces x numCentroids x subDim
+	std::vector<InvertedList> lists;
+	std::size_t count = 0;
+	std::size_t trainedCount = 0;	// the number of descriptors the quantizers were trained on
+	std::uint64_t storeFingerprint = 0;
+};	// IvfPqIndex
+
+
+#endif	// IVFPQINDEX_H
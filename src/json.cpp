@@ -0,0 +1,280 @@
+#include "json.h"
+
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+
+
+namespace
+{
+	class Parser
+	{
+	public:
+		explicit Parser(std::string_view text) noexcept
+			: text(text) {}
+
+		std::map<std::string, std::string> parseObject()
+		{
+			std::map<std::string, std::string> members;
+
+			expect('{');
+			if (!consume('}'))
+			{
+				do
+				{
+					std::string name = parseString();
+					expect(':');
+					members[std::move(name)] = parseValue();
+				} while (consume(','));
+
+				expect('}');
+			}
+
+			skipSpaces();
+			if (this->pos != this->text.size())
+				fail("unexpected characters after the object");
+
+			return members;
+		}	// parseObject
+
+	private:
+
+		[[noreturn]] void fail(const std::string& what) const
+		{
+			throw std::invalid_argument("Malformed JSON at position " + std::to_string(this->pos) + ": " + what + '.');
+		}
+
+		void skipSpaces() noexcept
+		{
+			while (this->pos < this->text.size() && (this->text[this->pos] == ' ' || this->text[this->pos] == '\t'
+				|| this->text[this->pos] == '\r' || this->text[this->pos] == '\n'))
+				++this->pos;
+		}
+
+		bool consume(char c) noexcept
+		{
+			skipSpaces();
+			if (this->pos < this->text.size() && this->text[this->pos] == c)
+			{
+				++this->pos;
+				return true;
+			}
+
+			return false;
+		}
+
+		void expect(char c)
+		{
+			if (!consume(c))
+				fail(std::string("expected '") + c + '\'');
+		}
+
+		std::string parseValue()
+		{
+			skipSpaces();
+			if (this->pos >= this->text.size())
+				fail("unexpected end of the text");
+
+			char c = this->text[this->pos];
+			if (c == '"')
+				return parseString();
+			else if (c == '{' || c == '[')
+				fail("nested values are not supported");
+
+			// A number or a literal extends up to the next delimiter
+			std::size_t start = this->pos;
+			while (this->pos < this->text.size() && std::string_view(",}] \t\r\n").find(this->text[this->pos]) == std::string_view::npos)
+				++this->pos;
+
+			std::string value(this->text.substr(start, this->pos - start));
+			if (value != "true" && value != "false" && value != "null" && !isNumber(value))
+				fail("invalid value '" + value + '\'');
+
+			return value;
+		}	// parseValue
+
+		static bool isNumber(const std::string& value)
+		{
+			// The stream accepts a little more than JSON does (e.g. leading zeros), which is harmless
+			if (value.empty() || !(value.front() == '-' || (value.front() >= '0' && value.front() <= '9')))
+				return false;
+
+			std::istringstream stream(value);
+			stream.imbue(std::locale::classic());
+			double number;
+			stream >> number;
+			return stream && stream.peek() == std::char_traits<char>::eof();
+		}
+
+		std::string parseString()
+		{
+			expect('"');
+
+			std::string value;
+			for (;;)
+			{
+				if (this->pos >= this->text.size())
+					fail("unterminated string");
+
+				char c = this->text[this->pos++];
+				if (c == '"')
+					return value;
+				else if (static_cast<unsigned char>(c) < 0x20)
+					fail("control character in a string");
+				else if (c != '\\')
+				{
+					value += c;
+					continue;
+				}
+
+				if (this->pos >= this->text.size())
+					fail("unterminated string");
+
+				switch (c = this->text[this->pos++])
+				{
+				case '"': case '\\': case '/': value += c; break;
+				case 'b': value += '\b'; break;
+				case 'f': value += '\f'; break;
+				case 'n': value += '\n'; break;
+				case 'r': value += '\r'; break;
+				case 't': value += '\t'; break;
+				case 'u': appendUtf8(value, parseCodePoint()); break;
+				default: fail("invalid escape sequence");
+				}
+			}	// for
+		}	// parseString
+
+		std::uint32_t parseHex4()
+		{
+			if (this->pos + 4 > this->text.size())
+				fail("truncated escape sequence");
+
+			std::uint32_t code = 0;
+			for (int i = 0; i < 4; ++i)
+			{
+				char c = this->text[this->pos++];
+				code <<= 4;
+				if (c >= '0' && c <= '9')
+					code |= static_cast<std::uint32_t>(c - '0');
+				else if (c >= 'a' && c <= 'f')
+					code |= static_cast<std::uint32_t>(c - 'a' + 10);
+				else if (c >= 'A' && c <= 'F')
+					code |= static_cast<std::uint32_t>(c - 'A' + 10);
+				else fail("invalid escape sequence");
+			}
+
+			return code;
+		}	// parseHex4
+
+		std::uint32_t parseCodePoint()
+		{
+			std::uint32_t code = parseHex4();
+			if (code >= 0xD800 && code < 0xDC00)		// a high surrogate must be followed by a low one
+			{
+				if (this->text.substr(this->pos, 2) != "\\u")
+					fail("unpaired surrogate");
+
+				this->pos += 2;
+				std::uint32_t low = parseHex4();
+				if (low < 0xDC00 || low >= 0xE000)
+					fail("unpaired surrogate");
+
+				code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+			}
+			else if (code >= 0xDC00 && code < 0xE000)
+				fail("unpaired surrogate");
+
+			return code;
+		}	// parseCodePoint
+
+		static void appendUtf8(std::string& value, std::uint32_t code)
+		{
+			if (code < 0x80)
+				value += static_cast<char>(code);
+			else if (code < 0x800)
+			{
+				value += static_cast<char>(0xC0 | (code >> 6));
+				value += static_cast<char>(0x80 | (code & 0x3F));
+			}
+			else if (code < 0x10000)
+			{
+				value += static_cast<char>(0xE0 | (code >> 12));
+				value += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+				value += static_cast<char>(0x80 | (code & 0x3F));
+			}
+			else
+			{
+				value += static_cast<char>(0xF0 | (code >> 18));
+				value += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+				value += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+				value += static_cast<char>(0x80 | (code & 0x3F));
+			}
+		}	// appendUtf8
+
+		std::string_view text;
+		std::size_t pos = 0;
+	};	// Parser
+}	// anonymous namespace
+
+
+std::string json::quote(std::string_view text)
+{
+	static constexpr char hexDigits[] = "0123456789abcdef";
+
+	std::string quoted;
+	quoted.reserve(text.size() + 2);
+	quoted += '"';
+	for (char c : text)
+	{
+		switch (c)
+		{
+		case '"': quoted += "\\\""; break;
+		case '\\': quoted += "\\\\"; break;
+		case '\b': quoted += "\\b"; break;
+		case '\f': quoted += "\\f"; break;
+		case '\n': quoted += "\\n"; break;
+		case '\r': quoted += "\\r"; break;
+		case '\t': quoted += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				quoted += "\\u00";
+				quoted += hexDigits[(c >> 4) & 0xF];
+				quoted += hexDigits[c & 0xF];
+			}
+			else quoted += c;	// UTF-8 sequences are passed through
+		}
+	}	// for
+
+	quoted += '"';
+	return quoted;
+}	// quote
+
+std::string json::number(double value)
+{
+	if (!std::isfinite(value))
+		return "null";
+
+	std::ostringstream stream;
+	stream.imbue(std::locale::classic());
+	stream << std::setprecision(std::numeric_limits<double>::digits10) << value;
+	return stream.str();
+}	// number
+
+std::map<std::string, std::string> json::parseObject(std::string_view text)
+{
+	return Parser(text).parseObject();
+}	// parseObject
+
+bool json::toBool(const std::string& value)
+{
+	if (value == "true")
+		return true;
+	else if (value == "false")
+		return false;
+	else throw std::invalid_argument("A boolean value is expected instead of '" + value + "'.");
+}	// toBool
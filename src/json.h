@@ -0,0 +1,33 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <map>
+#include <string>
+#include <string_view>
+
+
+/*
+* A handful of helpers for the small JSON messages exchanged with clients. Only flat objects are parsed, which is all the query
+* protocol needs, and output is composed by the callers from quoted strings and numbers.
+*/
+
+namespace json
+{
+
+	// Returns the text enclosed in quotes with special characters escaped
+	std::string quote(std::string_view text);
+
+	// Formats a number. Infinities and NaNs, which JSON cannot represent, become null.
+	std::string number(double value);
+
+	// Parses an object whose members are strings, numbers, booleans, or nulls. String values are unescaped, other values are
+	// returned as they appear in the text. Throws std::invalid_argument if the text is malformed or contains nested values.
+	std::map<std::string, std::string> parseObject(std::string_view text);
+
+	// Converts a value returned by parseObject() to a boolean. Throws std::invalid_argument if it is neither true nor false.
+	bool toBool(const std::string& value);
+
+}	// json
+
+
+#endif	// JSON_H
@@ -0,0 +1,225 @@
+#include "l2kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define L2KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif	// !_MSC_VER
+#endif	// x86
+
+#include <cstdint>
+
+
+namespace l2kernels
+{
+
+	float squaredScalar(const float* v1, const float* v2, std::size_t n) noexcept
+	{
+		// Independent partial sums let the compiler pipeline the operations without reordering floating-point additions
+		float sum[4] = { 0, 0, 0, 0 };
+		std::size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			for (std::size_t j = 0; j < 4; ++j)
+			{
+				float d = v1[i + j] - v2[i + j];
+				sum[j] += d * d;
+			}
+		}	// i
+
+		for (; i < n; ++i)
+		{
+			float d = v1[i] - v2[i];
+			sum[0] += d * d;
+		}
+
+		return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+	}	// squaredScalar
+
+	void innerProductsScalar(const float* a, std::size_t na, const float* b, std::size_t nb, std::size_t n, float* out) noexcept
+	{
+		for (std::size_t i = 0; i < na; ++i)
+		{
+			for (std::size_t j = 0; j < nb; ++j)
+			{
+				const float *u = a + i * n, *v = b + j * n;
+				float sum[4] = { 0, 0, 0, 0 };
+				std::size_t k = 0;
+				for (; k + 4 <= n; k += 4)
+				{
+					for (std::size_t l = 0; l < 4; ++l)
+						sum[l] += u[k + l] * v[k + l];
+				}
+
+				for (; k < n; ++k)
+					sum[0] += u[k] * v[k];
+
+				out[i * nb + j] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+			}	// j
+		}	// i
+	}	// innerProductsScalar
+
+	float squaredQuantizedScalar(const float* residual, const float* scale, const std::uint8_t* codes, std::size_t n) noexcept
+	{
+		float sum[4] = { 0, 0, 0, 0 };
+		std::size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			for (std::size_t j = 0; j < 4; ++j)
+			{
+				float d = residual[i + j] - scale[i + j] * codes[i + j];
+				sum[j] += d * d;
+			}
+		}	// i
+
+		for (; i < n; ++i)
+		{
+			float d = residual[i] - scale[i] * codes[i];
+			sum[0] += d * d;
+		}
+
+		return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+	}	// squaredQuantizedScalar
+
+
+#ifdef L2KERNELS_X86
+
+	namespace
+	{
+		void cpuid(int leaf, int subleaf, std::uint32_t (&regs)[4]) noexcept
+		{
+#ifdef _MSC_VER
+			int r[4];
+			__cpuidex(r, leaf, subleaf);
+			for (int i = 0; i < 4; ++i)
+				regs[i] = static_cast<std::uint32_t>(r[i]);
+#else
+			__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif	// !_MSC_VER
+		}
+
+		std::uint64_t xgetbv() noexcept
+		{
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			std::uint32_t eax, edx;
+			__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return (static_cast<std::uint64_t>(edx) << 32) | eax;
+#endif	// !_MSC_VER
+		}
+
+		InstructionSet detectInstructionSet() noexcept
+		{
+			std::uint32_t regs[4];
+			cpuid(0, 0, regs);
+			if (regs[0] < 7)
+				return InstructionSet::Scalar;
+
+			// The OS must save the extended registers on context switches (OSXSAVE and XCR0), otherwise they cannot be used
+			cpuid(1, 0, regs);
+			bool osxsave = regs[2] & (1u << 27), fma = regs[2] & (1u << 12);
+			if (!osxsave)
+				return InstructionSet::Scalar;
+
+			std::uint64_t xcr0 = xgetbv();
+			bool ymmEnabled = (xcr0 & 0x6) == 0x6;		// SSE and AVX state
+			bool zmmEnabled = (xcr0 & 0xE6) == 0xE6;	// opmask and ZMM state as well
+
+			cpuid(7, 0, regs);
+			bool avx2 = regs[1] & (1u << 5), avx512f = regs[1] & (1u << 16);
+
+			if (avx512f && zmmEnabled)
+				return InstructionSet::AVX512;
+			if (avx2 && fma && ymmEnabled)
+				return InstructionSet::AVX2;
+			return InstructionSet::Scalar;
+		}	// detectInstructionSet
+	}	// anonymous namespace
+
+	InstructionSet detect() noexcept
+	{
+		static const InstructionSet instructionSet = detectInstructionSet();
+		return instructionSet;
+	}
+
+	SquaredDistance get(InstructionSet instructionSet) noexcept
+	{
+		switch (instructionSet)
+		{
+		case InstructionSet::AVX512:
+			return &squaredAvx512;
+		case InstructionSet::AVX2:
+			return &squaredAvx2;
+		default:
+			return &squaredScalar;
+		}
+	}	// get
+
+	InnerProducts getInnerProducts(InstructionSet instructionSet) noexcept
+	{
+		switch (instructionSet)
+		{
+		case InstructionSet::AVX512:
+			return &innerProductsAvx512;
+		case InstructionSet::AVX2:
+			return &innerProductsAvx2;
+		default:
+			return &innerProductsScalar;
+		}
+	}	// getInnerProducts
+
+	SquaredQuantizedDistance getQuantized(InstructionSet instructionSet) noexcept
+	{
+		switch (instructionSet)
+		{
+		case InstructionSet::AVX512:
+			return &squaredQuantizedAvx512;
+		case InstructionSet::AVX2:
+			return &squaredQuantizedAvx2;
+		default:
+			return &squaredQuantizedScalar;
+		}
+	}	// getQuantized
+
+#else
+
+	InstructionSet detect() noexcept
+	{
+		return InstructionSet::Scalar;
+	}
+
+	SquaredDistance get(InstructionSet) noexcept
+	{
+		return &squaredScalar;	// vectorized kernels are only available on x86
+	}
+
+	InnerProducts getInnerProducts(InstructionSet) noexcept
+	{
+		return &innerProductsScalar;
+	}
+
+	SquaredQuantizedDistance getQuantized(InstructionSet) noexcept
+	{
+		return &squaredQuantizedScalar;
+	}
+
+#endif	// !L2KERNELS_X86
+
+
+	const char* getName(InstructionSet instructionSet) noexcept
+	{
+		switch (instructionSet)
+		{
+		case InstructionSet::AVX512:
+			return "AVX-512";
+		case InstructionSet::AVX2:
+			return "AVX2";
+		default:
+			return "Scalar";
+		}
+	}	// getName
+
+}	// l2kernels
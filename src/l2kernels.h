@@ -0,0 +1,76 @@
+#ifndef L2KERNELS_H
+#define L2KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+* Squared L2 distance kernels for packed float vectors. Vectorized versions are compiled for AVX2 and AVX-512, and the best one 
+* supported by the CPU is chosen at runtime, so the program still runs on processors lacking these extensions. 
+* 
+* The kernels do not allocate memory and accept vectors of any length, although face descriptors are typically 128-dimensional.
+* 
+* Inner product kernels compute a block of dot products between two sets of row-major vectors, i.e. a small matrix multiplication 
+* A*B^T. Several rows of both matrices are processed at once, so each loaded value is reused in multiple multiply-adds.
+* 
+* Quantized kernels compute the squared distance between a float query and a vector of 8-bit codes with per-dimension scales, 
+* i.e. sum((residual[i] - scale[i]*code[i])^2), where the residual is the query minus the per-dimension offset. Reading one byte 
+* per element instead of four makes a scan over a large gallery four times less memory-bound.
+*/
+
+namespace l2kernels
+{
+	enum class InstructionSet
+	{
+		Scalar,
+		AVX2,
+		AVX512
+	};
+
+	using SquaredDistance = float (*)(const float* v1, const float* v2, std::size_t n) noexcept;
+
+	// Computes out[i*nb + j] = dot(a[i], b[j]) for na rows of a and nb rows of b, each row having n elements
+	using InnerProducts = void (*)(const float* a, std::size_t na, const float* b, std::size_t nb, std::size_t n, float* out) noexcept;
+
+	using SquaredQuantizedDistance = float (*)(const float* residual, const float* scale, const std::uint8_t* codes, std::size_t n) noexcept;
+
+	float squaredScalar(const float* v1, const float* v2, std::size_t n) noexcept;
+
+	float squaredAvx2(const float* v1, const float* v2, std::size_t n) noexcept;	// requires AVX2 and FMA
+
+	float squaredAvx512(const float* v1, const float* v2, std::size_t n) noexcept;	// requires AVX-512F
+
+	void innerProductsScalar(const float* a, std::size_t na, const float* b, std::size_t nb, std::size_t n, float* out) noexcept;
+
+	void innerProductsAvx2(const float* a, std::size_t na, const float* b, std::size_t nb, std::size_t n, float* out) noexcept;
+
+	void innerProductsAvx512(const float* a, std::size_t na, const float* b, std::size_t nb, std::size_t n, float* out) noexcept;
+
+	float squaredQuantizedScalar(const float* residual, const float* scale, const std::uint8_t* codes, std::size_t n) noexcept;
+
+	float squaredQuantizedAvx2(const float* residual, const float* scale, const std::uint8_t* codes, std::size_t n) noexcept;
+
+	float squaredQuantizedAvx512(const float* residual, const float* scale, const std::uint8_t* codes, std::size_t n) noexcept;
+
+	// Returns the most advanced instruction set supported by both the CPU and the operating system (detected once)
+	InstructionSet detect() noexcept;
+
+	const char* getName(InstructionSet instructionSet) noexcept;
+
+	SquaredDistance get(InstructionSet instructionSet) noexcept;
+
+	InnerProducts getInnerProducts(InstructionSet instructionSet) noexcept;
+
+	SquaredQuantizedDistance getQuantized(InstructionSet instructionSet) noexcept;
+
+	inline SquaredDistance select() noexcept { return get(detect()); }
+
+	inline InnerProducts selectInnerProducts() noexcept { return getInnerProducts(detect()); }
+
+	inline SquaredQuantizedDistance selectQuantized() noexcept { return getQuantized(detect()); }
+
+}	// l2kernels
+
+
+#endif	// L2KERNELS_H
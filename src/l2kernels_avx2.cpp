@@ -0,0 +1,142 @@
+#include "l2kernels.h"
+
+// This file must be compiled with AVX2 and FMA enabled (see CMakeLists.txt). The kernel is only called on processors supporting them.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#include <immintrin.h>
+#include <cstdint>
+
+
+namespace l2kernels
+{
+
+	namespace
+	{
+		inline float horizontalSum(__m256 v) noexcept
+		{
+			__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+			s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+			s = _mm_add_ss(s, _mm_movehdup_ps(s));
+			return _mm_cvtss_f32(s);
+		}
+
+		// Computes a tile of NA x NB dot products keeping all accumulators in registers
+		template <std::size_t NA, std::size_t NB>
+		inline void innerProductTile(const float* a, const float* b, std::size_t nb, std::size_t n, float* out) noexcept
+		{
+			__m256 acc[NA][NB];
+			for (std::size_t i = 0; i < NA; ++i)
+				for (std::size_t j = 0; j < NB; ++j)
+					acc[i][j] = _mm256_setzero_ps();
+
+			std::size_t k = 0;
+			for (; k + 8 <= n; k += 8)
+			{
+				__m256 vb[NB];
+				for (std::size_t j = 0; j < NB; ++j)
+					vb[j] = _mm256_loadu_ps(b + j * n + k);
+
+				for (std::size_t i = 0; i < NA; ++i)
+				{
+					__m256 va = _mm256_loadu_ps(a + i * n + k);
+					for (std::size_t j = 0; j < NB; ++j)
+						acc[i][j] = _mm256_fmadd_ps(va, vb[j], acc[i][j]);
+				}
+			}	// k
+
+			for (std::size_t i = 0; i < NA; ++i)
+			{
+				for (std::size_t j = 0; j < NB; ++j)
+				{
+					float sum = horizontalSum(acc[i][j]);
+					for (std::size_t l = k; l < n; ++l)
+						sum += a[i * n + l] * b[j * n + l];
+
+					out[i * nb + j] = sum;
+				}
+			}
+		}	// innerProductTile
+	}	// anonymous namespace
+
+	float squaredAvx2(const float* v1, const float* v2, std::size_t n) noexcept
+	{
+		// Two accumulators hide the latency of fused multiply-add instructions
+		__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+		std::size_t i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(v1 + i), _mm256_loadu_ps(v2 + i));
+			__m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(v1 + i + 8), _mm256_loadu_ps(v2 + i + 8));
+			acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+		}	// i
+
+		if (i + 8 <= n)
+		{
+			__m256 d = _mm256_sub_ps(_mm256_loadu_ps(v1 + i), _mm256_loadu_ps(v2 + i));
+			acc0 = _mm256_fmadd_ps(d, d, acc0);
+			i += 8;
+		}
+
+		float sum = horizontalSum(_mm256_add_ps(acc0, acc1));
+
+		for (; i < n; ++i)
+		{
+			float d = v1[i] - v2[i];
+			sum += d * d;
+		}
+
+		return sum;
+	}	// squaredAvx2
+
+	void innerProductsAvx2(const float* a, std::size_t na, const float* b, std::size_t nb, std::size_t n, float* out) noexcept
+	{
+		// 4x2 tiles use 8 of 16 YMM registers for accumulators, leaving enough of them for the loaded values
+		std::size_t i = 0;
+		for (; i + 4 <= na; i += 4)
+		{
+			std::size_t j = 0;
+			for (; j + 2 <= nb; j += 2)
+				innerProductTile<4, 2>(a + i * n, b + j * n, nb, n, out + i * nb + j);
+			for (; j < nb; ++j)
+				innerProductTile<4, 1>(a + i * n, b + j * n, nb, n, out + i * nb + j);
+		}
+
+		for (; i < na; ++i)
+		{
+			for (std::size_t j = 0; j < nb; ++j)
+				innerProductTile<1, 1>(a + i * n, b + j * n, nb, n, out + i * nb + j);
+		}
+	}	// innerProductsAvx2
+
+	float squaredQuantizedAvx2(const float* residual, const float* scale, const std::uint8_t* codes, std::size_t n) noexcept
+	{
+		__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+		std::size_t i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			// Widen 16 codes to two vectors of 8 floats
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+			__m256 c0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(c));
+			__m256 c1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(c, 8)));
+
+			__m256 d0 = _mm256_fnmadd_ps(_mm256_loadu_ps(scale + i), c0, _mm256_loadu_ps(residual + i));
+			__m256 d1 = _mm256_fnmadd_ps(_mm256_loadu_ps(scale + i + 8), c1, _mm256_loadu_ps(residual + i + 8));
+			acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+		}	// i
+
+		float sum = horizontalSum(_mm256_add_ps(acc0, acc1));
+		for (; i < n; ++i)
+		{
+			float d = residual[i] - scale[i] * codes[i];
+			sum += d * d;
+		}
+
+		return sum;
+	}	// squaredQuantizedAvx2
+
+}	// l2kernels
+
+#endif	// x86
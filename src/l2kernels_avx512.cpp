@@ -0,0 +1,137 @@
+#include "l2kernels.h"
+
+// This file must be compiled with AVX-512F enabled (see CMakeLists.txt). The kernel is only called on processors supporting it.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#include <immintrin.h>
+#include <cstdint>
+#include <cstring>
+
+
+namespace l2kernels
+{
+
+	namespace
+	{
+		inline float horizontalSum(__m512 v) noexcept
+		{
+			// _mm512_reduce_add_ps triggers spurious warnings in some GCC versions
+			alignas(64) float lanes[16];
+			_mm512_store_ps(lanes, v);
+			float sum = 0;
+			for (float lane : lanes)
+				sum += lane;
+			return sum;
+		}
+
+		inline __mmask16 tailMask(std::size_t remaining) noexcept
+		{
+			return remaining >= 16 ? __mmask16(0xFFFF) : static_cast<__mmask16>((1u << remaining) - 1);
+		}
+
+		// Computes a tile of NA x NB dot products keeping all accumulators in registers
+		template <std::size_t NA, std::size_t NB>
+		inline void innerProductTile(const float* a, const float* b, std::size_t nb, std::size_t n, float* out) noexcept
+		{
+			__m512 acc[NA][NB];
+			for (std::size_t i = 0; i < NA; ++i)
+				for (std::size_t j = 0; j < NB; ++j)
+					acc[i][j] = _mm512_setzero_ps();
+
+			for (std::size_t k = 0; k < n; k += 16)
+			{
+				__mmask16 mask = tailMask(n - k);
+				__m512 vb[NB];
+				for (std::size_t j = 0; j < NB; ++j)
+					vb[j] = _mm512_maskz_loadu_ps(mask, b + j * n + k);
+
+				for (std::size_t i = 0; i < NA; ++i)
+				{
+					__m512 va = _mm512_maskz_loadu_ps(mask, a + i * n + k);
+					for (std::size_t j = 0; j < NB; ++j)
+						acc[i][j] = _mm512_fmadd_ps(va, vb[j], acc[i][j]);
+				}
+			}	// k
+
+			for (std::size_t i = 0; i < NA; ++i)
+				for (std::size_t j = 0; j < NB; ++j)
+					out[i * nb + j] = horizontalSum(acc[i][j]);
+		}	// innerProductTile
+	}	// anonymous namespace
+
+	float squaredAvx512(const float* v1, const float* v2, std::size_t n) noexcept
+	{
+		__m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+		std::size_t i = 0;
+		for (; i + 32 <= n; i += 32)
+		{
+			__m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(v1 + i), _mm512_loadu_ps(v2 + i));
+			__m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(v1 + i + 16), _mm512_loadu_ps(v2 + i + 16));
+			acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+		}	// i
+
+		// The remaining elements are processed with masked loads, which never touch memory past the end of the vectors
+		for (; i < n; i += 16)
+		{
+			__mmask16 mask = tailMask(n - i);
+			__m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, v1 + i), _mm512_maskz_loadu_ps(mask, v2 + i));
+			acc0 = _mm512_fmadd_ps(d, d, acc0);
+		}
+
+		return horizontalSum(_mm512_add_ps(acc0, acc1));
+	}	// squaredAvx512
+
+	void innerProductsAvx512(const float* a, std::size_t na, const float* b, std::size_t nb, std::size_t n, float* out) noexcept
+	{
+		// 4x4 tiles use 16 of 32 ZMM registers for accumulators
+		std::size_t i = 0;
+		for (; i + 4 <= na; i += 4)
+		{
+			std::size_t j = 0;
+			for (; j + 4 <= nb; j += 4)
+				innerProductTile<4, 4>(a + i * n, b + j * n, nb, n, out + i * nb + j);
+			for (; j < nb; ++j)
+				innerProductTile<4, 1>(a + i * n, b + j * n, nb, n, out + i * nb + j);
+		}
+
+		for (; i < na; ++i)
+		{
+			for (std::size_t j = 0; j < nb; ++j)
+				innerProductTile<1, 1>(a + i * n, b + j * n, nb, n, out + i * nb + j);
+		}
+	}	// innerProductsAvx512
+
+	float squaredQuantizedAvx512(const float* residual, const float* scale, const std::uint8_t* codes, std::size_t n) noexcept
+	{
+		__m512 acc = _mm512_setzero_ps();
+		for (std::size_t i = 0; i < n; i += 16)
+		{
+			// Masked byte loads require AVX512BW, so the tail codes are copied to a zeroed buffer instead.
+			// Masked-out lanes produce zero differences.
+			__mmask16 mask = tailMask(n - i);
+			__m128i packed;
+			if (n - i >= 16)
+			{
+				packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+			}
+			else
+			{
+				alignas(16) std::uint8_t tail[16] = {};
+				std::memcpy(tail, codes + i, n - i);
+				packed = _mm_load_si128(reinterpret_cast<const __m128i*>(tail));
+			}
+
+			// The zero-masking forms avoid spurious uninitialized-value warnings from GCC's intrinsic headers
+			__m512 c = _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(0xFFFF, packed));
+			__m512 d = _mm512_fnmadd_ps(_mm512_maskz_loadu_ps(mask, scale + i), c, _mm512_maskz_loadu_ps(mask, residual + i));
+			acc = _mm512_fmadd_ps(d, d, acc);
+		}	// i
+
+		return horizontalSum(acc);
+	}	// squaredQuantizedAvx512
+
+}	// l2kernels
+
+#endif	// x86
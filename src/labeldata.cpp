@@ -1,9 +1,24 @@
 #include "labeldata.h"
 
-Dict generateLabelMap()
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+
+
+namespace
 {
-	// Create a map of labels and corresponding names
-	return {		
+	struct LabelName
+	{
+		std::string_view label;
+		std::string_view name;
+	};
+
+	// Labels and corresponding names
+	constexpr LabelName labelNames[] =
+	{
 		{"n00000001" , "A.J. Buckley"},
 		{"n00000002" , "A.R. Rahman"},
 		{"n00000003" , "Aamir Khan"},
@@ -2628,4 +2643,117 @@ Dict generateLabelMap()
 		{"n00002622" , "Zuleyka Silver"}
 	};
 
-}	// generateLabelMap
\ No newline at end of file
+	// FNV-1a hash of the label
+	constexpr std::uint64_t hashLabel(std::string_view label) noexcept
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for (char c : label)
+			hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+		return hash;
+	}
+
+	// The number of slots is a power of two at least twice as large as the number of labels, so probe sequences are short
+	constexpr std::size_t numBuiltinSlots = []
+		{
+			std::size_t n = 16;
+			while (n < 2 * std::size(labelNames))
+				n *= 2;
+			return n;
+		}();
+
+	static_assert(std::size(labelNames) < std::numeric_limits<std::uint16_t>::max(), "Too many labels for 16-bit slots.");
+
+	// An open-addressing hash table of label indices (incremented by one, zero marks an empty slot) built at compile time
+	constexpr std::array<std::uint16_t, numBuiltinSlots> builtinSlots = []
+		{
+			std::array<std::uint16_t, numBuiltinSlots> slots = {};
+			for (std::size_t i = 0; i < std::size(labelNames); ++i)
+			{
+				std::size_t slot = hashLabel(labelNames[i].label) & (numBuiltinSlots - 1);
+				for (; slots[slot] != 0; slot = (slot + 1) & (numBuiltinSlots - 1))
+				{
+					if (labelNames[slots[slot] - 1].label == labelNames[i].label)
+						throw std::logic_error("Duplicate label.");		// fails to compile
+				}
+
+				slots[slot] = static_cast<std::uint16_t>(i + 1);
+			}
+
+			return slots;
+		}();
+
+	std::string_view findBuiltinName(std::string_view label) noexcept
+	{
+		for (std::size_t slot = hashLabel(label) & (numBuiltinSlots - 1); builtinSlots[slot] != 0; slot = (slot + 1) & (numBuiltinSlots - 1))
+		{
+			const auto& entry = labelNames[builtinSlots[slot] - 1];
+			if (entry.label == label)
+				return entry.name;
+		}
+
+		return std::string_view();
+	}	// findBuiltinName
+}	// anonymous namespace
+
+
+LabelNames::LabelNames(const std::string& filePath)
+	: file(filePath)
+{
+	// Each line holds a label and a name separated by a tab; other lines are skipped
+	const char* end = this->file.data() + this->file.size();
+	for (const char* p = this->file.data(); p < end; )
+	{
+		const char* eol = std::find(p, end, '\n');
+		std::string_view line(p, static_cast<std::size_t>(eol - p));
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+
+		auto tab = line.find('\t');
+		if (tab != std::string_view::npos)
+			this->entries.push_back({ line.substr(0, tab), line.substr(tab + 1) });
+
+		p = eol < end ? eol + 1 : end;
+	}
+
+	std::size_t numSlots = 16;
+	while (numSlots < 2 * this->entries.size())
+		numSlots *= 2;
+
+	// If a label repeats, the first name is used
+	this->slots.assign(numSlots, 0);
+	for (std::size_t i = 0; i < this->entries.size(); ++i)
+	{
+		std::size_t slot = hashLabel(this->entries[i].label) & (numSlots - 1);
+		for (; this->slots[slot] != 0; slot = (slot + 1) & (numSlots - 1))
+		{
+			if (this->entries[this->slots[slot] - 1].label == this->entries[i].label)
+				break;
+		}
+
+		if (this->slots[slot] == 0)
+			this->slots[slot] = static_cast<std::uint32_t>(i + 1);
+	}
+}	// ctor
+
+std::string_view LabelNames::find(std::string_view label) const noexcept
+{
+	if (!this->slots.empty())
+	{
+		std::size_t mask = this->slots.size() - 1;
+		for (std::size_t slot = hashLabel(label) & mask; this->slots[slot] != 0; slot = (slot + 1) & mask)
+		{
+			const auto& entry = this->entries[this->slots[slot] - 1];
+			if (entry.label == label)
+				return entry.name;
+		}
+	}
+
+	return findBuiltinName(label);
+}	// find
+
+
+std::string getNameFromLabel(const LabelNames& labelNames, const std::string& label)
+{
+	std::string_view name = labelNames.find(label);
+	return std::string(name.empty() ? label : name);	// in case name lookup failed, simply return the label itself
+}	// getNameFromLabel
@@ -1,12 +1,51 @@
 #ifndef LABELDATA_H
 #define LABELDATA_H
 
-#include <map>
+#include "mappedfile.h"
+
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
+
+
+/*
+* LabelNames maps labels of the dataset to names of people. 
+* 
+* The names of the people in the bundled dataset are compiled into the program as a constant hash table, so no memory is allocated
+* for them, and a label is found in constant time. A larger table can be loaded from a text file at runtime without recompiling: 
+* each line of the file holds a label and a name separated by a tab. The file is memory-mapped, and the labels and names are 
+* referred to in place. Labels which are not found in the file are looked up in the built-in table.
+*/
+
+class LabelNames
+{
+public:
+
+	// Only the built-in names are used
+	LabelNames() noexcept = default;
+
+	explicit LabelNames(const std::string& filePath);
+
+	// Returns the name of the person with the specified label or an empty string if the label is unknown
+	std::string_view find(std::string_view label) const noexcept;
+
+private:
+
+	struct Entry
+	{
+		std::string_view label;
+		std::string_view name;
+	};
+
+	MappedFile file;
+	std::vector<Entry> entries;
+	std::vector<std::uint32_t> slots;	// entry indices incremented by one (zero marks an empty slot); the size is a power of two
+};	// LabelNames
+
 
-// Label -> Name Mapping file
-typedef std::map<std::string, std::string> Dict;
+// Returns the name of the person with the specified label or the label itself if the name is unknown
+std::string getNameFromLabel(const LabelNames& labelNames, const std::string& label);
 
-Dict generateLabelMap();
 
-#endif	// LABELDATA_H
\ No newline at end of file
+#endif	// LABELDATA_H
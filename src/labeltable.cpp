@@ -0,0 +1,106 @@
+#include "labeltable.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+
+
+std::string_view LabelTable::at(std::size_t i) const
+{
+	if (i >= size())
+		throw std::out_of_range("Label index out of range: " + std::to_string(i));
+
+	return (*this)[i];
+}	// at
+
+std::size_t LabelTable::find(std::string_view label) const noexcept
+{
+	if (this->slots.empty())
+		return npos;
+
+	std::uint32_t slot = this->slots[findSlot(label, std::hash<std::string_view>{}(label))];
+	return slot == emptySlot ? npos : slot - 1;
+}	// find
+
+std::pair<std::size_t, bool> LabelTable::insert(std::string_view label)
+{
+	std::size_t i = find(label);
+	if (i != npos)
+		return { i, false };
+
+	return { push_back(label), true };
+}	// insert
+
+std::size_t LabelTable::push_back(std::string_view label)
+{
+	if (size() >= std::numeric_limits<std::uint32_t>::max() - 1)
+		throw std::runtime_error("Too many labels in the database.");
+
+	// Keep the load factor at most 1/2, so probe sequences stay short
+	if (2 * (size() + 1) > this->slots.size())
+		rehash(std::max<std::size_t>(2 * this->slots.size(), 16));
+
+	std::size_t hash = std::hash<std::string_view>{}(label);
+	std::size_t slot = findSlot(label, hash);
+
+	std::size_t i = size();
+	this->chars.append(label);
+	this->offsets.push_back(this->chars.size());
+	this->hashes.push_back(hash);
+	if (this->slots[slot] == emptySlot)		// a duplicate keeps referring to the first occurrence
+		this->slots[slot] = static_cast<std::uint32_t>(i + 1);
+
+	return i;
+}	// push_back
+
+void LabelTable::reserve(std::size_t numLabels, std::size_t numChars)
+{
+	this->chars.reserve(numChars);
+	this->offsets.reserve(numLabels + 1);
+	this->hashes.reserve(numLabels);
+
+	std::size_t numSlots = 16;
+	while (numSlots < 2 * numLabels)
+		numSlots *= 2;
+	if (numSlots > this->slots.size())
+		rehash(numSlots);
+}	// reserve
+
+void LabelTable::clear()
+{
+	this->chars.clear();
+	this->offsets.assign(1, 0);
+	this->hashes.clear();
+	std::fill(this->slots.begin(), this->slots.end(), emptySlot);
+}	// clear
+
+std::size_t LabelTable::findSlot(std::string_view label, std::size_t hash) const noexcept
+{
+	// Linear probing until the label or an empty slot is found
+	std::size_t mask = this->slots.size() - 1;
+	for (std::size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+	{
+		std::uint32_t s = this->slots[slot];
+		if (s == emptySlot || (this->hashes[s - 1] == hash && (*this)[s - 1] == label))
+			return slot;
+	}
+}	// findSlot
+
+void LabelTable::rehash(std::size_t numSlots)
+{
+	std::vector<std::uint32_t> slots(numSlots, emptySlot);
+	std::size_t mask = numSlots - 1;
+	for (std::uint32_t s : this->slots)
+	{
+		if (s == emptySlot)
+			continue;
+
+		std::size_t slot = this->hashes[s - 1] & mask;
+		while (slots[slot] != emptySlot)
+			slot = (slot + 1) & mask;
+		slots[slot] = s;
+	}
+
+	this->slots = std::move(slots);
+}	// rehash
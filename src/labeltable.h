@@ -0,0 +1,72 @@
+#ifndef LABELTABLE_H
+#define LABELTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+/*
+* LabelTable is a dictionary of interned labels. The labels are concatenated in one string and addressed by their offsets, which is
+* the same layout as the label table of the binary database file. A label is looked up by means of an open-addressing hash table
+* of label indices, so enrolling a face takes constant time regardless of the number of labels.
+*/
+
+class LabelTable
+{
+public:
+
+	static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+	std::size_t size() const noexcept { return this->offsets.size() - 1; }
+
+	bool empty() const noexcept { return size() == 0; }
+
+	std::string_view operator[](std::size_t i) const noexcept
+	{
+		return std::string_view(this->chars.data() + this->offsets[i], static_cast<std::size_t>(this->offsets[i + 1] - this->offsets[i]));
+	}
+
+	// Throws std::out_of_range if the index is not valid
+	std::string_view at(std::size_t i) const;
+
+	// Returns the index of the label or npos if it is not in the table
+	std::size_t find(std::string_view label) const noexcept;
+
+	// Returns the index of the label adding it to the table if needed. The second value is true if the label has been added.
+	std::pair<std::size_t, bool> insert(std::string_view label);
+
+	// Appends the label even if it is already in the table (then find() returns the first index). It is meant for loading label
+	// tables in which the order of labels must be preserved.
+	std::size_t push_back(std::string_view label);
+
+	void reserve(std::size_t numLabels, std::size_t numChars);
+
+	void clear();
+
+	// The concatenated labels
+	const std::string& data() const noexcept { return this->chars; }
+
+	// The offsets of the labels in the concatenated string followed by its length
+	const std::vector<std::uint64_t>& offsetData() const noexcept { return this->offsets; }
+
+private:
+
+	static constexpr std::uint32_t emptySlot = 0;
+
+	std::size_t findSlot(std::string_view label, std::size_t hash) const noexcept;
+
+	void rehash(std::size_t numSlots);
+
+	std::string chars;
+	std::vector<std::uint64_t> offsets = { 0 };
+	std::vector<std::size_t> hashes;		// the hash of each label, so rehashing does not touch the strings
+	std::vector<std::uint32_t> slots;		// label indices incremented by one (zero marks an empty slot); the size is a power of two
+};	// LabelTable
+
+
+#endif	// LABELTABLE_H
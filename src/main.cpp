@@ -1,13 +1,25 @@
 #include "facedb.h"
+#include "searchbackend.h"
 #include "resnetfacedescriptorcomputer.h"
 #include "resnetfacedescriptormetric.h"
 #include "openfacedescriptorcomputer.h"
 #include "openfacedescriptormetric.h"
 #include "labeldata.h"
+#include "queryserver.h"
+#include "json.h"
+#include "metrics.h"
+#include "parallel.h"
 
 #include <iostream>
 #include <cassert>
 #include <filesystem>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <csignal>
+#include <fstream>
+#include <map>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
@@ -16,78 +28,474 @@
 
 
 
-std::string getNameFromLabel(const std::string& label)
+// Draws a box around every face with the name of the best match and the dissimilarity above it or "Unknown" if the best match is not 
+// within the tolerance. If no faces have been found, "Unknown" is drawn at the bottom of the image.
+void annotate(cv::Mat& im, const LabelNames& labelNames, const std::vector<FaceMatches>& faces, double tolerance)
 {
-	static const auto labelMap = generateLabelMap();
+	auto drawText = [&im, thickness=1, padding=4](int centerX, int bottom, const cv::String& text, cv::Scalar color, int fontFace, double fontScale)
+	{
+		int baseLine;
+		cv::Size szText = cv::getTextSize(text, fontFace, fontScale, thickness, &baseLine);
+
+		bottom -= baseLine + thickness + padding;	// adjust the bottom coordinate of the text for OpenCV
+		cv::putText(im, text, cv::Point{ centerX - szText.width / 2, bottom }, fontFace, fontScale, color, thickness, cv::LINE_AA);
+		return bottom - szText.height;	// return the top coordinate of the text
+	};
+
+	// Returns the color of the text
+	auto drawMatch = [&drawText, &labelNames, tolerance](int centerX, int bottom, const std::vector<std::pair<std::string, double>>& matches)
+	{
+		auto [label, dissimilarity] = matches.empty() ? std::make_pair(std::string(), std::numeric_limits<double>::infinity()) : matches.front();
+		if (dissimilarity <= tolerance)
+		{
+			bottom = drawText(centerX, bottom, std::to_string(dissimilarity), cv::Scalar(0, 140, 255), cv::FONT_HERSHEY_COMPLEX_SMALL, 1);
+			drawText(centerX, bottom, getNameFromLabel(labelNames, label), cv::Scalar(139, 200, 0), cv::FONT_HERSHEY_COMPLEX, 1);
+			return cv::Scalar(139, 200, 0);
+		}	// face identified
+		
+		drawText(centerX, bottom, "Unknown", cv::Scalar(0, 0, 255), cv::FONT_HERSHEY_COMPLEX, 1);
+		return cv::Scalar(0, 0, 255);
+	};
+
+	if (faces.empty())
+	{
+		drawMatch(im.cols / 2, im.rows, {});
+		return;
+	}
+
+	constexpr long textHeight = 48;		// roughly the height of the two lines of text
+	for (const auto& [box, matches] : faces)
+	{
+		// The text goes above the box unless there is no room for it
+		long bottom = box.top >= textHeight ? box.top : std::min(box.bottom + 1 + textHeight, static_cast<long>(im.rows));
+		cv::Scalar color = drawMatch(static_cast<int>(box.left + box.width() / 2), static_cast<int>(bottom), matches);
+		cv::rectangle(im, cv::Rect(static_cast<int>(box.left), static_cast<int>(box.top), static_cast<int>(box.width()), 
+			static_cast<int>(box.height())), color, 2);
+	}	// face
+}	// annotate
+
+// Formats the matches as a JSON array of objects with the label, the name, and the distance
+std::string toJson(const LabelNames& labelNames, const std::vector<std::pair<std::string, double>>& matches)
+{
+	std::string array = "[";
+	for (std::size_t i = 0; i < matches.size(); ++i)
+	{
+		array += (i > 0 ? ",{\"label\":" : "{\"label\":") + json::quote(matches[i].first)
+			+ ",\"name\":" + json::quote(getNameFromLabel(labelNames, matches[i].first))
+			+ ",\"distance\":" + json::number(matches[i].second) + "}";
+	}
+
+	return array + "]";
+}	// toJson
+
+// Formats the faces as a JSON array of objects with the bounding box ([left, top, right, bottom]), whether the face has been identified,
+// the label, the name, and the distance of the best match, and optionally the list of the best matches
+std::string toJson(const LabelNames& labelNames, const std::vector<FaceMatches>& faces, double tolerance, bool listMatches)
+{
+	std::string array = "[";
+	for (std::size_t i = 0; i < faces.size(); ++i)
+	{
+		const auto& [box, matches] = faces[i];
+		bool found = !matches.empty();
+		std::string label = found ? matches.front().first : std::string();
+		array += (i > 0 ? ",{\"box\":[" : "{\"box\":[") + std::to_string(box.left) + ',' + std::to_string(box.top) + ','
+			+ std::to_string(box.right) + ',' + std::to_string(box.bottom) + ']'
+			+ ",\"identified\":" + (found && matches.front().second <= tolerance ? "true" : "false")
+			+ ",\"label\":" + (found ? json::quote(label) : "null")
+			+ ",\"name\":" + (found ? json::quote(getNameFromLabel(labelNames, label)) : "null")
+			+ ",\"distance\":" + (found ? json::number(matches.front().second) : "null");
+		if (listMatches)
+			array += ",\"matches\":" + toJson(labelNames, matches);
+		array += '}';
+	}
+
+	return array + "]";
+}	// toJson
+
+// Encloses a CSV field in quotes if needed
+std::string toCsv(const std::string& field)
+{
+	if (field.find_first_of(",\"\r\n") == std::string::npos)
+		return field;
+
+	std::string quoted = "\"";
+	for (char c : field)
+		quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+
+	return quoted + "\"";
+}	// toCsv
+
+// Query server options
+struct ServerSettings
+{
+	std::string address;	// a port number or a Unix domain socket path; the server is not started if empty
+	std::size_t workers = 0;
+};
+
+// The default number of workers is kept for the pipeline stages where zero is specified
+template <class DescriptorComputer>
+void setPipelineWorkers(DescriptorComputer& descriptorComputer, std::size_t decoders, std::size_t extractors, std::size_t recognizers)
+{
+	auto workers = descriptorComputer.getPipelineWorkers();
+	workers.decoders = decoders > 0 ? decoders : workers.decoders;
+	workers.extractors = extractors > 0 ? extractors : workers.extractors;
+	workers.recognizers = recognizers > 0 ? recognizers : workers.recognizers;
+	descriptorComputer.setPipelineWorkers(workers);
+}	// setPipelineWorkers
+
+// The server being run, which is stopped by SIGINT and SIGTERM
+std::atomic<QueryServer*> activeServer{ nullptr };
+
+extern "C" void stopServer(int)
+{
+	if (QueryServer* server = activeServer.load())
+		server->stop();
+}	// stopServer
+
+// Parses an optional non-negative integer parameter of a query
+std::size_t getCount(const std::map<std::string, std::string>& parameters, const std::string& name, std::size_t defaultValue)
+{
+	auto it = parameters.find(name);
+	if (it == parameters.end())
+		return defaultValue;
+
+	const std::string& value = it->second;
+	if (value.empty() || value.size() > 9 || !std::all_of(value.cbegin(), value.cend(), [](unsigned char c) { return std::isdigit(c); }))
+		throw std::invalid_argument("The value of \"" + name + "\" must be a non-negative integer.");
+
+	return std::stoul(value);
+}	// getCount
+
+// Answers queries of local clients until the process is interrupted. The protocol:
+//	POST /query {"image": "<image file>", "top": <the number of matches>, "unique": <true or false>}
+//		-> {"image": "<image file>", "found": <whether a face has been found>, "identified": <whether the best match is within 
+//			the tolerance>, "matches": [{"label": "<label>", "name": "<name>", "distance": <dissimilarity>}, ...],
+//			"faces": [{"box": [<left>, <top>, <right>, <bottom>], "identified": ..., "label": ..., "name": ..., "distance": ...,
+//			"matches": [...]}, ...]}
+// The top-level fields describe the most confident detection, and the faces list every face found in the image.
+//	GET /health -> {"status": "ok"}
+//	GET /metrics -> the latencies and throughput of the pipeline stages in the Prometheus text format
+//	GET /metrics.json -> the same summarized in JSON
+// The image file is read by the server, so relative paths are resolved against its working directory.
+template <class FaceDb>
+void serveQueries(FaceDb& faceDb, const ServerSettings& serverSettings, const LabelNames& labelNames, double tolerance,
+	std::size_t top, bool uniqueLabels)
+{
+	// Queries run concurrently, and the descriptor computers can be called from multiple threads
+	auto handler = [&faceDb, &labelNames, tolerance, top, uniqueLabels](const QueryServer::Request& request) -> QueryServer::Response
+	{
+		if (request.path == "/health")
+			return { 200, "{\"status\":\"ok\"}" };
+		else if (request.path == "/metrics")
+			return { 200, Metrics::toPrometheus(), "text/plain; version=0.0.4" };
+		else if (request.path == "/metrics.json")
+			return { 200, Metrics::toJson() };
+		else if (request.path != "/query")
+			return { 404, "{\"error\":" + json::quote("Unknown path: " + request.path) + "}" };
+		else if (request.method != "POST")
+			return { 405, "{\"error\":\"Queries must be posted.\"}" };
 
+		auto parameters = json::parseObject(request.body);
+		auto image = parameters.find("image");
+		if (image == parameters.end() || image->second.empty())
+			throw std::invalid_argument("The image file is not specified.");
+		else if (!std::filesystem::is_regular_file(image->second))
+			throw std::invalid_argument("The image file does not exist: " + image->second);
+
+		std::size_t k = std::max(getCount(parameters, "top", top), std::size_t(1));
+		bool unique = parameters.count("unique") ? json::toBool(parameters["unique"]) : uniqueLabels;
+		auto faces = faceDb.findFaces(image->second, k, unique);
+		auto matches = faces.empty() ? std::vector<std::pair<std::string, double>>() : faces.front().second;
+
+		return { 200, "{\"image\":" + json::quote(image->second)
+			+ ",\"found\":" + (matches.empty() ? "false" : "true")
+			+ ",\"identified\":" + (!matches.empty() && matches.front().second <= tolerance ? "true" : "false")
+			+ ",\"matches\":" + toJson(labelNames, matches)
+			+ ",\"faces\":" + toJson(labelNames, faces, tolerance, true) + "}" };
+	};	// handler
+
+	QueryServer server(serverSettings.address, handler, serverSettings.workers);
+	activeServer = &server;
+	std::signal(SIGINT, stopServer);
+	std::signal(SIGTERM, stopServer);
+
+	std::cout << "Serving queries on " << server.address() << " with " << server.workers() << " workers" << std::endl;
 	try
 	{
-		return labelMap.at(label);
+		server.run();
 	}
-	catch (const std::out_of_range&)
+	catch (...)
 	{
-		return label;	// in case name lookup failed, simply return the label itself
+		activeServer = nullptr;
+		throw;
 	}
-}	// getNameFromLabel
+
+	activeServer = nullptr;
+	std::cout << "The server has been stopped." << std::endl;
+}	// serveQueries
+
+// Batch query options
+struct BatchSettings
+{
+	std::string queries;	// a file listing images (one per line) or a directory of images; batch mode is off if empty
+	std::string format = "jsonl";	// jsonl or csv
+	std::string annotate;	// if not empty, the directory annotated images are written to
+};
+
+// Identifies the people in a batch of images and streams the results to the standard output as JSON Lines or CSV. Descriptors are 
+// computed in blocks by the pipeline of the descriptor computer, and the results of each block are written as soon as it is done.
+template <class FaceDb>
+void queryBatch(FaceDb& faceDb, const BatchSettings& batchSettings, const LabelNames& labelNames, double tolerance,
+	std::size_t top, bool uniqueLabels)
+{
+	// The images of a directory are listed recursively, and their annotated copies keep the relative paths. The annotated copies
+	// of the images in a list file are named after the images.
+	std::vector<std::filesystem::path> files, outputFiles;
+	if (std::filesystem::is_directory(batchSettings.queries))
+	{
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(batchSettings.queries))
+		{
+			if (entry.is_regular_file())
+				files.push_back(entry.path());
+		}
+
+		std::sort(files.begin(), files.end());
+		for (const auto& file : files)
+			outputFiles.push_back(file.lexically_relative(batchSettings.queries));
+	}	// directory
+	else
+	{
+		std::ifstream list(batchSettings.queries);
+		if (!list)
+			throw std::runtime_error("Failed to open the list of queries: " + batchSettings.queries);
+
+		for (std::string line; std::getline(list, line); )
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			if (!line.empty())
+			{
+				files.emplace_back(line);
+				outputFiles.push_back(files.back().filename());
+			}
+		}	// for
+	}	// list file
+
+	bool csv = batchSettings.format == "csv";
+	if (csv)
+		std::cout << "file,found,identified,label,name,distance,matches,face,left,top,right,bottom\n";
+
+	// The fields of a record without faces
+	const std::vector<std::pair<std::string, double>> noMatches;
+
+	faceDb.findFacesBatch(files, std::max(top, std::size_t(1)), uniqueLabels, 
+		[&](std::size_t head, const std::vector<std::vector<FaceMatches>>& blockResults)
+		{
+			for (std::size_t i = 0; i < blockResults.size(); ++i)
+			{
+				const auto& faces = blockResults[i];
+				std::string file = files[head + i].string();
+				if (csv)
+				{
+					// Every face makes a row; an image without faces makes a single row with empty face fields
+					for (std::size_t j = 0; j < std::max(faces.size(), std::size_t(1)); ++j)
+					{
+						const auto& matches = j < faces.size() ? faces[j].second : noMatches;
+						bool found = !matches.empty(), identified = found && matches.front().second <= tolerance;
+						std::string label = found ? matches.front().first : std::string();
+
+						std::string topMatches;
+						for (std::size_t m = 0; top > 0 && m < matches.size(); ++m)
+							topMatches += (m > 0 ? ";" : "") + matches[m].first + ':' + json::number(matches[m].second);
+
+						std::cout << toCsv(file) << ',' << (found ? "true" : "false") << ',' << (identified ? "true" : "false") << ',' << toCsv(label) << ',' 
+							<< toCsv(found ? getNameFromLabel(labelNames, label) : std::string()) << ','
+							<< (found ? json::number(matches.front().second) : std::string()) << ',' << toCsv(topMatches);
+						if (j < faces.size())
+						{
+							const FaceBox& box = faces[j].first;
+							std::cout << ',' << j << ',' << box.left << ',' << box.top << ',' << box.right << ',' << box.bottom << '\n';
+						}
+						else std::cout << ",,,,,\n";
+					}	// j
+				}
+				else
+				{
+					// The top-level fields describe the most confident detection, so records of single-face images read as before
+					const auto& matches = faces.empty() ? noMatches : faces.front().second;
+					bool found = !matches.empty(), identified = found && matches.front().second <= tolerance;
+					std::string label = found ? matches.front().first : std::string();
+
+					std::cout << "{\"file\":" << json::quote(file) << ",\"found\":" << (found ? "true" : "false")
+						<< ",\"identified\":" << (identified ? "true" : "false")
+						<< ",\"label\":" << (found ? json::quote(label) : "null")
+						<< ",\"name\":" << (found ? json::quote(getNameFromLabel(labelNames, label)) : "null")
+						<< ",\"distance\":" << (found ? json::number(matches.front().second) : "null");
+					if (top > 0)
+						std::cout << ",\"matches\":" << toJson(labelNames, matches);
+					std::cout << ",\"faces\":" << toJson(labelNames, faces, tolerance, top > 0) << "}\n";
+				}
+			}	// i
+
+			std::cout.flush();
+
+			if (!batchSettings.annotate.empty())
+			{
+				parallel::forEach(blockResults.cbegin(), blockResults.cend(), [&](const auto& faces)
+					{
+						std::size_t i = head + static_cast<std::size_t>(&faces - blockResults.data());
+						auto outputFile = std::filesystem::path(batchSettings.annotate) / outputFiles[i];
+						try
+						{
+							cv::Mat im = cv::imread(files[i].string(), cv::IMREAD_COLOR);
+							if (im.empty())
+								return;		// not an image
+
+							annotate(im, labelNames, faces, tolerance);
+							std::filesystem::create_directories(outputFile.parent_path());
+							cv::imwrite(outputFile.string(), im);
+						}
+						catch (const std::exception& e)		// a broken image must not stop the others
+						{
+							std::cerr << "Failed to write " + outputFile.string() + ": " + e.what() + '\n';
+						}
+					});
+			}	// annotate
+		});
+}	// queryBatch
 
 template <class DescriptorComputer>
-void execute(DescriptorComputer&& descriptorComputer, const std::string& database, const std::string& cache, const std::string& query, double tolerance)
+void execute(DescriptorComputer&& descriptorComputer, const std::string& database, const std::string& cache, const std::string& update, 
+	const std::string& query, const LabelNames& labelNames, double tolerance,
+	std::size_t top, bool uniqueLabels, bool resume, const SearchSettings& searchSettings, const ServerSettings& serverSettings,
+	const BatchSettings& batchSettings)
 {
+	// In batch mode the standard output is reserved for the results, so the messages about loading the database go to stderr as well
+	bool batchMode = serverSettings.address.empty() && !batchSettings.queries.empty();
+	std::ostream& messages = batchMode ? std::cerr : std::cout;
+
 	FaceDb<DescriptorComputer> faceDb{ std::forward<DescriptorComputer>(descriptorComputer) };	
-	faceDb.setReporter([](const std::string& message) { std::cout << message << std::endl; });	
+	faceDb.setReporter([&messages](const std::string& message) { messages << message << std::endl; });	
+
+	// The search index is built or loaded along with the database
+	faceDb.setSearchIndex(makeSearchIndex(searchSettings));
+	faceDb.setRerankSize(searchSettings.rerankSize);
 	
 	if (std::filesystem::is_directory(database))	// dataset directory specified
 	{
-		faceDb.create(database);
-		
-		if (!cache.empty())			// if the database cache file is specified, save descriptors there,
-			faceDb.save(cache);		// so we don't have to recreate it every time
+		// If the database cache file is specified, descriptors are saved there as they are computed, 
+		// so we don't have to recreate the database every time
+		faceDb.create(database, cache, resume);
 	}
 	else	// load the database from the existing file
 	{
 		faceDb.load(database);
+
+		// Only the descriptors of the files changed since the database was saved are recomputed
+		if (!update.empty())
+		{
+			faceDb.update(update);
+			faceDb.save(cache.empty() ? database : cache);
+		}
+	}
+
+	// Every sample is searched exhaustively as well, so the estimate is only computed on request
+	if (searchSettings.estimateRecall)
+	{
+		constexpr std::size_t recallK = 10;
+		messages << "Estimated recall@" << recallK << " of the approximate search: " << faceDb.estimateRecall(recallK) << std::endl;
 	}
 	
-	if (!query.empty())		// if query is specified, try to find this person in the database
+	if (!serverSettings.address.empty())	// answer queries of clients instead of a single one
+	{
+		// Messages about every query would interleave
+		faceDb.setReporter([](const std::string&) {});
+		serveQueries(faceDb, serverSettings, labelNames, tolerance, top, uniqueLabels);
+	}
+	else if (batchMode)	// identify people in many images without GUI
+	{
+		queryBatch(faceDb, batchSettings, labelNames, tolerance, top, uniqueLabels);
+	}
+	else if (!query.empty())		// if query is specified, try to find this person in the database
 	{
 		cv::Mat im = cv::imread(query, cv::IMREAD_COLOR);
 
-		auto drawText = [&im, thickness=1, padding=4](int bottom, const cv::String& text, cv::Scalar color, int fontFace, double fontScale)
-		{
-			int baseLine;
-			cv::Size szText = cv::getTextSize(text, fontFace, fontScale, thickness, &baseLine);
-
-			bottom -= baseLine + thickness + padding;	// adjust the bottom coordinate of the text for OpenCV
-			cv::putText(im, text, cv::Point{ (im.cols - szText.width) / 2, bottom }, fontFace, fontScale, color, thickness, cv::LINE_AA);
-			return bottom - szText.height;	// return the top coordinate of the text
-		};
-
-		int y = im.rows;	// the bottom coordinate of the text to draw
-		auto [label, dissimilarity] = faceDb.find(query);	// find the best match
-		if (dissimilarity <= tolerance)
+		// Find the best matches for every face in a single pass over the database
+		auto faces = faceDb.findFaces(query, std::max(top, std::size_t(1)), uniqueLabels);
+		if (top > 0)
 		{
-			y = drawText(y, std::to_string(dissimilarity), cv::Scalar(0, 140, 255), cv::FONT_HERSHEY_COMPLEX_SMALL, 1);
-			drawText(y, getNameFromLabel(label), cv::Scalar(139, 200, 0), cv::FONT_HERSHEY_COMPLEX, 1);
-		}	// face identified
-		else
-		{
-			drawText(y, "Unknown", cv::Scalar(0, 0, 255), cv::FONT_HERSHEY_COMPLEX, 1);
-		}
+			for (std::size_t j = 0; j < faces.size(); ++j)
+			{
+				const auto& [box, matches] = faces[j];
+				std::cout << "Top " << top << " matches for face " << j + 1 << " at (" << box.left << ", " << box.top << ")-("
+					<< box.right << ", " << box.bottom << "):" << std::endl;
+				for (std::size_t i = 0; i < matches.size(); ++i)
+				{
+					std::cout << i + 1 << ". " << getNameFromLabel(labelNames, matches[i].first) << " (" << matches[i].first << ") "
+						<< matches[i].second << std::endl;
+				}
+			}	// j
+		}	// top > 0
 
+		annotate(im, labelNames, faces, tolerance);
 		cv::imshow("Doppelganger", im);
 		cv::waitKey();
 	}	// not an empty query
 }	// execute
 
 
+// Writes the metrics in the Prometheus text format if the file has the .prom extension, and in JSON otherwise
+void writeMetrics(const std::string& filePath)
+{
+	try
+	{
+		std::ofstream file(filePath);
+		file.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+		if (std::filesystem::path(filePath).extension() == ".prom")
+			file << Metrics::toPrometheus();
+		else
+			file << Metrics::toJson() << '\n';
+	}
+	catch (const std::ios_base::failure& e)
+	{
+		throw std::ios_base::failure("Failed to write the metrics file " + filePath, e.code());
+	}
+}	// writeMetrics
+
+
 void printUsage()
 {
 	std::cout << "Usage: doppelganger [-h]"
 		" --database=<dataset directory or cached database file>"
 		" [--cache=<cache file (output)>]"
+		" [--resume]"
+		" [--update=<dataset directory>]"
 		" [--query=<image file>]"
+		" [--queries=<image list file or directory>]"
+		" [--format=<jsonl or csv>]"
+		" [--annotate=<output directory>]"
+		" [--names=<label file>]"
+		" [--serve=<port or Unix socket path>]"
+		" [--workers=<the number of threads serving queries>]"
+		" [--metrics=<output file (.json or .prom)>]"
 		" [--tolerance=<a positive float>]"
-		" [--algorithm=<ResNet or OpenFace>]" << std::endl;
+		" [--top=<the number of best matches to list>]"
+		" [--unique]"
+		" [--search=<exhaustive, quantized, ivfpq, or hnsw>]"
+		" [--lists=<the number of inverted lists>]"
+		" [--probes=<the number of inverted lists to probe>]"
+		" [--ef=<the size of the HNSW candidate list>]"
+		" [--rerank=<the number of candidates to re-rank>]"
+		" [--recall]"
+		" [--algorithm=<ResNet or OpenFace>]"
+		" [--detection=<the largest side of the images faces are detected in>]"
+		" [--threads=<the number of threads of parallel computations>]"
+		" [--pin]"
+		" [--minibatch=<the number of faces recognized at once by each thread>]"
+		" [--decoders=<the number of images decoded at once>]"
+		" [--extractors=<the number of images searched for faces at once>]"
+		" [--recognizers=<the number of batches of faces recognized at once>]" << std::endl;
 }	// printUsage
 
 
@@ -100,9 +508,33 @@ int main(int argc, char* argv[])
 			"{help h usage ?        |       | Print the help message  }"
 			"{database              |<none> | The path to a dataset directory or a cached file of previously computed face descriptors }"
 			"{cache                 |       | If not empty, specifies the output file path where face descriptors will be saved to }"
+			"{resume                |       | Resume creating the cache file from the last checkpoint of an interrupted run }"
+			"{update                |       | If not empty, specifies the dataset directory the cached database is brought up to date with }"
 			"{query                 |       | If not empty, specifies the path to an image of a person that needs to be recognized }"
+			"{queries               |       | If not empty, specifies a file listing images (one per line) or a directory of images to identify people in without GUI }"
+			"{format                |jsonl  | The format of the results of batch queries written to the standard output (jsonl or csv) }"
+			"{annotate              |       | If not empty, specifies the directory the images of batch queries are written to with the results drawn on them }"
+			"{names                 |       | If not empty, specifies a file of labels and names separated by tabs, which are used along with the built-in names }"
+			"{serve                 |       | If not empty, specifies a localhost port or a Unix domain socket path to answer queries on instead of the single query }"
+			"{workers               |0      | The number of threads serving queries (chosen automatically if zero) }"
+			"{metrics               |       | If not empty, specifies the file where the latencies and throughput of the pipeline stages are written to at exit (Prometheus text format if its extension is .prom, JSON otherwise) }"
 			"{tolerance             |0.7    | Defines the largest allowed difference between two faces considered the same (float) }"
-			"{algorithm             |ResNet | Specifies face recognition algorithm to use (ResNet or OpenFace) }";
+			"{top                   |0      | If positive, specifies the number of best matches to list }"
+			"{unique                |       | List at most one match for each label }"
+			"{search                |exhaustive | The search backend: exhaustive, quantized (8-bit descriptors), ivfpq (inverted-file index with product quantization), or hnsw (navigable small world graph) }"
+			"{lists                 |0      | The number of inverted lists in the IVF-PQ index (chosen automatically if zero) }"
+			"{probes                |8      | The number of inverted lists probed for each query }"
+			"{ef                    |64     | The size of the candidate list of the HNSW search }"
+			"{rerank                |100    | The number of candidates found by an approximate search which are re-ranked by exact distances }"
+			"{recall                |       | Estimate the recall of the approximate search once the database is ready (takes a while in large databases) }"
+			"{algorithm             |ResNet | Specifies face recognition algorithm to use (ResNet or OpenFace) }"
+			"{detection             |0      | The largest side of the images faces are detected in; larger images are downscaled for detection (full resolution if zero) }"
+			"{threads               |0      | The number of threads running parallel computations (the number of hardware threads if zero) }"
+			"{pin                   |       | Bind the threads running parallel computations to their own cores }"
+			"{minibatch             |1      | The number of faces passed through the ResNet network at once by each thread (parallel builds only) }"
+			"{decoders              |0      | The number of images decoded at once while computing descriptors (chosen automatically if zero) }"
+			"{extractors            |0      | The number of images faces are detected and aligned in at once (chosen automatically if zero) }"
+			"{recognizers           |0      | The number of batches of faces descriptors are computed for at once (chosen automatically if zero) }";
 			
 		cv::CommandLineParser parser(argc, argv, keys);
 		parser.about("Doppelganger\n(c) Yaroslav Pugach");
@@ -115,9 +547,33 @@ int main(int argc, char* argv[])
 
 		std::string db = parser.get<std::string>("database");
 		std::string cache = parser.get<std::string>("cache");
+		std::string update = parser.get<std::string>("update");
 		std::string query = parser.get<std::string>("query");
+		std::string queries = parser.get<std::string>("queries");
+		std::string format = parser.get<std::string>("format");
+		std::string annotateDir = parser.get<std::string>("annotate");
+		std::string names = parser.get<std::string>("names");
+		std::string serve = parser.get<std::string>("serve");
+		int workers = parser.get<int>("workers");
+		std::string metrics = parser.get<std::string>("metrics");
 		std::string algorithm = parser.get<std::string>("algorithm");
 		double tolerance = parser.get<double>("tolerance");
+		int top = parser.get<int>("top");
+		int detectionSide = parser.get<int>("detection");
+		int threads = parser.get<int>("threads");
+		bool pinThreads = parser.has("pin");
+		int miniBatchSize = parser.get<int>("minibatch");
+		int decoders = parser.get<int>("decoders");
+		int extractors = parser.get<int>("extractors");
+		int recognizers = parser.get<int>("recognizers");
+		bool uniqueLabels = parser.has("unique");
+		bool resume = parser.has("resume");
+		std::string backend = parser.get<std::string>("search");
+		int numLists = parser.get<int>("lists");
+		int numProbes = parser.get<int>("probes");
+		int efSearch = parser.get<int>("ef");
+		int rerankSize = parser.get<int>("rerank");
+		bool estimateRecall = parser.has("recall");
 
 		if (!parser.check())
 		{
@@ -126,13 +582,51 @@ int main(int argc, char* argv[])
 			return -1;
 		}
 
+		if (top < 0)
+			throw std::invalid_argument("The number of best matches cannot be negative.");
+
+		if (miniBatchSize <= 0)
+			throw std::invalid_argument("The mini-batch size must be positive.");
+
+		if (detectionSide < 0)
+			throw std::invalid_argument("The detection resolution cannot be negative.");
+
+		if (decoders < 0 || extractors < 0 || recognizers < 0 || workers < 0 || threads < 0)
+			throw std::invalid_argument("The number of worker threads cannot be negative.");
+
+		if (numLists < 0 || numProbes <= 0 || efSearch <= 0 || rerankSize < 0)
+			throw std::invalid_argument("The number of inverted lists and candidates cannot be negative, and the number of probes and "
+				"the size of the HNSW candidate list must be positive.");
+
+		// The pool must be set up before the descriptor computers, which choose the numbers of their threads by its size
+		ThreadPool::configure({ static_cast<std::size_t>(threads), pinThreads });
+
+		std::transform(backend.cbegin(), backend.cend(), backend.begin(), static_cast<int (*)(int)>(&std::tolower));
+		SearchSettings searchSettings{ backend, static_cast<std::size_t>(numLists), static_cast<std::size_t>(numProbes),
+			static_cast<std::size_t>(efSearch), static_cast<std::size_t>(rerankSize), false, estimateRecall };
+		makeSearchIndex(searchSettings);	// fail early if the backend is not supported
+
+		ServerSettings serverSettings{ serve, static_cast<std::size_t>(workers) };
+
+		std::transform(format.cbegin(), format.cend(), format.begin(), static_cast<int (*)(int)>(&std::tolower));
+		if (format != "jsonl" && format != "csv")
+			throw std::invalid_argument("Unsupported output format: " + format);
+
+		BatchSettings batchSettings{ queries, format, annotateDir };
+
+		// The label file is memory-mapped, and the names are looked up in place
+		LabelNames labelNames = names.empty() ? LabelNames() : LabelNames(names);
+
 		
 		std::transform(algorithm.cbegin(), algorithm.cend(), algorithm.begin(), static_cast<int (*)(int)>(&std::tolower));
 		if (algorithm == "resnet")
 		{			
 			ResNetFaceDescriptorComputer descriptorComputer{ "./models/shape_predictor_5_face_landmarks.dat"
                                                             , "./models/dlib_face_recognition_resnet_model_v1.dat" };
-			execute(std::move(descriptorComputer), db, cache, query, tolerance);
+			descriptorComputer.setMiniBatchSize(static_cast<std::size_t>(miniBatchSize));
+			descriptorComputer.setMaxDetectionSide(static_cast<std::size_t>(detectionSide));
+			setPipelineWorkers(descriptorComputer, decoders, extractors, recognizers);
+			execute(std::move(descriptorComputer), db, cache, update, query, labelNames, tolerance, static_cast<std::size_t>(top), uniqueLabels, resume, searchSettings, serverSettings, batchSettings);
 		}
 		else if (algorithm == "openface")
 		{
@@ -140,9 +634,14 @@ int main(int argc, char* argv[])
 			// https://cmusatyalab.github.io/openface/visualizations/#2-preprocess-the-raw-images
 			OpenFaceDescriptorComputer<OpenFaceAlignment::OuterEyesAndNose> descriptorComputer{ "./models/shape_predictor_68_face_landmarks.dat"
                                                                                             ,  "./models/nn4.v2.t7" };
-			execute(std::move(descriptorComputer), db, cache, query, tolerance);
+			descriptorComputer.setMaxDetectionSide(static_cast<std::size_t>(detectionSide));
+			setPipelineWorkers(descriptorComputer, decoders, extractors, recognizers);
+			execute(std::move(descriptorComputer), db, cache, update, query, labelNames, tolerance, static_cast<std::size_t>(top), uniqueLabels, resume, searchSettings, serverSettings, batchSettings);
 		}
 		else throw std::invalid_argument("Unsupported algorithm: " + algorithm);
+
+		if (!metrics.empty())
+			writeMetrics(metrics);
 	}	// try
 	catch (const dlib::cuda_error& e)
 	{
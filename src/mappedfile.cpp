@@ -0,0 +1,142 @@
+#include "mappedfile.h"
+
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif	// !_WIN32
+
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filePath)
+{
+	HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "Failed to open " + filePath);
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		auto error = static_cast<int>(GetLastError());
+		CloseHandle(file);
+		throw std::system_error(error, std::system_category(), "Failed to obtain the size of " + filePath);
+	}
+
+	this->fileHandle = file;
+	this->length = static_cast<std::size_t>(fileSize.QuadPart);
+	if (this->length == 0)		// empty files cannot be mapped
+		return;
+
+	this->mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!this->mappingHandle || !(this->address = static_cast<const char*>(MapViewOfFile(this->mappingHandle, FILE_MAP_READ, 0, 0, 0))))
+	{
+		auto error = static_cast<int>(GetLastError());
+		unmap();
+		throw std::system_error(error, std::system_category(), "Failed to map " + filePath);
+	}
+}	// ctor
+
+void MappedFile::unmap() noexcept
+{
+	if (this->address)
+		UnmapViewOfFile(this->address);
+	if (this->mappingHandle)
+		CloseHandle(this->mappingHandle);
+	if (this->fileHandle)
+		CloseHandle(this->fileHandle);
+
+	this->address = nullptr;
+	this->mappingHandle = this->fileHandle = nullptr;
+	this->length = 0;
+}	// unmap
+
+#else
+
+MappedFile::MappedFile(const std::string& filePath)
+{
+	int fd = ::open(filePath.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::system_error(errno, std::generic_category(), "Failed to open " + filePath);
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0)
+	{
+		int error = errno;
+		::close(fd);
+		throw std::system_error(error, std::generic_category(), "Failed to obtain the size of " + filePath);
+	}
+
+	this->length = static_cast<std::size_t>(st.st_size);
+	if (this->length > 0)	// empty files cannot be mapped
+	{
+		void* p = ::mmap(nullptr, this->length, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			int error = errno;
+			::close(fd);
+			this->length = 0;
+			throw std::system_error(error, std::generic_category(), "Failed to map " + filePath);
+		}
+
+		// The whole file is going to be scanned, so ask the kernel to start reading it ahead
+		::madvise(p, this->length, MADV_WILLNEED);
+		this->address = static_cast<const char*>(p);
+	}
+
+	::close(fd);	// the mapping remains valid after the file descriptor is closed
+}	// ctor
+
+void MappedFile::unmap() noexcept
+{
+	if (this->address)
+		::munmap(const_cast<char*>(this->address), this->length);
+
+	this->address = nullptr;
+	this->length = 0;
+}	// unmap
+
+#endif	// !_WIN32
+
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+	: address(std::exchange(other.address, nullptr))
+	, length(std::exchange(other.length, 0))
+#ifdef _WIN32
+	, fileHandle(std::exchange(other.fileHandle, nullptr))
+	, mappingHandle(std::exchange(other.mappingHandle, nullptr))
+#endif	// _WIN32
+{
+}
+
+MappedFile& MappedFile::operator = (MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		unmap();
+		this->address = std::exchange(other.address, nullptr);
+		this->length = std::exchange(other.length, 0);
+#ifdef _WIN32
+		this->fileHandle = std::exchange(other.fileHandle, nullptr);
+		this->mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif	// _WIN32
+	}
+
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
@@ -0,0 +1,51 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+
+/*
+* MappedFile maps a whole file into memory for reading. The contents are paged in on demand by the operating system, 
+* so opening even a very large file is fast, and no memory is allocated for reading it.
+* 
+* The mapping is read-only. It is released when the object is destroyed.
+*/
+
+class MappedFile
+{
+public:
+
+	MappedFile() noexcept = default;
+
+	explicit MappedFile(const std::string& filePath);
+
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+
+	MappedFile& operator = (const MappedFile& other) = delete;
+	MappedFile& operator = (MappedFile&& other) noexcept;
+
+	~MappedFile();
+
+	const char* data() const noexcept { return this->address; }
+
+	std::size_t size() const noexcept { return this->length; }
+
+	bool empty() const noexcept { return this->length == 0; }
+
+private:
+
+	void unmap() noexcept;
+
+	const char* address = nullptr;
+	std::size_t length = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif	// _WIN32
+};	// MappedFile
+
+
+#endif	// MAPPEDFILE_H
@@ -0,0 +1,252 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+
+
+namespace
+{
+	// The counters of a stage are only written by the thread owning them, so they are updated by plain loads and stores.
+	// Atomics merely let other threads read them while they change.
+	struct StageCounters
+	{
+		std::atomic<std::uint64_t> count{ 0 }, items{ 0 }, totalNanoseconds{ 0 };
+		std::array<std::atomic<std::uint64_t>, Metrics::numBuckets> buckets = {};
+	};	// StageCounters
+
+	using ThreadCounters = std::array<StageCounters, Metrics::numStages>;
+
+	void add(std::atomic<std::uint64_t>& counter, std::uint64_t value) noexcept
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	void addTo(Metrics::Summary& summary, const StageCounters& counters) noexcept
+	{
+		summary.count += counters.count.load(std::memory_order_relaxed);
+		summary.items += counters.items.load(std::memory_order_relaxed);
+		summary.totalNanoseconds += counters.totalNanoseconds.load(std::memory_order_relaxed);
+		for (std::size_t i = 0; i < Metrics::numBuckets; ++i)
+			summary.buckets[i] += counters.buckets[i].load(std::memory_order_relaxed);
+	}
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<const ThreadCounters*> threads;
+		std::array<Metrics::Summary, Metrics::numStages> retired;	// the totals of the threads which have exited
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	};	// Registry
+
+	// The registry is never destroyed, since threads may exit after static objects have been destroyed
+	Registry& registry()
+	{
+		static Registry* registry = new Registry();
+		return *registry;
+	}
+
+	// Registers the counters of the thread on first use and merges them into the totals when the thread exits
+	class ThreadCountersHolder
+	{
+	public:
+		ThreadCountersHolder()
+		{
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			r.threads.push_back(&this->counters);
+		}
+
+		ThreadCountersHolder(const ThreadCountersHolder& other) = delete;
+		ThreadCountersHolder& operator = (const ThreadCountersHolder& other) = delete;
+
+		~ThreadCountersHolder()
+		{
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			for (std::size_t stage = 0; stage < Metrics::numStages; ++stage)
+				addTo(r.retired[stage], this->counters[stage]);
+
+			r.threads.erase(std::find(r.threads.begin(), r.threads.end(), &this->counters));
+		}
+
+		ThreadCounters& get() noexcept { return this->counters; }
+
+	private:
+		ThreadCounters counters;
+	};	// ThreadCountersHolder
+
+	std::size_t bucketOf(std::uint64_t nanoseconds) noexcept
+	{
+		// The smallest i such that the latency does not exceed 2^i microseconds
+		std::uint64_t microseconds = (nanoseconds + 999) / 1000;
+		std::size_t i = 0;
+		while (i + 1 < Metrics::numBuckets && (std::uint64_t(1) << i) < microseconds)
+			++i;
+		return i;
+	}
+
+	double bucketBound(std::size_t i) noexcept
+	{
+		return std::ldexp(1e-6, static_cast<int>(i));	// in seconds
+	}
+
+	// Estimates the percentile by linear interpolation within the bucket it falls into
+	double percentile(const Metrics::Summary& summary, double p) noexcept
+	{
+		if (summary.count == 0)
+			return 0;
+
+		double rank = p * static_cast<double>(summary.count);
+		std::uint64_t seen = 0;
+		for (std::size_t i = 0; i < Metrics::numBuckets; ++i)
+		{
+			if (summary.buckets[i] == 0 || static_cast<double>(seen + summary.buckets[i]) < rank)
+			{
+				seen += summary.buckets[i];
+				continue;
+			}
+
+			double lower = i > 0 ? bucketBound(i - 1) : 0, upper = bucketBound(i);
+			if (i + 1 == Metrics::numBuckets)
+				return lower;		// unbounded
+
+			return lower + (upper - lower) * (rank - static_cast<double>(seen)) / static_cast<double>(summary.buckets[i]);
+		}
+
+		return bucketBound(Metrics::numBuckets - 2);
+	}
+
+	std::string formatNumber(double value)
+	{
+		std::ostringstream stream;
+		stream.imbue(std::locale::classic());
+		stream << std::setprecision(6) << value;
+		return stream.str();
+	}
+}	// anonymous namespace
+
+
+const char* Metrics::stageName(Stage stage) noexcept
+{
+	switch (stage)
+	{
+	case Stage::Decode: return "decode";
+	case Stage::Detection: return "detection";
+	case Stage::Landmarks: return "landmarks";
+	case Stage::Alignment: return "alignment";
+	case Stage::Inference: return "inference";
+	case Stage::Search: return "search";
+	case Stage::DatabaseIo: return "database_io";
+	default: return "unknown";
+	}
+}	// stageName
+
+void Metrics::record(Stage stage, std::chrono::steady_clock::duration elapsed, std::uint64_t items) noexcept
+{
+	thread_local ThreadCountersHolder holder;
+
+	auto nanoseconds = static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), 0));
+	StageCounters& counters = holder.get()[static_cast<std::size_t>(stage)];
+	add(counters.count, 1);
+	add(counters.items, items);
+	add(counters.totalNanoseconds, nanoseconds);
+	add(counters.buckets[bucketOf(nanoseconds)], 1);
+}	// record
+
+std::array<Metrics::Summary, Metrics::numStages> Metrics::summarize()
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	std::array<Summary, numStages> summaries = r.retired;
+	for (const ThreadCounters* counters : r.threads)
+	{
+		for (std::size_t stage = 0; stage < numStages; ++stage)
+			addTo(summaries[stage], (*counters)[stage]);
+	}
+
+	return summaries;
+}	// summarize
+
+double Metrics::uptime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - registry().start).count();
+}	// uptime
+
+std::string Metrics::toJson()
+{
+	auto summaries = summarize();
+
+	std::string json = "{\"uptime_seconds\":" + formatNumber(uptime()) + ",\"stages\":{";
+	for (std::size_t stage = 0; stage < numStages; ++stage)
+	{
+		const Summary& summary = summaries[stage];
+		double totalSeconds = static_cast<double>(summary.totalNanoseconds) * 1e-9;
+		double meanSeconds = summary.count > 0 ? totalSeconds / static_cast<double>(summary.count) : 0;
+
+		// The throughput of a single thread running the stage, i.e. without regard to concurrency
+		double itemsPerSecond = totalSeconds > 0 ? static_cast<double>(summary.items) / totalSeconds : 0;
+
+		json += (stage > 0 ? ",\"" : "\"") + std::string(stageName(static_cast<Stage>(stage))) + "\":{"
+			+ "\"count\":" + std::to_string(summary.count)
+			+ ",\"items\":" + std::to_string(summary.items)
+			+ ",\"total_seconds\":" + formatNumber(totalSeconds)
+			+ ",\"mean_ms\":" + formatNumber(meanSeconds * 1e3)
+			+ ",\"p50_ms\":" + formatNumber(percentile(summary, 0.5) * 1e3)
+			+ ",\"p90_ms\":" + formatNumber(percentile(summary, 0.9) * 1e3)
+			+ ",\"p99_ms\":" + formatNumber(percentile(summary, 0.99) * 1e3)
+			+ ",\"items_per_second\":" + formatNumber(itemsPerSecond) + "}";
+	}
+
+	return json + "}}";
+}	// toJson
+
+std::string Metrics::toPrometheus()
+{
+	auto summaries = summarize();
+
+	std::string text =
+		"# HELP doppelganger_stage_duration_seconds The time spent in a stage of face recognition or a database operation.\n"
+		"# TYPE doppelganger_stage_duration_seconds histogram\n";
+	for (std::size_t stage = 0; stage < numStages; ++stage)
+	{
+		const Summary& summary = summaries[stage];
+		std::string label = std::string("stage=\"") + stageName(static_cast<Stage>(stage)) + '"';
+
+		std::uint64_t cumulative = 0;
+		for (std::size_t i = 0; i + 1 < numBuckets; ++i)
+		{
+			cumulative += summary.buckets[i];
+			text += "doppelganger_stage_duration_seconds_bucket{" + label + ",le=\"" + formatNumber(bucketBound(i)) + "\"} "
+				+ std::to_string(cumulative) + '\n';
+		}
+
+		text += "doppelganger_stage_duration_seconds_bucket{" + label + ",le=\"+Inf\"} " + std::to_string(summary.count) + '\n'
+			+ "doppelganger_stage_duration_seconds_sum{" + label + "} "
+			+ formatNumber(static_cast<double>(summary.totalNanoseconds) * 1e-9) + '\n'
+			+ "doppelganger_stage_duration_seconds_count{" + label + "} " + std::to_string(summary.count) + '\n';
+	}	// stage
+
+	text +=
+		"# HELP doppelganger_stage_items_total The number of images, faces, queries, or descriptors processed by a stage.\n"
+		"# TYPE doppelganger_stage_items_total counter\n";
+	for (std::size_t stage = 0; stage < numStages; ++stage)
+	{
+		text += std::string("doppelganger_stage_items_total{stage=\"") + stageName(static_cast<Stage>(stage)) + "\"} "
+			+ std::to_string(summaries[stage].items) + '\n';
+	}
+
+	text +=
+		"# HELP doppelganger_uptime_seconds The time since the collection of metrics started.\n"
+		"# TYPE doppelganger_uptime_seconds gauge\n"
+		"doppelganger_uptime_seconds " + formatNumber(uptime()) + '\n';
+
+	return text;
+}	// toPrometheus
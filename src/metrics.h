@@ -0,0 +1,90 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+/*
+* Metrics collects latency histograms of the stages of face recognition and database operations, so it can be seen where the time
+* goes. A measurement is the duration of one execution of a stage and the number of items it has processed (images, faces,
+* queries, or descriptors), hence batched stages report their throughput as well.
+*
+* Every thread records measurements into its own block of counters, which takes a few uncontended memory operations and no locks.
+* The blocks are summed up when a summary is requested; the blocks of threads which have exited are merged into common totals.
+* Latencies are counted in buckets whose upper bounds are powers of two microseconds, so percentiles are estimates.
+*/
+
+class Metrics
+{
+public:
+
+	enum class Stage : std::size_t
+	{
+		Decode,		// loading and decoding an image file
+		Detection,	// detecting faces in an image
+		Landmarks,	// predicting facial landmarks
+		Alignment,	// cropping and aligning a face
+		Inference,	// computing descriptors by a neural network
+		Search,		// finding the best matches in the database
+		DatabaseIo,	// reading and writing database files
+		Count
+	};	// Stage
+
+	static constexpr std::size_t numStages = static_cast<std::size_t>(Stage::Count);
+
+	// Bucket i counts latencies up to 2^i microseconds, the last one counts the rest
+	static constexpr std::size_t numBuckets = 32;
+
+	struct Summary
+	{
+		std::uint64_t count = 0;		// the number of measurements
+		std::uint64_t items = 0;		// the number of processed items
+		std::uint64_t totalNanoseconds = 0;
+		std::array<std::uint64_t, numBuckets> buckets = {};
+	};	// Summary
+
+	// Measures the time from construction to destruction
+	class Timer
+	{
+	public:
+		explicit Timer(Stage stage, std::uint64_t items = 1) noexcept
+			: stage(stage)
+			, items(items)
+			, start(std::chrono::steady_clock::now()) {}
+
+		Timer(const Timer& other) = delete;
+		Timer& operator = (const Timer& other) = delete;
+
+		~Timer() { Metrics::record(this->stage, std::chrono::steady_clock::now() - this->start, this->items); }
+
+		// Sets the number of items processed, which may not be known in advance
+		void setItems(std::uint64_t items) noexcept { this->items = items; }
+
+	private:
+		Stage stage;
+		std::uint64_t items;
+		std::chrono::steady_clock::time_point start;
+	};	// Timer
+
+	static const char* stageName(Stage stage) noexcept;
+
+	static void record(Stage stage, std::chrono::steady_clock::duration elapsed, std::uint64_t items = 1) noexcept;
+
+	static std::array<Summary, numStages> summarize();
+
+	// The number of seconds since the first measurement or summary
+	static double uptime();
+
+	// Returns the summary as a JSON object with the counts, total and mean times, throughput, and percentiles of each stage
+	static std::string toJson();
+
+	// Returns the histograms in the Prometheus text exposition format
+	static std::string toPrometheus();
+};	// Metrics
+
+
+#endif	// METRICS_H
@@ -0,0 +1,109 @@
+#ifndef NEARESTNEIGHBORS_H
+#define NEARESTNEIGHBORS_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+
+/*
+* NearestNeighbors keeps track of the k closest items seen so far by means of a bounded max-heap. Each item is identified by
+* an id (e.g. a label index) and may belong to a group (e.g. a label of a descriptor identified by its index). If ids (groups) 
+* are required to be unique, only the closest item is kept for every group, which allows to obtain the k best matching labels 
+* in a single pass. By default the group of an item is its id.
+* 
+* Partial results computed by different threads can be combined by merging them.
+*/
+
+class NearestNeighbors
+{
+public:
+
+	using Neighbor = std::pair<std::size_t, double>;	// id and distance
+
+	NearestNeighbors(std::size_t k, bool uniqueIds = false)
+		: k(k > 0 ? k : throw std::invalid_argument("The number of nearest neighbors must be positive."))
+		, uniqueIds(uniqueIds) 
+	{
+		this->heap.reserve(k);
+	}
+
+	std::size_t size() const noexcept { return this->heap.size(); }
+
+	// Items which are not closer than the bound won't be accepted
+	double bound() const noexcept 
+	{ 
+		return this->heap.size() < this->k ? std::numeric_limits<double>::infinity() : this->heap.front().distance;
+	}
+
+	void push(std::size_t id, double distance) { push(id, distance, id); }
+
+	void push(std::size_t id, double distance, std::size_t group)
+	{
+		if (!(distance < bound()))
+			return;
+
+		if (this->uniqueIds)
+		{
+			auto it = std::find_if(this->heap.begin(), this->heap.end(), [group](const Item& item) { return item.group == group; });
+			if (it != this->heap.end())
+			{
+				if (distance < it->distance)
+				{
+					*it = { id, distance, group };
+					std::make_heap(this->heap.begin(), this->heap.end(), &farther);	// the heap is small, so rebuilding it is cheap
+				}
+				return;
+			}	// group found
+		}	// unique ids
+
+		if (this->heap.size() == this->k)
+		{
+			std::pop_heap(this->heap.begin(), this->heap.end(), &farther);
+			this->heap.back() = { id, distance, group };
+		}
+		else this->heap.push_back({ id, distance, group });
+
+		std::push_heap(this->heap.begin(), this->heap.end(), &farther);
+	}	// push
+
+	void merge(const NearestNeighbors& other)
+	{
+		for (const auto& item : other.heap)
+			push(item.id, item.distance, item.group);
+	}
+
+	// Returns the neighbors sorted by distance in ascending order
+	std::vector<Neighbor> sorted() const
+	{
+		std::vector<Item> items = this->heap;
+		std::sort_heap(items.begin(), items.end(), &farther);
+
+		std::vector<Neighbor> neighbors;
+		neighbors.reserve(items.size());
+		for (const auto& item : items)
+			neighbors.emplace_back(item.id, item.distance);
+
+		return neighbors;
+	}
+
+private:
+
+	struct Item
+	{
+		std::size_t id;
+		double distance;
+		std::size_t group;
+	};
+
+	static bool farther(const Item& a, const Item& b) noexcept { return a.distance < b.distance; }
+
+	std::size_t k;
+	bool uniqueIds;
+	std::vector<Item> heap;
+};	// NearestNeighbors
+
+
+#endif	// NEARESTNEIGHBORS_H
@@ -11,7 +11,7 @@ struct L2Distance<cv::Mat>
 {	
 	double operator()(const cv::Mat& m1, const cv::Mat& m2) const
 	{
-		return cv::norm(m1 - m2, cv::NORM_L2);
+		return cv::norm(m1, m2, cv::NORM_L2);	// unlike norm(m1 - m2), it does not allocate a temporary matrix
 	}
 };	// L2Distance
 
@@ -1,4 +1,7 @@
 #include "openface.h"
+#include "l2kernels.h"
+
+#include <cmath>
 
 #include <opencv2/core.hpp>
 #include <opencv2/dnn/dnn.hpp>
@@ -10,15 +13,25 @@ std::optional<OpenFace::Descriptor> OpenFace::operator()(const Input& input)
 	CV_Assert(!input.empty());
 	CV_Assert(input.type() == CV_32FC3 || input.type() == CV_8UC3);
 
+	auto net = this->nets.acquire([this] { return readNet(); });
+	Metrics::Timer timer(Metrics::Stage::Inference);
 	auto blob = cv::dnn::blobFromImage(input, 1 / 255.0, cv::Size(inputSize, inputSize), cv::Scalar(0, 0, 0), this->swapRB, false, CV_32F);
-	net.setInput(blob);	
-	return net.forward().clone();	// it seems like a non-owning Mat is returned
+	net->setInput(blob);	
+	return net->forward().clone();	// it seems like a non-owning Mat is returned
 }
 
 
 double operator - (const OpenFace::Descriptor& d1, const OpenFace::Descriptor& d2)
 {
-	return cv::norm(d1.data - d2.data, cv::NORM_L2);	
+	const cv::Mat &m1 = d1.data, &m2 = d2.data;
+	if (m1.type() == CV_32FC1 && m2.type() == CV_32FC1 && m1.isContinuous() && m2.isContinuous() && m1.total() == m2.total())
+	{
+		// Use the vectorized kernel instead of allocating a matrix for the difference
+		static const auto squaredDistance = l2kernels::select();
+		return std::sqrt(squaredDistance(m1.ptr<float>(), m2.ptr<float>(), m1.total()));
+	}
+
+	return cv::norm(m1, m2, cv::NORM_L2);	
 }
 
 std::istream& operator >> (std::istream& stream, OpenFace::Descriptor& descriptor)
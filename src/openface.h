@@ -1,17 +1,28 @@
 #ifndef OPENFACE_H
 #define OPENFACE_H
 
+#include "replicapool.h"
+#include "metrics.h"
+
 #include <optional>
+#include <iterator>
 #include <string>
 
 #include <opencv2/dnn.hpp>
 
 
+template <typename T>
+struct DescriptorData;
+
 
 /*
 * OpenFace implements a callable object to perform face recognition by means of the OpenFace model. 
 * It takes in an image or a range of images and outputs face descriptors wrapped into std::optional<T>, which can be std::nullopt in 
 * case of a failure. 
+* 
+* An instance of cv::dnn::Net cannot be used by multiple threads at once, so inference is performed by networks checked out from 
+* a pool. Each of them is loaded from the model file when all existing ones are busy, hence the call operators can be used 
+* concurrently.
 */
 
 class OpenFace
@@ -25,6 +36,7 @@ public:
 		friend double operator - (const Descriptor& d1, const Descriptor& d2);
 		friend std::ostream& operator << (std::ostream& stream, const Descriptor& descriptor);
 		friend std::istream& operator >> (std::istream& stream, Descriptor& descriptor);
+		friend struct DescriptorData<Descriptor>;
 
 		using DataType = cv::Mat;	// the output type of the network
 		
@@ -57,13 +69,17 @@ public:
 	static constexpr unsigned long inputSize = 96;
 
 	OpenFace(const std::string& modelPath, bool swapRB) 
-		: net(cv::dnn::readNetFromTorch(modelPath))
-		, swapRB(swapRB) { }
+		: modelPath(modelPath)
+		, swapRB(swapRB) 
+	{ 
+		this->nets.acquire([this] { return readNet(); });	// load the first network right away to report an invalid model early
+	}
 		
-	OpenFace(const OpenFace& other) = delete;	// OpenCV provides no way to perform a deep copy of dnn::Net
+	// OpenCV provides no way to perform a deep copy of dnn::Net, so copies load their own networks from the model file
+	OpenFace(const OpenFace& other) = default;
 	OpenFace(OpenFace&& other) = default;
 	
-	OpenFace& operator = (const OpenFace& other) = delete;	// OpenCV provides no way to perform a deep copy of dnn::Net
+	OpenFace& operator = (const OpenFace& other) = default;
 	OpenFace& operator = (OpenFace&& other) = default;
 	
 	std::optional<Descriptor> operator()(const Input& input);
@@ -72,8 +88,11 @@ public:
 	OutputIterator operator()(InputIterator inHead, InputIterator inTail, OutputIterator outHead);	
 
 private:
-	cv::dnn::Net net;
+	cv::dnn::Net readNet() const { return cv::dnn::readNetFromTorch(this->modelPath); }
+
+	std::string modelPath;
 	bool swapRB;
+	ReplicaPool<cv::dnn::Net> nets;
 };	// OpenFace
 
 
@@ -83,10 +102,12 @@ OutputIterator OpenFace::operator()(InputIterator inHead, InputIterator inTail,
 	if (inHead == inTail)
 		return outHead;
 
+	auto net = this->nets.acquire([this] { return readNet(); });
+	Metrics::Timer timer(Metrics::Stage::Inference, static_cast<std::uint64_t>(std::distance(inHead, inTail)));
 	auto inBlob = cv::dnn::blobFromImages(std::vector<cv::Mat>(inHead, inTail), 1 / 255.0, cv::Size(inputSize, inputSize)
 										, cv::Scalar(0, 0, 0), this->swapRB, false, CV_32F);
-	net.setInput(inBlob);
-	auto outBlob = net.forward();
+	net->setInput(inBlob);
+	auto outBlob = net->forward();
 
 	for (int i = 0; i < outBlob.rows; ++i)
 	{
@@ -4,6 +4,7 @@
 #include "facedescriptorcomputer.h"
 #include "openface.h"
 #include "openfaceextractor.h"
+#include "openfacedescriptordata.h"
 
 #include <tuple>
 
@@ -0,0 +1,45 @@
+#ifndef OPENFACEDESCRIPTORDATA_H
+#define OPENFACEDESCRIPTORDATA_H
+
+#include "openface.h"
+
+#include <cstddef>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+
+template <typename T>
+struct DescriptorData;
+
+
+/*
+* DescriptorData specialization for OpenFace descriptors converts them to and from packed float arrays. The network outputs 
+* a single-row matrix of 32-bit floats, so the data can be copied as is.
+*/
+
+template <>
+struct DescriptorData<OpenFace::Descriptor>
+{
+	static std::size_t size(const OpenFace::Descriptor& descriptor) noexcept
+	{
+		return descriptor.data.total();
+	}
+
+	static void copy(const OpenFace::Descriptor& descriptor, float* data)
+	{
+		const cv::Mat& m = descriptor.data;
+		CV_Assert(m.type() == CV_32FC1 && m.rows == 1 && m.isContinuous());
+		std::copy_n(m.ptr<float>(), m.cols, data);
+	}
+
+	static OpenFace::Descriptor make(const float* data, std::size_t n)
+	{
+		cv::Mat m(1, static_cast<int>(n), CV_32FC1);
+		std::copy_n(data, n, m.ptr<float>());
+		return m;
+	}
+};	// DescriptorData
+
+
+#endif	// OPENFACEDESCRIPTORDATA_H
@@ -2,6 +2,7 @@
 #define OPENFACEDESCRIPTORMETRIC_H
 
 #include "openface.h"
+#include "floatvectordistancel2.h"
 
 
 /*
@@ -12,8 +13,10 @@ template <typename T>
 struct L2Distance;
 
 template <>
-struct L2Distance<OpenFace::Descriptor>
+struct L2Distance<OpenFace::Descriptor> : L2Distance<float>
 {
+	using L2Distance<float>::operator();	// packed vectors from a binary database file
+
 	double operator()(const OpenFace::Descriptor& d1, const OpenFace::Descriptor& d2) const
 	{
 		return d1 - d2;
@@ -3,10 +3,14 @@
 
 
 #include "faceextractorhelper.h"
+#include "metrics.h"
 
 #include <string>
 #include <optional>
 #include <exception>
+#include <filesystem>
+#include <utility>
+#include <vector>
 
 #include <opencv2/core.hpp>     // cv::Mat
 
@@ -33,6 +37,8 @@ enum class OpenFaceAlignment
 * OpenFaceExtractor crops a face detected in an input image and prepares it for face recognition by means of the OpenFace model.
 * https://cmusatyalab.github.io/openface/visualizations/#2-preprocess-the-raw-images
 * https://github.com/cmusatyalab/openface/blob/master/openface/align_dlib.py
+* Decoding an image file and extracting the face can also be performed separately, e.g. by different stages of a pipeline.
+* All faces of an image can be extracted at once along with their bounding boxes.
 */
 
 template <OpenFaceAlignment alignment>
@@ -41,6 +47,7 @@ class OpenFaceExtractor : FaceExtractorHelper<cv::Mat>
     using FaceExtractorHelper::ExtractFaceCallback;
 public:
     using FaceExtractorHelper::Output;
+    using DecodedImage = cv::Mat;
 
     // OpenFaceExtractor expects a path to 68 landmark detection model 
     OpenFaceExtractor(const std::string& landmarkDetectionModel, unsigned long size)
@@ -57,6 +64,18 @@ public:
     OpenFaceExtractor& operator = (OpenFaceExtractor&& other) = default;
 
     using FaceExtractorHelper::operator();
+    using FaceExtractorHelper::getMaxDetectionSide;
+    using FaceExtractorHelper::setMaxDetectionSide;
+
+    // Loads the image file (throws if it cannot be read)
+    DecodedImage decode(const std::filesystem::path& filePath) const;
+
+    // Detects and aligns the face in the decoded image. Face detection is a non-const operation.
+    std::optional<Output> extract(const DecodedImage& image);
+
+    // Detects and aligns the faces in the decoded image (at most maxFaces of them unless it is zero). The faces are listed with their 
+    // bounding boxes in the order of the detector's confidence.
+    std::vector<std::pair<FaceBox, Output>> extractAll(const DecodedImage& image, std::size_t maxFaces = 0);
 
 private:
 
@@ -117,15 +136,48 @@ private:
 template <OpenFaceAlignment alignment>
 std::optional<typename OpenFaceExtractor<alignment>::Output> OpenFaceExtractor<alignment>::extractFace(const std::string& filePath)
 {
-    cv::Mat im = cv::imread(filePath, cv::IMREAD_COLOR);
+    return extract(decode(filePath));
+}
+
+template <OpenFaceAlignment alignment>
+typename OpenFaceExtractor<alignment>::DecodedImage OpenFaceExtractor<alignment>::decode(const std::filesystem::path& filePath) const
+{
+    Metrics::Timer timer(Metrics::Stage::Decode);
+    cv::Mat im = cv::imread(filePath.string(), cv::IMREAD_COLOR);
     CV_Assert(!im.empty());
+    return im;
+}
 
-    dlib::cv_image<dlib::bgr_pixel> imDlib(im);
-    auto landmarks = FaceExtractorHelper::getLandmarks(imDlib);
-    if (landmarks.num_parts() != std::size(lkTemplate))
+template <OpenFaceAlignment alignment>
+std::optional<typename OpenFaceExtractor<alignment>::Output> OpenFaceExtractor<alignment>::extract(const DecodedImage& im)
+{
+    // Only the landmarks of the most confident detection are needed
+    auto faces = extractAll(im, 1);
+    if (faces.empty())
         return std::nullopt;
 
-    return alignFace(im, landmarks, this->size);
+    return std::move(faces.front().second);
+}
+
+template <OpenFaceAlignment alignment>
+std::vector<std::pair<FaceBox, typename OpenFaceExtractor<alignment>::Output>> OpenFaceExtractor<alignment>::extractAll(const DecodedImage& im, 
+    std::size_t maxFaces)
+{
+    dlib::cv_image<dlib::bgr_pixel> imDlib(im);
+    auto landmarks = FaceExtractorHelper::getLandmarks(imDlib, maxFaces);
+    std::vector<std::pair<FaceBox, Output>> faces;
+    if (landmarks.empty())
+        return faces;
+
+    Metrics::Timer timer(Metrics::Stage::Alignment, landmarks.size());
+    faces.reserve(landmarks.size());
+    for (const auto& faceLandmarks : landmarks)
+    {
+        if (faceLandmarks.num_parts() == std::size(lkTemplate))
+            faces.emplace_back(getFaceBox(faceLandmarks), alignFace(im, faceLandmarks, this->size));
+    }
+
+    return faces;
 }
 
 template <OpenFaceAlignment alignment>
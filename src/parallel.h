@@ -0,0 +1,89 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+/*
+* Parallel counterparts of the standard algorithms which run on the global thread pool, so all parallel computations of the program
+* share the same workers, and nested ones do not oversubscribe the CPU. If PARALLEL_EXECUTION is not defined, they run sequentially
+* on the calling thread.
+*
+* Iterators must be random-access. Unlike the standard parallel algorithms, which terminate the program if the function throws,
+* these rethrow the first exception (the other elements may or may not have been processed by then).
+*
+* The grain size is the number of elements processed at once by a thread. By default it is chosen so that every thread gets several
+* chunks, which suits cheap uniform work; heavy or uneven work (e.g. images) is better processed one element at a time.
+*/
+
+namespace parallel
+{
+	// Calls the body with the first and the last index of each chunk of [0, count)
+	template <class Body>
+	void forRange(std::size_t count, std::size_t grainSize, Body&& body)
+	{
+#ifdef PARALLEL_EXECUTION
+		ThreadPool::global().forRange(count, grainSize, std::forward<Body>(body));
+#else
+		static_cast<void>(grainSize);
+		if (count > 0)
+			body(std::size_t(0), count);
+#endif	// PARALLEL_EXECUTION
+	}	// forRange
+
+	template <class RandomIt, class Function>
+	void forEach(RandomIt first, RandomIt last, Function&& function, std::size_t grainSize = 0)
+	{
+		forRange(static_cast<std::size_t>(last - first), grainSize, [first, &function](std::size_t head, std::size_t tail)
+			{
+				for (std::size_t i = head; i < tail; ++i)
+					function(*(first + i));
+			});
+	}	// forEach
+
+	template <class RandomIt, class OutputIt, class UnaryOperation>
+	OutputIt transform(RandomIt first, RandomIt last, OutputIt out, UnaryOperation&& operation, std::size_t grainSize = 0)
+	{
+		auto count = static_cast<std::size_t>(last - first);
+		forRange(count, grainSize, [first, out, &operation](std::size_t head, std::size_t tail)
+			{
+				for (std::size_t i = head; i < tail; ++i)
+					*(out + i) = operation(*(first + i));
+			});
+
+		return out + count;
+	}	// transform
+
+	// Every chunk is reduced on its own, and then the partial results are combined in order, so the result does not depend
+	// on scheduling even if the reduction is not commutative
+	template <class RandomIt, class T, class Reduce, class Transform>
+	T transformReduce(RandomIt first, RandomIt last, T init, Reduce&& reduce, Transform&& transform, std::size_t grainSize = 0)
+	{
+		std::mutex mutex;
+		std::vector<std::pair<std::size_t, T>> partials;
+		forRange(static_cast<std::size_t>(last - first), grainSize, [first, &reduce, &transform, &mutex, &partials](std::size_t head, std::size_t tail)
+			{
+				T partial = transform(*(first + head));
+				for (std::size_t i = head + 1; i < tail; ++i)
+					partial = reduce(std::move(partial), transform(*(first + i)));
+
+				std::lock_guard<std::mutex> lock(mutex);
+				partials.emplace_back(head, std::move(partial));
+			});
+
+		std::sort(partials.begin(), partials.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		for (auto& partial : partials)
+			init = reduce(std::move(init), std::move(partial.second));
+
+		return init;
+	}	// transformReduce
+}	// parallel
+
+
+#endif	// PARALLEL_H
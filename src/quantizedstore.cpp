@@ -0,0 +1,172 @@
+#include "quantizedstore.h"
+#include "binaryio.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+
+
+void QuantizedStore::build(const DescriptorStore& store)
+{
+	clear();
+	if (store.empty())
+		return;
+
+	this->dim = store.dimension();
+	this->offset.assign(this->dim, std::numeric_limits<float>::max());
+	this->scale.assign(this->dim, std::numeric_limits<float>::lowest());	// holds the maximum until the scales are computed
+
+	for (std::size_t i = 0; i < store.size(); ++i)
+	{
+		const float* descriptor = store.descriptor(i);
+		for (std::size_t j = 0; j < this->dim; ++j)
+		{
+			this->offset[j] = std::min(this->offset[j], descriptor[j]);
+			this->scale[j] = std::max(this->scale[j], descriptor[j]);
+		}
+	}	// i
+
+	for (std::size_t j = 0; j < this->dim; ++j)
+		this->scale[j] = (this->scale[j] - this->offset[j]) / 255.0f;
+
+	this->trainedCount = store.size();
+	encode(store, 0);
+}	// build
+
+void QuantizedStore::update(const DescriptorStore& store)
+{
+	// Descriptors added after training may fall out of the range, in which case they are clamped. Retraining
+	// when the store has grown substantially keeps the parameters representative.
+	if (store.size() < this->count || store.dimension() != this->dim || store.size() >= 2 * this->trainedCount)
+		build(store);
+	else
+		encode(store, this->count);
+}	// update
+
+void QuantizedStore::encode(const DescriptorStore& store, std::size_t first)
+{
+	this->codeData.resize(store.size() * this->dim);
+	for (std::size_t i = first; i < store.size(); ++i)
+	{
+		const float* descriptor = store.descriptor(i);
+		std::uint8_t* code = this->codeData.data() + i * this->dim;
+		for (std::size_t j = 0; j < this->dim; ++j)
+		{
+			// Constant dimensions have zero scale and are encoded by zeros
+			float x = this->scale[j] > 0 ? std::round((descriptor[j] - this->offset[j]) / this->scale[j]) : 0.0f;
+			code[j] = static_cast<std::uint8_t>(std::clamp(x, 0.0f, 255.0f));
+		}
+	}	// i
+
+	this->count = store.size();
+	this->storeFingerprint = store.fingerprint();
+}	// encode
+
+void QuantizedStore::residual(const float* query, float* out) const noexcept
+{
+	for (std::size_t j = 0; j < this->dim; ++j)
+		out[j] = query[j] - this->offset[j];
+}	// residual
+
+std::vector<NearestNeighbors::Neighbor> QuantizedStore::search(const DescriptorStore& store, const float* query, std::size_t k,
+	bool uniqueLabels) const
+{
+	if (empty())
+		return {};
+
+	std::vector<float> r(this->dim);
+	residual(query, r.data());
+
+	// The codes are scanned in blocks, each of which keeps its own bounded heap of the nearest neighbors
+	constexpr std::size_t blockSize = 1024;
+	std::vector<std::size_t> blocks((this->count + blockSize - 1) / blockSize);
+	for (std::size_t i = 0; i < blocks.size(); ++i)
+		blocks[i] = i * blockSize;
+
+	auto nearest = parallel::transformReduce(blocks.cbegin(), blocks.cend(), NearestNeighbors(k, uniqueLabels),
+		[](NearestNeighbors x, const NearestNeighbors& y)	// reduce
+		{
+			x.merge(y);
+			return x;
+		},
+		[&, this](std::size_t head)	// transform
+		{
+			NearestNeighbors blockNearest(k, uniqueLabels);
+			for (std::size_t i = head, tail = std::min(head + blockSize, this->count); i < tail; ++i)
+				blockNearest.push(i, squaredDistance(r.data(), i), store.label(i));
+
+			return blockNearest;
+		}, 1);	// transformReduce
+
+	return nearest.sorted();
+}	// search
+
+void QuantizedStore::save(const std::string& filePath) const
+{
+	FileHeader header = {};
+	binaryio::initHeader(header);
+	header.dimension = this->dim;
+	header.count = this->count;
+	header.fingerprint = this->storeFingerprint;
+
+	binaryio::atomicWrite(filePath, [&](std::ostream& file)
+		{
+			binaryio::write(file, header);
+			binaryio::write<std::uint64_t>(file, this->trainedCount);
+			binaryio::write(file, this->offset.data(), this->offset.size());
+			binaryio::write(file, this->scale.data(), this->scale.size());
+			binaryio::write(file, this->codeData.data(), this->codeData.size());
+		});
+}	// save
+
+bool QuantizedStore::load(const std::string& filePath, const DescriptorStore& store)
+{
+	FileHeader header;
+	std::size_t trainedCount;
+	std::vector<float> offset, scale;
+	std::vector<std::uint8_t> codeData;
+	bool loaded = binaryio::tryRead(filePath, [&](std::istream& file)
+		{
+			header = binaryio::read<FileHeader>(file);
+			if (!binaryio::checkHeader(header))
+				return false;
+
+			// The codes are only valid for the descriptors they were computed from
+			if (header.dimension != store.dimension() || header.count != store.size() || header.fingerprint != store.fingerprint())
+				return false;
+
+			trainedCount = static_cast<std::size_t>(binaryio::read<std::uint64_t>(file));
+			offset.resize(store.dimension());
+			scale.resize(store.dimension());
+			codeData.resize(store.size() * store.dimension());
+			binaryio::read(file, offset.data(), offset.size());
+			binaryio::read(file, scale.data(), scale.size());
+			binaryio::read(file, codeData.data(), codeData.size());
+
+			return true;
+		});	// tryRead
+
+	if (!loaded)
+		return false;
+
+	this->offset = std::move(offset);
+	this->scale = std::move(scale);
+	this->codeData = std::move(codeData);
+	this->dim = store.dimension();
+	this->count = store.size();
+	this->trainedCount = trainedCount;
+	this->storeFingerprint = header.fingerprint;
+	return true;
+}	// load
+
+void QuantizedStore::clear() noexcept
+{
+	this->offset.clear();
+	this->scale.clear();
+	this->codeData.clear();
+	this->dim = this->count = this->trainedCount = 0;
+	this->storeFingerprint = 0;
+}	// clear
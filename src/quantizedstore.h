@@ -0,0 +1,101 @@
+#ifndef QUANTIZEDSTORE_H
+#define QUANTIZEDSTORE_H
+
+#include "searchindex.h"
+#include "l2kernels.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/*
+* QuantizedStore keeps an 8-bit copy of the descriptors held in a DescriptorStore. Each element is encoded as a code in [0, 255]
+* with a per-dimension offset and scale derived from the range of values in that dimension: x ~ offset + scale * code.
+* The codes take four times less memory than packed floats, therefore a scan over them is four times less memory-bound.
+*
+* Distances to the codes are computed for a float query, so the only approximation is the quantization of the stored descriptors.
+* They are meant for selecting candidates which are then re-ranked by exact distances to the float descriptors. Searching is a linear
+* scan over the codes.
+*
+* The codes can be saved to a file next to the database and loaded later. The file keeps a fingerprint of the descriptor store,
+* which allows to detect that the database has changed since then.
+*/
+
+class QuantizedStore : public SearchIndex
+{
+public:
+
+	std::unique_ptr<SearchIndex> clone() const override { return std::make_unique<QuantizedStore>(*this); }
+
+	std::string name() const override { return "quantized descriptor store"; }
+
+	std::string fileExtension() const override { return ".sq8"; }
+
+	std::size_t size() const noexcept override { return this->count; }
+
+	std::size_t dimension() const noexcept { return this->dim; }
+
+	const std::uint8_t* codes(std::size_t i) const noexcept { return this->codeData.data() + i * this->dim; }
+
+	const float* offsets() const noexcept { return this->offset.data(); }
+
+	const float* scales() const noexcept { return this->scale.data(); }
+
+	// Computes the parameters of quantization from the descriptors in the store and encodes all of them
+	void build(const DescriptorStore& store) override;
+
+	// Encodes the descriptors added to the store since the last update. The parameters are recomputed when the store doubles in size.
+	void update(const DescriptorStore& store) override;
+
+	// Subtracts the per-dimension offsets from the query. The residual is passed to squaredDistance().
+	void residual(const float* query, float* out) const noexcept;
+
+	// Returns the squared L2 distance between the query and the decoded i-th descriptor
+	float squaredDistance(const float* residual, std::size_t i) const noexcept
+	{
+		return this->kernel(residual, this->scale.data(), codes(i), this->dim);
+	}
+
+	std::vector<NearestNeighbors::Neighbor> search(const DescriptorStore& store, const float* query, std::size_t k,
+		bool uniqueLabels) const override;
+
+	void save(const std::string& filePath) const override;
+
+	// Loads the codes from a file. Returns false if the file does not exist or was built for different descriptors.
+	bool load(const std::string& filePath, const DescriptorStore& store) override;
+
+	void clear() noexcept override;
+
+private:
+
+	// Binary file header
+	struct FileHeader
+	{
+		static constexpr char signature[8] = { 'F', 'A', 'C', 'E', 'S', 'Q', '8', '\n' };
+		static constexpr std::uint32_t currentVersion = 1;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byteOrderMark;
+		std::uint64_t dimension;
+		std::uint64_t count;
+		std::uint64_t fingerprint;
+	};	// FileHeader
+
+	void encode(const DescriptorStore& store, std::size_t first);
+
+	l2kernels::SquaredQuantizedDistance kernel = l2kernels::selectQuantized();
+	std::vector<float> offset;
+	std::vector<float> scale;
+	std::vector<std::uint8_t> codeData;
+	std::size_t dim = 0;
+	std::size_t count = 0;
+	std::size_t trainedCount = 0;	// the number of descriptors the parameters were computed for
+	std::uint64_t storeFingerprint = 0;		// the fingerprint of the store the codes were computed from
+};	// QuantizedStore
+
+
+#endif	// QUANTIZEDSTORE_H
@@ -0,0 +1,450 @@
+#include "queryserver.h"
+#include "boundedqueue.h"
+#include "json.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif	// !_WIN32
+
+
+
+namespace
+{
+#ifdef _WIN32
+	int lastSocketError() noexcept { return WSAGetLastError(); }
+
+	bool isInterrupted(int error) noexcept { return error == WSAEINTR || error == WSAECONNABORTED; }
+
+	int pollSockets(pollfd* fds, unsigned long count, int timeout) noexcept { return WSAPoll(fds, count, timeout); }
+
+	// Winsock must be initialized before any socket is created
+	void startSockets()
+	{
+		static const int error = []
+			{
+				WSADATA data;
+				return WSAStartup(MAKEWORD(2, 2), &data);
+			}();
+
+		if (error != 0)
+			throw std::system_error(error, std::system_category(), "Failed to initialize Winsock");
+	}
+
+	void setTimeout(std::uintptr_t socket, int option, int seconds) noexcept
+	{
+		DWORD timeout = static_cast<DWORD>(seconds) * 1000;
+		setsockopt(socket, SOL_SOCKET, option, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+	}
+
+	constexpr int sendFlags = 0;
+#else
+	int lastSocketError() noexcept { return errno; }
+
+	bool isInterrupted(int error) noexcept { return error == EINTR || error == ECONNABORTED; }
+
+	int pollSockets(pollfd* fds, nfds_t count, int timeout) noexcept { return ::poll(fds, count, timeout); }
+
+	void startSockets() noexcept {}
+
+	void setTimeout(int socket, int option, int seconds) noexcept
+	{
+		timeval timeout = { seconds, 0 };
+		setsockopt(socket, SOL_SOCKET, option, &timeout, sizeof(timeout));
+	}
+
+	// A client closing the connection must not kill the server with SIGPIPE
+#ifdef MSG_NOSIGNAL
+	constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+	constexpr int sendFlags = 0;
+#endif	// MSG_NOSIGNAL
+#endif	// !_WIN32
+
+	// The largest header block of a request
+	constexpr std::size_t maxHeaderSize = 64 * 1024;
+
+	std::string toLower(std::string text)
+	{
+		std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return text;
+	}
+
+	std::string trim(const std::string& text)
+	{
+		auto first = text.find_first_not_of(" \t"), last = text.find_last_not_of(" \t");
+		return first == std::string::npos ? std::string() : text.substr(first, last - first + 1);
+	}
+
+	const char* reasonPhrase(int status) noexcept
+	{
+		switch (status)
+		{
+		case 200: return "OK";
+		case 400: return "Bad Request";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 413: return "Payload Too Large";
+		case 422: return "Unprocessable Entity";
+		case 500: return "Internal Server Error";
+		case 501: return "Not Implemented";
+		default: return "Unknown";
+		}
+	}
+
+	QueryServer::Response errorResponse(int status, const std::string& message)
+	{
+		return { status, "{\"error\":" + json::quote(message) + "}" };
+	}
+
+	// Thrown while reading a request which cannot be answered normally
+	struct RequestError : std::runtime_error
+	{
+		RequestError(int status, const std::string& message)
+			: std::runtime_error(message)
+			, status(status) {}
+
+		int status;
+	};	// RequestError
+}	// anonymous namespace
+
+
+#ifdef _WIN32
+const QueryServer::Socket QueryServer::invalidSocket = INVALID_SOCKET;
+#else
+const QueryServer::Socket QueryServer::invalidSocket = -1;
+#endif	// _WIN32
+
+
+QueryServer::QueryServer(const std::string& address, Handler handler, std::size_t numWorkers)
+	: listenAddress(address)
+	, handler(std::move(handler))
+	, numWorkers(numWorkers > 0 ? numWorkers : std::max(std::thread::hardware_concurrency(), 1u))
+	, listenSocket(invalidSocket)
+{
+	if (address.empty())
+		throw std::invalid_argument("The server address must be a port number or a socket path.");
+
+	startSockets();
+
+	// A number is a TCP port, which is only open to local clients, anything else is a Unix domain socket path
+	this->isUnixSocket = !std::all_of(address.cbegin(), address.cend(), [](unsigned char c) { return std::isdigit(c); });
+	if (this->isUnixSocket)
+	{
+		sockaddr_un unixAddress = {};
+		unixAddress.sun_family = AF_UNIX;
+		if (address.size() >= sizeof(unixAddress.sun_path))
+			throw std::invalid_argument("The socket path is too long: " + address);
+
+		std::copy(address.cbegin(), address.cend(), unixAddress.sun_path);
+
+		// A socket left by a server which has not shut down cleanly prevents binding
+		std::error_code ec;
+		if (std::filesystem::is_socket(address, ec))
+			std::filesystem::remove(address, ec);
+
+		this->listenSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (this->listenSocket == invalidSocket)
+			throw std::system_error(lastSocketError(), std::system_category(), "Failed to create a socket");
+
+		if (::bind(this->listenSocket, reinterpret_cast<const sockaddr*>(&unixAddress), sizeof(unixAddress)) != 0)
+		{
+			int error = lastSocketError();
+			closeSocket(this->listenSocket);
+			throw std::system_error(error, std::system_category(), "Failed to bind the socket to " + address);
+		}
+	}	// Unix socket
+	else
+	{
+		unsigned long port = std::stoul(address);
+		if (port == 0 || port > 65535)
+			throw std::invalid_argument("Invalid port number: " + address);
+
+		sockaddr_in inetAddress = {};
+		inetAddress.sin_family = AF_INET;
+		inetAddress.sin_port = htons(static_cast<std::uint16_t>(port));
+		inetAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		this->listenSocket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (this->listenSocket == invalidSocket)
+			throw std::system_error(lastSocketError(), std::system_category(), "Failed to create a socket");
+
+		int reuse = 1;
+		setsockopt(this->listenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+		if (::bind(this->listenSocket, reinterpret_cast<const sockaddr*>(&inetAddress), sizeof(inetAddress)) != 0)
+		{
+			int error = lastSocketError();
+			closeSocket(this->listenSocket);
+			throw std::system_error(error, std::system_category(), "Failed to bind the socket to port " + address);
+		}
+	}	// TCP socket
+
+	if (::listen(this->listenSocket, SOMAXCONN) != 0)
+	{
+		int error = lastSocketError();
+		closeSocket(this->listenSocket);
+		throw std::system_error(error, std::system_category(), "Failed to listen on " + address);
+	}
+}	// ctor
+
+QueryServer::~QueryServer()
+{
+	closeSocket(this->listenSocket);
+
+	if (this->isUnixSocket)
+	{
+		std::error_code ec;
+		std::filesystem::remove(this->listenAddress, ec);
+	}
+}	// dtor
+
+void QueryServer::closeSocket(Socket socket) noexcept
+{
+#ifdef _WIN32
+	::closesocket(socket);
+#else
+	::close(socket);
+#endif	// _WIN32
+}	// closeSocket
+
+void QueryServer::run()
+{
+	// Accepted connections wait for a free worker. When the queue is full, new clients wait in the backlog of the socket.
+	BoundedQueue<Socket> connections(this->numWorkers);
+	std::atomic<std::size_t> numWaiting{ 0 };
+	std::vector<std::thread> workers;
+	auto work = [this, &connections, &numWaiting]
+	{
+		while (auto connection = connections.pop())
+		{
+			--numWaiting;
+			serve(*connection, numWaiting);
+			closeSocket(*connection);
+		}
+	};
+
+	try
+	{
+		for (std::size_t i = 0; i < this->numWorkers; ++i)
+			workers.emplace_back(work);
+
+		while (!this->stopping.load(std::memory_order_acquire))
+		{
+			// Waiting with a timeout lets the loop notice stop() without closing the socket under a blocked accept()
+			pollfd fd = {};
+			fd.fd = this->listenSocket;
+			fd.events = POLLIN;
+			int ready = pollSockets(&fd, 1, 200);
+			if (ready < 0 && !isInterrupted(lastSocketError()))
+				throw std::system_error(lastSocketError(), std::system_category(), "Failed to wait for connections");
+			else if (ready <= 0)
+				continue;
+
+			Socket connection = ::accept(this->listenSocket, nullptr, nullptr);
+			if (connection == invalidSocket)
+			{
+				int error = lastSocketError();
+				if (isInterrupted(error))
+					continue;
+
+				throw std::system_error(error, std::system_category(), "Failed to accept a connection");
+			}
+
+			// Responses are small, so they are sent at once rather than waiting for more data
+			if (!this->isUnixSocket)
+			{
+				int noDelay = 1;
+				setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+			}
+
+			setTimeout(connection, SO_RCVTIMEO, idleTimeout);
+			setTimeout(connection, SO_SNDTIMEO, idleTimeout);
+			++numWaiting;
+			if (!connections.push(connection))
+				closeSocket(connection);
+		}	// while
+	}
+	catch (...)
+	{
+		connections.close();
+		for (auto& worker : workers)
+			worker.join();
+
+		throw;
+	}
+
+	connections.close();
+	for (auto& worker : workers)
+		worker.join();
+}	// run
+
+void QueryServer::stop() noexcept
+{
+	this->stopping.store(true, std::memory_order_release);
+}	// stop
+
+void QueryServer::serve(Socket connection, const std::atomic<std::size_t>& numWaiting) const
+{
+	std::string buffer;		// may hold the beginning of the next request
+	for (bool keepAlive = true; keepAlive; )
+	{
+		Request request;
+		try
+		{
+			if (!readRequest(connection, buffer, request, keepAlive))
+				return;		// closed by the client or timed out
+		}
+		catch (const RequestError& e)
+		{
+			writeResponse(connection, errorResponse(e.status, e.what()), false);
+			return;
+		}
+
+		Response response;
+		try
+		{
+			response = this->handler(request);
+		}
+		catch (const std::invalid_argument& e)		// invalid parameters of the query
+		{
+			response = errorResponse(400, e.what());
+		}
+		catch (const std::exception& e)
+		{
+			response = errorResponse(500, e.what());
+		}
+
+		// A connection is not kept alive while others wait for a worker, so clients are served in turn
+		keepAlive = keepAlive && numWaiting.load() == 0;
+		writeResponse(connection, response, keepAlive);
+	}	// for
+}	// serve
+
+bool QueryServer::readRequest(Socket connection, std::string& buffer, Request& request, bool& keepAlive)
+{
+	// Returns false if no more data can be read
+	auto receive = [connection, &buffer]
+	{
+		char chunk[16 * 1024];
+		auto received = ::recv(connection, chunk, static_cast<int>(sizeof(chunk)), 0);
+		if (received <= 0)
+			return false;
+
+		buffer.append(chunk, static_cast<std::size_t>(received));
+		return true;
+	};
+
+	std::size_t headerEnd;
+	while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+	{
+		if (buffer.size() > maxHeaderSize)
+			throw RequestError(400, "The request header is too large.");
+
+		if (!receive())
+		{
+			if (!buffer.empty())
+				throw RequestError(400, "Incomplete request.");
+
+			return false;
+		}
+	}	// while
+
+	// The request line: method, target, and version
+	std::size_t lineEnd = buffer.find("\r\n");
+	std::string requestLine = buffer.substr(0, lineEnd);
+	std::size_t methodEnd = requestLine.find(' '), targetEnd = requestLine.rfind(' ');
+	if (methodEnd == std::string::npos || targetEnd == methodEnd || requestLine.compare(targetEnd + 1, 5, "HTTP/") != 0)
+		throw RequestError(400, "Malformed request line.");
+
+	request.method = requestLine.substr(0, methodEnd);
+	request.path = requestLine.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+	request.path = request.path.substr(0, request.path.find('?'));
+	keepAlive = requestLine.compare(targetEnd + 1, std::string::npos, "HTTP/1.0") != 0;
+
+	std::size_t contentLength = 0;
+	for (std::size_t pos = lineEnd + 2; pos < headerEnd; )
+	{
+		std::size_t next = buffer.find("\r\n", pos);
+		std::string line = buffer.substr(pos, next - pos);
+		pos = next + 2;
+
+		std::size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			throw RequestError(400, "Malformed header field.");
+
+		std::string name = toLower(trim(line.substr(0, colon))), value = trim(line.substr(colon + 1));
+		if (name == "content-length")
+		{
+			if (value.empty() || !std::all_of(value.cbegin(), value.cend(), [](unsigned char c) { return std::isdigit(c); })
+				|| value.size() > 9)
+				throw RequestError(value.size() > 9 ? 413 : 400, "Invalid content length.");
+
+			contentLength = std::stoul(value);
+		}
+		else if (name == "connection")
+		{
+			std::string option = toLower(value);
+			if (option == "close")
+				keepAlive = false;
+			else if (option == "keep-alive")
+				keepAlive = true;
+		}
+		else if (name == "transfer-encoding")
+			throw RequestError(501, "Chunked request bodies are not supported.");
+	}	// for
+
+	if (contentLength > maxBodySize)
+		throw RequestError(413, "The request body is too large.");
+
+	std::size_t bodyStart = headerEnd + 4;
+	while (buffer.size() < bodyStart + contentLength)
+	{
+		if (!receive())
+			throw RequestError(400, "Incomplete request body.");
+	}
+
+	request.body = buffer.substr(bodyStart, contentLength);
+	buffer.erase(0, bodyStart + contentLength);
+	return true;
+}	// readRequest
+
+void QueryServer::writeResponse(Socket connection, const Response& response, bool keepAlive)
+{
+	std::string message = "HTTP/1.1 " + std::to_string(response.status) + ' ' + reasonPhrase(response.status) + "\r\n"
+		"Content-Type: " + response.contentType + "\r\n"
+		"Content-Length: " + std::to_string(response.body.size()) + "\r\n"
+		"Connection: " + (keepAlive ? "keep-alive" : "close") + "\r\n"
+		"\r\n" + response.body;
+
+	// A failure means the client has gone, so there is nobody to report it to
+	for (std::size_t sent = 0; sent < message.size(); )
+	{
+		auto count = ::send(connection, message.data() + sent, static_cast<int>(message.size() - sent), sendFlags);
+		if (count <= 0)
+			break;
+
+		sent += static_cast<std::size_t>(count);
+	}
+}	// writeResponse
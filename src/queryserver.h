@@ -0,0 +1,97 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+
+/*
+* QueryServer answers requests of local clients, so that the models and the database are loaded once and reused by many queries.
+*
+* It speaks a subset of HTTP/1.1 over a TCP socket bound to the loopback interface or over a Unix domain socket (the address is
+* a port number or a socket path respectively). Connections are accepted by the thread calling run() and served by a pool of
+* worker threads, each of which reads requests from a connection and passes them to the handler. Hence the handler is called
+* concurrently and must be thread-safe. Connections are kept alive between requests until the client closes them or stays idle
+* for too long; if more clients are connected than there are workers, the connections are closed after each response instead,
+* so that the clients take turns.
+*
+* Requests with chunked bodies, pipelining, and other features which clients of the query protocol do not need are not supported.
+*/
+
+class QueryServer
+{
+public:
+
+	struct Request
+	{
+		std::string method;
+		std::string path;
+		std::string body;
+	};	// Request
+
+	struct Response
+	{
+		int status = 200;
+		std::string body;
+		std::string contentType = "application/json";
+	};	// Response
+
+	using Handler = std::function<Response (const Request&)>;
+
+	// The largest request body accepted
+	static constexpr std::size_t maxBodySize = 1 << 20;
+
+	// The number of seconds an idle connection is kept open
+	static constexpr int idleTimeout = 5;
+
+	// Starts listening on the address. The number of workers is chosen automatically if zero.
+	QueryServer(const std::string& address, Handler handler, std::size_t numWorkers = 0);
+
+	QueryServer(const QueryServer& other) = delete;
+	QueryServer& operator = (const QueryServer& other) = delete;
+
+	~QueryServer();
+
+	// The address the server is listening on
+	const std::string& address() const noexcept { return this->listenAddress; }
+
+	std::size_t workers() const noexcept { return this->numWorkers; }
+
+	// Accepts connections until stop() is called
+	void run();
+
+	// Makes run() return after the requests being processed have been answered. It can be called from any thread.
+	void stop() noexcept;
+
+private:
+
+#ifdef _WIN32
+	using Socket = std::uintptr_t;
+#else
+	using Socket = int;
+#endif	// _WIN32
+
+	static const Socket invalidSocket;
+
+	static void closeSocket(Socket socket) noexcept;
+
+	// Answers the requests received over the connection. It is closed after a response if other connections are waiting.
+	void serve(Socket connection, const std::atomic<std::size_t>& numWaiting) const;
+
+	static bool readRequest(Socket connection, std::string& buffer, Request& request, bool& keepAlive);
+
+	static void writeResponse(Socket connection, const Response& response, bool keepAlive);
+
+	std::string listenAddress;
+	bool isUnixSocket = false;
+	Handler handler;
+	std::size_t numWorkers;
+	Socket listenSocket;
+	std::atomic<bool> stopping{ false };
+};	// QueryServer
+
+
+#endif	// QUERYSERVER_H
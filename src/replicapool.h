@@ -0,0 +1,120 @@
+#ifndef REPLICAPOOL_H
+#define REPLICAPOOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+/*
+* ReplicaPool keeps replicas of an object with a non-const interface (e.g. a neural network, which holds intermediate outputs), so
+* that multiple threads can use it at the same time without making a copy for every call.
+*
+* A thread checks out a replica by calling acquire() and gets a Lease, which returns the replica to the pool when destroyed.
+* If there are no idle replicas, a new one is made by the factory passed to acquire(). Thus, the pool grows up to the number of
+* threads which use it simultaneously (i.e. the number of workers), and the replicas are reused afterwards.
+*
+* The pool itself is thread-safe. Copies of the pool start empty, since the replicas are meant to be owned exclusively.
+*/
+
+template <class T>
+class ReplicaPool
+{
+	struct State
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<T>> idle;
+		std::size_t count = 0;		// the total number of replicas
+	};
+
+public:
+
+	class Lease
+	{
+	public:
+		Lease(State& state, std::unique_ptr<T> replica) noexcept
+			: state(&state)
+			, replica(std::move(replica)) {}
+
+		Lease(const Lease& other) = delete;
+		Lease(Lease&& other) = default;
+
+		Lease& operator = (const Lease& other) = delete;
+		Lease& operator = (Lease&& other) = delete;
+
+		~Lease()
+		{
+			if (this->replica)
+			{
+				std::lock_guard<std::mutex> lock(this->state->mutex);
+				this->state->idle.push_back(std::move(this->replica));		// the capacity has been reserved, so it does not throw
+			}
+		}
+
+		T& operator * () const noexcept { return *this->replica; }
+		T* operator -> () const noexcept { return this->replica.get(); }
+
+	private:
+		State* state;
+		std::unique_ptr<T> replica;
+	};	// Lease
+
+	ReplicaPool()
+		: state(std::make_unique<State>()) {}
+
+	ReplicaPool(const ReplicaPool&)
+		: ReplicaPool() {}
+
+	ReplicaPool(ReplicaPool&& other) = default;
+
+	ReplicaPool& operator = (const ReplicaPool&)
+	{
+		this->state = std::make_unique<State>();
+		return *this;
+	}
+
+	ReplicaPool& operator = (ReplicaPool&& other) = default;
+
+	// Checks out an idle replica or makes a new one by calling the factory, which must return an object of type T
+	template <class Factory>
+	Lease acquire(Factory&& make);
+
+	// Returns the number of replicas made so far
+	std::size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(this->state->mutex);
+		return this->state->count;
+	}
+
+private:
+	std::unique_ptr<State> state;	// leases refer to the state, so it must not move
+};	// ReplicaPool
+
+
+template <class T>
+template <class Factory>
+typename ReplicaPool<T>::Lease ReplicaPool<T>::acquire(Factory&& make)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->state->mutex);
+		if (!this->state->idle.empty())
+		{
+			std::unique_ptr<T> replica = std::move(this->state->idle.back());
+			this->state->idle.pop_back();
+			return Lease(*this->state, std::move(replica));
+		}
+	}
+
+	// Making a replica may take a while, so other threads are not blocked meanwhile
+	auto replica = std::make_unique<T>(std::forward<Factory>(make)());
+
+	std::lock_guard<std::mutex> lock(this->state->mutex);
+	this->state->idle.reserve(this->state->count + 1);	// make sure the replica can be returned to the pool without reallocation
+	++this->state->count;
+	return Lease(*this->state, std::move(replica));
+}	// acquire
+
+
+#endif	// REPLICAPOOL_H
@@ -1,9 +1,14 @@
 #ifndef RESNET_H
 #define RESNET_H
 
+#include "replicapool.h"
+#include "metrics.h"
+#include "parallel.h"
+
 #include <optional>
-#include <execution>
-#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
 
 #include <dlib/dnn.h>
 #include <dlib/serialize.h>
@@ -14,6 +19,11 @@
 * ResNet is a callable object which computes face embeddings (descriptors) by means of the ResNet model implemented in Dlib.
 * It takes in an image or a range of images and outputs face descriptors wrapped into std::optional<T>, which can be std::nullopt in 
 * case of a failure. 
+* 
+* The network loaded from the model file serves as a prototype. Inference is performed by replicas of the network checked out from
+* a pool, so the call operators can be used concurrently, and each worker thread reuses a replica instead of copying the network
+* for every image. When parallel execution is enabled, a range of images is split into mini-batches, and each thread runs a batched
+* forward pass for a mini-batch on its replica (which keeps its tensors allocated for the next mini-batch).
 */
 
 class ResNet
@@ -76,14 +86,29 @@ public:
     ResNet& operator = (const ResNet& other) = default;
     ResNet& operator = (ResNet&& other) = default;
 
-    std::optional<Descriptor> operator ()(const Input& input) { return this->net(input); }
+    std::optional<Descriptor> operator ()(const Input& input) 
+    { 
+        auto faceRecognizer = this->replicas.acquire([this] { return this->net; });
+        Metrics::Timer timer(Metrics::Stage::Inference);
+        return (*faceRecognizer)(input);
+    }
 
     template <class InputIterator, class OutputIterator>
     OutputIterator operator()(InputIterator inHead, InputIterator inTail, OutputIterator outHead);
 
+    std::size_t getMiniBatchSize() const noexcept { return this->miniBatchSize; }
+
+    // Sets the number of images passed through the network at once by each thread in parallel execution mode
+    void setMiniBatchSize(std::size_t miniBatchSize)
+    {
+        this->miniBatchSize = miniBatchSize > 0 ? miniBatchSize : throw std::invalid_argument("The mini-batch size must be positive.");
+    }
+
 private:
 
-    anet_type net;
+    anet_type net;      // the prototype, which is never used for inference, so its replicas don't carry intermediate outputs
+    ReplicaPool<anet_type> replicas;    // copies of ResNet make their own replicas
+    std::size_t miniBatchSize = 1;
 };  // ResNet
 
 
@@ -95,46 +120,36 @@ OutputIterator ResNet::operator()(InputIterator inHead, InputIterator inTail, Ou
     
     // Dlib's batching for face recognition is not really efficient:
     // https://github.com/davisking/dlib/issues/1159
+    // Therefore the images are split into small mini-batches processed concurrently. The mini-batch size which gives the best 
+    // throughput depends on the CPU (the number of cores and the cache size), so it can be tuned.
 
-    std::atomic_flag eflag{ false };
-    std::exception_ptr eptr;
-    outHead = std::transform(std::execution::par, inHead, inTail, outHead,         
-        [this, &eflag, &eptr](const Input& input) -> std::optional<ResNet::Descriptor> 
+    // The mini-batches are the chunks of a parallel loop, so nested in the loop over batches of faces they share the workers 
+    // of the pool with it rather than starting threads of their own
+    const auto count = static_cast<std::size_t>(inTail - inHead);
+    parallel::forRange(count, this->miniBatchSize, [this, inHead, outHead](std::size_t head, std::size_t tail)
         {
-            try
-            {
-
-                // Since we are performing inference concurrently and the call operator of anet_type is non-const, we have to make 
-                // sure that there is no data race. Using thread_local variables is not an option in this case as they are shared 
-                // among all instances of the class, while we want to perform inference by means of the network from this particular 
-                // instance. That's why we are making a local copy of the network every time before using it. It may seem inefficient, 
-                // but in fact it almost has no impact on the overall processing time. That is for two reasons:        
-                // 1) the time to copy the network is small as compared to the inference time 
-                // 2) other threads can pick up the slack while we are waiting for a copy
-
-                anet_type faceRecognizer = this->net;
-                return faceRecognizer(input);
-            }   // try
-            catch (...)     // exceptions from other threads are not automatically propagated
-            {
-                // A read-modify-write operation with this memory order is both an acquire operation and a release operation. 
-			    // No memory reads or writes in the current thread can be reordered before or after this store. All writes in 
-			    // other threads that release the same atomic variable are visible before the modification and the modification 
-			    // is visible in other threads that acquire the same atomic variable.
-                if (!eflag.test_and_set(std::memory_order_acq_rel))     // noexcept
-                    eptr = std::current_exception();
-            }   // catch
-
-            return std::nullopt;
-        });     // transform
-
-    if (eptr)
-        std::rethrow_exception(eptr);
+            // Since we are performing inference concurrently and the call operator of anet_type is non-const, we have to make 
+            // sure that there is no data race. Using thread_local variables is not an option in this case as they are shared 
+            // among all instances of the class, while we want to perform inference by means of the network from this particular 
+            // instance. That's why every thread checks out a replica of the network from the pool. Replicas are only made when 
+            // all existing ones are busy, so after the first batch each worker reuses its replica without reallocating the 
+            // parameters and the workspace of every layer.
+
+            auto faceRecognizer = this->replicas.acquire([this] { return this->net; });
+            Metrics::Timer timer(Metrics::Stage::Inference, tail - head);
+            (*faceRecognizer)(inHead + head, inHead + tail, outHead + head);
+        });     // forRange
+
+    outHead += count;
 
 #else
-    // When parallel execution is disabled (no tbb), use batching
-    this->net(inHead, inTail, outHead);
+    // When parallel execution is disabled, use batching
+    auto faceRecognizer = this->replicas.acquire([this] { return this->net; });
     auto batchSize = inTail - inHead;
+    {
+        Metrics::Timer timer(Metrics::Stage::Inference, static_cast<std::uint64_t>(batchSize));
+        (*faceRecognizer)(inHead, inTail, outHead);
+    }
     outHead += batchSize;    
 #endif  // !PARALLEL_EXECUTION
 
@@ -4,6 +4,7 @@
 #include "resnet.h"
 #include "facedescriptorcomputer.h"
 #include "dlibfaceextractor.h"
+#include "dlibmatrixdata.h"
 
 #include <tuple>
 
@@ -27,6 +28,10 @@ public:
 
 	ResNetFaceDescriptorComputer& operator = (const ResNetFaceDescriptorComputer& other) = default;
 	ResNetFaceDescriptorComputer& operator = (ResNetFaceDescriptorComputer&& other) = default;
+
+	// The number of faces recognized at once by each thread in parallel execution mode
+	std::size_t getMiniBatchSize() const noexcept { return getFaceRecognizer().getMiniBatchSize(); }
+	void setMiniBatchSize(std::size_t miniBatchSize) { getFaceRecognizer().setMiniBatchSize(miniBatchSize); }
 };	// ResNetFaceDescriptorComputer
 
 
@@ -0,0 +1,26 @@
+#include "searchbackend.h"
+#include "quantizedstore.h"
+#include "ivfpqindex.h"
+#include "hnswindex.h"
+
+#include <stdexcept>
+
+
+
+std::unique_ptr<SearchIndex> makeSearchIndex(const SearchSettings& searchSettings)
+{
+	if (searchSettings.backend == "exhaustive")
+		return nullptr;
+	else if (searchSettings.backend == "quantized")
+		return std::make_unique<QuantizedStore>();
+	else if (searchSettings.backend == "ivfpq")
+		return std::make_unique<IvfPqIndex>(IvfPqIndex::Parameters{ searchSettings.numLists, 0, searchSettings.numProbes });
+	else if (searchSettings.backend == "hnsw")
+	{
+		HnswIndex::Parameters parameters;
+		parameters.efSearch = searchSettings.efSearch;
+		parameters.sequential = searchSettings.reproducible;
+		return std::make_unique<HnswIndex>(parameters);
+	}
+	else throw std::invalid_argument("Unsupported search backend: " + searchSettings.backend);
+}	// makeSearchIndex
@@ -0,0 +1,28 @@
+#ifndef SEARCHBACKEND_H
+#define SEARCHBACKEND_H
+
+#include "searchindex.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+
+// Approximate search options
+struct SearchSettings
+{
+	std::string backend = "exhaustive";		// exhaustive, quantized, ivfpq, or hnsw
+	std::size_t numLists = 0;
+	std::size_t numProbes = 8;
+	std::size_t efSearch = 64;
+	std::size_t rerankSize = 100;
+	bool reproducible = false;		// build indexes whose structure does not depend on thread scheduling
+	bool estimateRecall = false;	// check the approximate search against the exhaustive one once the index is ready
+};
+
+// Creates the search index for the backend. Returns a null pointer for the exhaustive search and throws std::invalid_argument
+// if the backend is not supported.
+std::unique_ptr<SearchIndex> makeSearchIndex(const SearchSettings& searchSettings);
+
+
+#endif	// SEARCHBACKEND_H
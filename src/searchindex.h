@@ -0,0 +1,62 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "descriptorstore.h"
+#include "nearestneighbors.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/*
+* SearchIndex is the interface of approximate search backends for FaceDb (see QuantizedStore, IvfPqIndex, and HnswIndex).
+*
+* An index is built for the descriptors in a DescriptorStore and refers to them by their positions in the store. It must be kept
+* up to date with the store: descriptors appended to the store are added to the index by update(). Searching returns candidates
+* with approximate squared L2 distances to the query, which are expected to be re-ranked by exact distances.
+*
+* Indices can be saved to a file next to the database and loaded later. Loading must fail (return false) if the file was saved
+* for a different store.
+*/
+
+class SearchIndex
+{
+public:
+
+	virtual ~SearchIndex() = default;
+
+	virtual std::unique_ptr<SearchIndex> clone() const = 0;
+
+	// A short human-readable description of the index type
+	virtual std::string name() const = 0;
+
+	// The suffix appended to the database path to make the name of the index file
+	virtual std::string fileExtension() const = 0;
+
+	virtual std::size_t size() const noexcept = 0;
+
+	bool empty() const noexcept { return size() == 0; }
+
+	// Builds the index from scratch for all descriptors in the store
+	virtual void build(const DescriptorStore& store) = 0;
+
+	// Adds the descriptors appended to the store since the last update
+	virtual void update(const DescriptorStore& store) = 0;
+
+	// Returns the indices of up to k stored descriptors with the smallest approximate squared distances to the query sorted in ascending
+	// order of distances. If uniqueLabels is true, only the closest descriptor of each label is reported.
+	virtual std::vector<NearestNeighbors::Neighbor> search(const DescriptorStore& store, const float* query, std::size_t k,
+		bool uniqueLabels) const = 0;
+
+	virtual void save(const std::string& filePath) const = 0;
+
+	// Loads the index from a file. Returns false if the file does not exist or was built for different descriptors.
+	virtual bool load(const std::string& filePath, const DescriptorStore& store) = 0;
+
+	virtual void clear() noexcept = 0;
+};	// SearchIndex
+
+
+#endif	// SEARCHINDEX_H
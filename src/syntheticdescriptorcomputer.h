@@ -0,0 +1,114 @@
+#ifndef SYNTHETICDESCRIPTORCOMPUTER_H
+#define SYNTHETICDESCRIPTORCOMPUTER_H
+
+#include "syntheticgallery.h"
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+template <class DescriptorComputer>
+struct DescriptorComputerType;
+
+template <typename Descriptor>
+struct DescriptorData;
+
+
+/*
+* SyntheticDescriptorComputer stands in for a real descriptor computer, so the database can be searched, saved, and loaded without
+* running the neural network. The "files" are names of generated descriptors, which are resolved by the source function. The source
+* made by fromGallery() accepts "g<index>" for the descriptors of a synthetic gallery and "q<index>" for its queries.
+*
+* The descriptors have the type of the descriptor computer it imitates, and the databases it works with have the type id of that
+* computer, so database files made from synthetic descriptors can be loaded by the application like any other.
+*/
+
+template <class DescriptorComputer>
+class SyntheticDescriptorComputer
+{
+public:
+
+	using Descriptor = typename DescriptorComputer::Descriptor;
+
+	// Writes the descriptor with the specified name to the output array or throws std::invalid_argument if the name is not known
+	using Source = std::function<void (const std::string& name, float* descriptor)>;
+
+	SyntheticDescriptorComputer(std::size_t dimension, Source source) noexcept
+		: dimension(dimension)
+		, source(std::move(source)) {}
+
+	explicit SyntheticDescriptorComputer(std::shared_ptr<const SyntheticGallery> gallery)
+		: SyntheticDescriptorComputer(gallery->dimension(), fromGallery(gallery)) {}
+
+	static Source fromGallery(std::shared_ptr<const SyntheticGallery> gallery)
+	{
+		return [gallery = std::move(gallery)](const std::string& name, float* descriptor)
+			{
+				if (name.size() < 2 || (name.front() != 'q' && name.front() != 'g'))
+					throw std::invalid_argument("Not a name of a synthetic descriptor: " + name);
+
+				std::size_t index = std::stoull(name.substr(1));
+				if (name.front() == 'q')
+					gallery->query(index, descriptor);
+				else
+					gallery->descriptor(index, descriptor);
+			};
+	}	// fromGallery
+
+	std::optional<Descriptor> operator()(const std::string& name) const
+	{
+		std::vector<float> data(this->dimension);
+		this->source(name, data.data());
+		return DescriptorData<Descriptor>::make(data.data(), data.size());
+	}
+
+	std::optional<Descriptor> operator()(const std::filesystem::path& name) const
+	{
+		return (*this)(name.string());
+	}
+
+	std::vector<std::optional<Descriptor>> operator()(const std::vector<std::string>& names) const
+	{
+		std::vector<std::optional<Descriptor>> descriptors(names.size());
+		(*this)(names.cbegin(), names.cend(), descriptors.begin());
+		return descriptors;
+	}
+
+	std::vector<std::optional<Descriptor>> operator()(const std::vector<std::filesystem::path>& names) const
+	{
+		std::vector<std::optional<Descriptor>> descriptors(names.size());
+		(*this)(names.cbegin(), names.cend(), descriptors.begin());
+		return descriptors;
+	}
+
+	template <class InputIterator, class OutputIterator>
+	OutputIterator operator()(InputIterator inHead, InputIterator inTail, OutputIterator outHead) const
+	{
+		for (; inHead != inTail; ++inHead, ++outHead)
+			*outHead = (*this)(*inHead);
+
+		return outHead;
+	}
+
+private:
+	std::size_t dimension;
+	Source source;
+};	// SyntheticDescriptorComputer
+
+
+/*
+* DescriptorComputerType specialization borrows the string ID of the imitated descriptor computer.
+*/
+template <class DescriptorComputer>
+struct DescriptorComputerType<SyntheticDescriptorComputer<DescriptorComputer>>
+{
+	static inline const std::string& id = DescriptorComputerType<DescriptorComputer>::id;
+};
+
+#endif	// SYNTHETICDESCRIPTORCOMPUTER_H
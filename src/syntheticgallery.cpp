@@ -0,0 +1,118 @@
+#include "syntheticgallery.h"
+
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+
+
+namespace
+{
+	// SplitMix64 is a tiny generator of good quality which can be seeded by any value, so each descriptor gets its own stream
+	class Random
+	{
+	public:
+		explicit Random(std::uint64_t state) noexcept
+			: state(state) {}
+
+		std::uint64_t next() noexcept
+		{
+			std::uint64_t z = (this->state += 0x9E3779B97F4A7C15ull);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+
+		// A uniform value in (0, 1)
+		double uniform() noexcept
+		{
+			return (static_cast<double>(next() >> 11) + 0.5) * 0x1.0p-53;
+		}
+
+		// A pair of standard normal values by the Box-Muller transform
+		void normal(double& z1, double& z2) noexcept
+		{
+			constexpr double twoPi = 6.283185307179586;
+			double r = std::sqrt(-2 * std::log(uniform())), phi = twoPi * uniform();
+			z1 = r * std::cos(phi);
+			z2 = r * std::sin(phi);
+		}
+
+	private:
+		std::uint64_t state;
+	};	// Random
+
+	std::uint64_t mix(std::uint64_t seed, std::uint64_t stream, std::uint64_t index) noexcept
+	{
+		return Random(Random(seed ^ (stream << 56)).next() ^ index).next();
+	}
+
+	// Fills the array with normal values of the specified standard deviation added to the base values
+	void scatter(Random& random, const float* base, double sigma, float* out, std::size_t n) noexcept
+	{
+		for (std::size_t i = 0; i < n; i += 2)
+		{
+			double z1, z2;
+			random.normal(z1, z2);
+			out[i] = static_cast<float>(base[i] + sigma * z1);
+			if (i + 1 < n)
+				out[i + 1] = static_cast<float>(base[i + 1] + sigma * z2);
+		}
+	}
+
+	// The streams of random values
+	constexpr std::uint64_t centerStream = 1, spreadStream = 2, descriptorStream = 3, queryStream = 4;
+}	// anonymous namespace
+
+
+SyntheticGallery::SyntheticGallery(std::size_t numLabels, std::size_t dimension, std::uint64_t seed, double labelDistance,
+		double sampleDistance)
+	: numLabels(numLabels > 0 ? numLabels : throw std::invalid_argument("The number of labels must be positive."))
+	, dim(dimension > 0 ? dimension : throw std::invalid_argument("The dimension must be positive."))
+	, seed(seed)
+{
+	if (labelDistance <= 0 || sampleDistance <= 0)
+		throw std::invalid_argument("The distances between labels and samples must be positive.");
+
+	// The distance between two random vectors with independent elements of variance s^2 is about s*sqrt(2*dim)
+	double labelSigma = labelDistance / std::sqrt(2.0 * static_cast<double>(dimension));
+	double sampleSigma = sampleDistance / std::sqrt(2.0 * static_cast<double>(dimension));
+
+	const std::vector<float> origin(dimension, 0.0f);
+	this->centers.resize(numLabels * dimension);
+	this->spreads.resize(numLabels);
+	for (std::size_t label = 0; label < numLabels; ++label)
+	{
+		Random centerRandom(mix(seed, centerStream, label));
+		scatter(centerRandom, origin.data(), labelSigma, this->centers.data() + label * dimension, dimension);
+
+		// Some people look much the same in all photos, while others are hard to recognize
+		Random spreadRandom(mix(seed, spreadStream, label));
+		this->spreads[label] = static_cast<float>(sampleSigma * (0.6 + 0.8 * spreadRandom.uniform()));
+	}
+}	// ctor
+
+std::string SyntheticGallery::labelName(std::size_t label)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "s%08zu", label);
+	return name;
+}	// labelName
+
+void SyntheticGallery::descriptor(std::size_t index, float* out) const noexcept
+{
+	sample(descriptorStream, index, out);
+}	// descriptor
+
+void SyntheticGallery::query(std::size_t index, float* out) const noexcept
+{
+	sample(queryStream, index, out);
+}	// query
+
+void SyntheticGallery::sample(std::uint64_t stream, std::size_t index, float* out) const noexcept
+{
+	std::size_t label = labelOf(index);
+	Random random(mix(this->seed, stream, index));
+
+	scatter(random, this->centers.data() + label * this->dim, this->spreads[label], out, this->dim);
+}	// sample
@@ -0,0 +1,58 @@
+#ifndef SYNTHETICGALLERY_H
+#define SYNTHETICGALLERY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/*
+* SyntheticGallery generates random face descriptors clustered by identity, which stand in for real galleries in benchmarks.
+*
+* Every label has a random center, and the descriptors of the label are scattered around it. The spread varies from label to label
+* like it does for real people photographed in different conditions. The expected distance between two centers and between two
+* descriptors of the same label are set on construction; the defaults resemble the descriptors of the ResNet model, for which faces
+* of the same person are typically less than 0.6 apart.
+*
+* A descriptor is a function of the seed and its index, so descriptors can be generated in any order, by multiple threads, and
+* without keeping the gallery in memory. Queries are drawn from the same labels as gallery descriptors, but they are different
+* samples, so a query is never identical to a gallery descriptor.
+*/
+
+class SyntheticGallery
+{
+public:
+
+	SyntheticGallery(std::size_t numLabels, std::size_t dimension = 128, std::uint64_t seed = 0,
+		double labelDistance = 1.0, double sampleDistance = 0.45);
+
+	std::size_t labels() const noexcept { return this->numLabels; }
+
+	std::size_t dimension() const noexcept { return this->dim; }
+
+	// The label of the descriptor or the query with the specified index. Labels are assigned in a round-robin fashion.
+	std::size_t labelOf(std::size_t index) const noexcept { return index % this->numLabels; }
+
+	// The name of the label, e.g. the directory name of a dataset
+	static std::string labelName(std::size_t label);
+
+	// Writes the gallery descriptor with the specified index to the output array of dimension() elements
+	void descriptor(std::size_t index, float* out) const noexcept;
+
+	// Writes the query with the specified index to the output array of dimension() elements
+	void query(std::size_t index, float* out) const noexcept;
+
+private:
+
+	void sample(std::uint64_t stream, std::size_t index, float* out) const noexcept;
+
+	std::size_t numLabels;
+	std::size_t dim;
+	std::uint64_t seed;
+	std::vector<float> centers;		// numLabels x dim
+	std::vector<float> spreads;		// the standard deviation of the elements of the descriptors of each label
+};	// SyntheticGallery
+
+
+#endif	// SYNTHETICGALLERY_H
@@ -0,0 +1,426 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif	// !_WIN32
+
+
+
+namespace
+{
+	thread_local CancellationToken currentToken;
+
+	// The pool whose worker the thread is and the index of the worker
+	thread_local const ThreadPool* currentPool = nullptr;
+	thread_local std::size_t currentWorker = 0;
+
+	std::mutex globalMutex;
+	ThreadPool::Settings globalSettings;
+	std::unique_ptr<ThreadPool> globalPool;
+	std::atomic<ThreadPool*> globalInstance{ nullptr };
+
+	std::size_t getNumWorkers(const ThreadPool::Settings& settings) noexcept
+	{
+		return settings.workers > 0 ? settings.workers : std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+	}
+
+	// Binds the calling thread to the core. It is a hint: it fails silently if the core is not available to the process.
+	void pinThread(std::size_t core) noexcept
+	{
+		core %= std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+#if defined(_WIN32)
+		if (core < sizeof(DWORD_PTR) * 8)
+			SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core);
+#elif defined(__linux__)
+		if (core < CPU_SETSIZE)
+		{
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(core, &cpus);
+			pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		}
+#else
+		static_cast<void>(core);	// not supported
+#endif
+	}	// pinThread
+}	// anonymous namespace
+
+
+bool CancellationToken::isCancelled() const noexcept
+{
+	for (const State* state = this->state.get(); state; state = state->parent.get())
+	{
+		if (state->cancelled.load(std::memory_order_acquire))
+			return true;
+	}
+
+	return false;
+}	// isCancelled
+
+void CancellationToken::cancel() noexcept
+{
+	if (this->state)
+		this->state->cancelled.store(true, std::memory_order_release);
+}	// cancel
+
+CancellationToken CancellationToken::child() const
+{
+	CancellationToken token;
+	token.state = std::make_shared<State>();
+	token.state->parent = this->state;
+	return token;
+}	// child
+
+const CancellationToken& CancellationToken::current() noexcept
+{
+	return currentToken;
+}	// current
+
+CancellationToken::Scope::Scope(CancellationToken token) noexcept
+	: previous(std::exchange(currentToken, std::move(token)))
+{
+}
+
+CancellationToken::Scope::~Scope()
+{
+	currentToken = std::move(this->previous);
+}
+
+
+// The state of a parallel loop is shared with the helper tasks, which may start after the loop has finished. A helper only touches
+// the body after claiming a chunk, and the loop does not return until all claimed chunks are done, so the body is still alive then.
+struct ThreadPool::Loop
+{
+	std::size_t count = 0;
+	std::size_t chunkSize = 1;
+	std::size_t numChunks = 0;
+	const RangeBody* body = nullptr;
+	CancellationToken token;
+
+	std::atomic<std::size_t> next{ 0 };			// the next chunk to claim
+	std::atomic<std::size_t> finished{ 0 };		// the number of finished chunks
+	std::atomic<bool> failed{ false };
+	std::exception_ptr eptr;
+	std::mutex mutex;
+	std::condition_variable done;
+
+	void run()
+	{
+		CancellationToken::Scope scope(this->token);
+		for (std::size_t chunk = this->next++; chunk < this->numChunks; chunk = this->next++)
+		{
+			// The remaining chunks are skipped, but they are counted as finished, so the loop can return
+			if (!this->failed.load(std::memory_order_acquire) && !this->token.isCancelled())
+			{
+				try
+				{
+					(*this->body)(chunk * this->chunkSize, std::min((chunk + 1) * this->chunkSize, this->count));
+				}
+				catch (...)
+				{
+					if (!this->failed.exchange(true, std::memory_order_acq_rel))
+						this->eptr = std::current_exception();
+				}
+			}
+
+			if (++this->finished == this->numChunks)
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->done.notify_all();
+			}
+		}	// chunk
+	}	// run
+};	// Loop
+
+
+ThreadPool::ThreadPool(const Settings& settings)
+	: settings(settings)
+{
+	std::size_t numWorkers = getNumWorkers(settings);
+	for (std::size_t i = 0; i < numWorkers; ++i)
+		this->queues.push_back(std::make_unique<Queue>());
+
+	try
+	{
+		for (std::size_t i = 0; i < numWorkers; ++i)
+			this->threads.emplace_back(&ThreadPool::work, this, i);
+	}
+	catch (...)		// failed to start a thread
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->stopping = true;
+		}
+
+		this->wakeUp.notify_all();
+		for (auto& thread : this->threads)
+			thread.join();
+
+		throw;
+	}
+}	// ThreadPool
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+
+	this->wakeUp.notify_all();
+	for (auto& thread : this->threads)
+		thread.join();
+}	// ~ThreadPool
+
+void ThreadPool::submit(Task task)
+{
+	// A worker keeps its tasks to itself unless others are idle
+	std::size_t index = isWorkerThread() ? currentWorker : this->nextQueue++ % this->queues.size();
+	{
+		std::lock_guard<std::mutex> lock(this->queues[index]->mutex);
+		this->queues[index]->tasks.push_back(std::move(task));
+		++this->queued;
+	}
+
+	// Sleeping workers check the number of queued tasks under the lock, so the notification cannot slip in before they wait
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+	}
+	this->wakeUp.notify_one();
+}	// submit
+
+bool ThreadPool::runPending()
+{
+	Task task;
+	bool found = isWorkerThread() ? pop(currentWorker, task) || steal(currentWorker, task) : steal(this->nextQueue % this->queues.size(), task);
+	if (found)
+		task();
+
+	return found;
+}	// runPending
+
+bool ThreadPool::isWorkerThread() const noexcept
+{
+	return currentPool == this;
+}
+
+void ThreadPool::forRange(std::size_t count, std::size_t grainSize, const RangeBody& body)
+{
+	const CancellationToken& token = CancellationToken::current();
+	if (count == 0 || token.isCancelled())
+		return;
+
+	std::size_t chunkSize = grainSize > 0 ? grainSize : std::max<std::size_t>(count / (4 * (size() + 1)), 1);
+	std::size_t numChunks = (count + chunkSize - 1) / chunkSize;
+	if (numChunks == 1)
+	{
+		body(0, count);
+		return;
+	}
+
+	auto loop = std::make_shared<Loop>();
+	loop->count = count;
+	loop->chunkSize = chunkSize;
+	loop->numChunks = numChunks;
+	loop->body = &body;
+	loop->token = token;
+
+	// The calling thread takes part in the loop, so it needs one helper less than the number of chunks
+	for (std::size_t i = 0, numHelpers = std::min(numChunks - 1, size()); i < numHelpers; ++i)
+	{
+		try
+		{
+			submit([loop] { loop->run(); });
+		}
+		catch (...)
+		{
+			break;	// failed to queue a helper; the chunks are processed by the ones we already have
+		}
+	}
+
+	loop->run();
+
+	{
+		std::unique_lock<std::mutex> lock(loop->mutex);
+		loop->done.wait(lock, [&loop] { return loop->finished == loop->numChunks; });
+	}
+
+	if (loop->eptr)
+		std::rethrow_exception(loop->eptr);
+}	// forRange
+
+ThreadPool& ThreadPool::global()
+{
+	if (ThreadPool* pool = globalInstance.load(std::memory_order_acquire))
+		return *pool;
+
+	std::lock_guard<std::mutex> lock(globalMutex);
+	if (!globalPool)
+	{
+		globalPool = std::make_unique<ThreadPool>(globalSettings);
+		globalInstance.store(globalPool.get(), std::memory_order_release);
+	}
+
+	return *globalPool;
+}	// global
+
+void ThreadPool::configure(const Settings& settings)
+{
+	std::unique_ptr<ThreadPool> pool;
+	{
+		std::lock_guard<std::mutex> lock(globalMutex);
+		globalSettings = settings;
+		globalInstance.store(nullptr, std::memory_order_release);
+		pool = std::move(globalPool);
+	}
+
+	// The workers of the old pool are joined outside of the lock
+}	// configure
+
+std::size_t ThreadPool::globalSize() noexcept
+{
+	if (ThreadPool* pool = globalInstance.load(std::memory_order_acquire))
+		return pool->size();
+
+	std::lock_guard<std::mutex> lock(globalMutex);
+	return getNumWorkers(globalSettings);
+}	// globalSize
+
+void ThreadPool::work(std::size_t index)
+{
+	currentPool = this;
+	currentWorker = index;
+	if (this->settings.pinWorkers)
+		pinThread(this->settings.firstCore + index);
+
+	for (Task task;;)
+	{
+		if (pop(index, task) || steal(index, task))
+		{
+			task();		// tasks of loops and task groups catch their exceptions
+			task = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->wakeUp.wait(lock, [this] { return this->queued > 0 || this->stopping; });
+		if (this->stopping && this->queued == 0)
+			break;
+	}	// task
+}	// work
+
+bool ThreadPool::pop(std::size_t index, Task& task)
+{
+	Queue& queue = *this->queues[index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+		return false;
+
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	--this->queued;
+	return true;
+}	// pop
+
+bool ThreadPool::steal(std::size_t thief, Task& task)
+{
+	for (std::size_t i = 1; i <= this->queues.size(); ++i)
+	{
+		Queue& queue = *this->queues[(thief + i) % this->queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			--this->queued;
+			return true;
+		}
+	}	// i
+
+	return false;
+}	// steal
+
+
+TaskGroup::TaskGroup(ThreadPool& pool)
+	: pool(pool)
+	, state(std::make_shared<State>())
+{
+	this->state->token = CancellationToken::current().child();
+}
+
+TaskGroup::~TaskGroup()
+{
+	cancel();
+	try
+	{
+		wait();
+	}
+	catch (...)
+	{
+		// the exception has not been asked for
+	}
+}	// ~TaskGroup
+
+void TaskGroup::run(ThreadPool::Task task)
+{
+	++this->state->pending;
+	try
+	{
+		this->pool.submit([state = this->state, task = std::move(task)]
+			{
+				if (!state->token.isCancelled())
+				{
+					CancellationToken::Scope scope(state->token);
+					try
+					{
+						task();
+					}
+					catch (...)
+					{
+						if (!state->failed.exchange(true, std::memory_order_acq_rel))
+							state->eptr = std::current_exception();
+						state->token.cancel();
+					}
+				}	// not cancelled
+
+				if (--state->pending == 0)
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->done.notify_all();
+				}
+			});
+	}	// try
+	catch (...)
+	{
+		--this->state->pending;
+		throw;
+	}
+}	// run
+
+void TaskGroup::wait()
+{
+	bool isWorker = this->pool.isWorkerThread();
+	while (this->state->pending > 0)
+	{
+		// A waiting worker may be the only one able to run the tasks of the group
+		if (isWorker && this->pool.runPending())
+			continue;
+
+		std::unique_lock<std::mutex> lock(this->state->mutex);
+		if (isWorker)	// new tasks may be queued meanwhile
+			this->state->done.wait_for(lock, std::chrono::milliseconds(1), [this] { return this->state->pending == 0; });
+		else
+			this->state->done.wait(lock, [this] { return this->state->pending == 0; });
+	}	// pending
+
+	if (this->state->eptr)
+		std::rethrow_exception(std::exchange(this->state->eptr, nullptr));
+}	// wait
@@ -0,0 +1,212 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/*
+* CancellationToken is the cancellation state shared by the tasks of a task group and by the parallel loops they run. A token made
+* by child() is cancelled along with its parent, so cancelling a group stops the work it has spawned at any depth.
+*
+* Every thread has a current token: the one of the task it is running. Parallel loops pass it on to the threads which run their
+* chunks and stop taking new chunks once it has been cancelled.
+*/
+
+class CancellationToken
+{
+public:
+
+	// A token which is never cancelled
+	CancellationToken() = default;
+
+	bool isCancelled() const noexcept;
+
+	void cancel() noexcept;
+
+	// A new token which is cancelled when this one is
+	CancellationToken child() const;
+
+	// The token of the task run by the calling thread
+	static const CancellationToken& current() noexcept;
+
+	// Makes the token current for the calling thread while the scope exists
+	class Scope;
+
+private:
+
+	struct State
+	{
+		std::atomic<bool> cancelled{ false };
+		std::shared_ptr<const State> parent;
+	};
+
+	std::shared_ptr<State> state;
+};	// CancellationToken
+
+
+class CancellationToken::Scope
+{
+public:
+	explicit Scope(CancellationToken token) noexcept;
+	~Scope();
+
+	Scope(const Scope&) = delete;
+	Scope& operator = (const Scope&) = delete;
+
+private:
+	CancellationToken previous;
+};	// Scope
+
+
+/*
+* ThreadPool is a work-stealing executor, which runs the parallel computations of the program instead of the standard parallel
+* algorithms. Unlike those, it lets us choose the number of threads (e.g. to leave cores for other services), pin them to cores,
+* and cancel groups of tasks.
+*
+* Every worker has its own deque of tasks. A task submitted by a worker is pushed to the back of its deque, and the worker takes
+* tasks from the back, so nested work stays on the same core while its data is in the cache. Idle workers steal from the front
+* of the deques of others, i.e. they take the oldest and usually the largest pieces of work. Tasks submitted by other threads are
+* distributed among the deques in turn.
+*
+* Parallel loops (see parallel.h) split a range into chunks claimed by the calling thread and by helper tasks. Since the caller takes
+* part in the loop and only waits for chunks which are already running, nested loops neither deadlock nor spawn extra threads:
+* a loop run by a worker of an outer loop shares the same workers.
+*
+* The global pool is created on first use. Its settings can be changed by configure() before any parallel work starts.
+*/
+
+class ThreadPool
+{
+public:
+
+	using Task = std::function<void ()>;
+
+	// Called with the first and the last index of a chunk
+	using RangeBody = std::function<void (std::size_t first, std::size_t last)>;
+
+	struct Settings
+	{
+		std::size_t workers = 0;		// the number of worker threads (the number of hardware threads if zero)
+		bool pinWorkers = false;		// bind each worker to its own core
+		std::size_t firstCore = 0;		// the core of the first worker when pinning; the others take the following cores
+	};
+
+	ThreadPool() : ThreadPool(Settings()) {}
+
+	explicit ThreadPool(const Settings& settings);
+
+	// Runs the queued tasks and joins the workers
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator = (const ThreadPool&) = delete;
+
+	std::size_t size() const noexcept { return this->threads.size(); }
+
+	void submit(Task task);
+
+	// Runs a queued task on the calling thread if there is one. Workers take tasks from their own deque first.
+	bool runPending();
+
+	// True if the calling thread is a worker of this pool
+	bool isWorkerThread() const noexcept;
+
+	// Calls the body for consecutive chunks of [0, count) in parallel and returns when all of them are done. The chunks have the grain
+	// size or, if it is zero, a size giving every thread several chunks. The first exception thrown by the body stops the loop and is
+	// rethrown. The loop also stops, without an exception, if the current cancellation token is cancelled.
+	void forRange(std::size_t count, std::size_t grainSize, const RangeBody& body);
+
+	// The pool used by parallel algorithms
+	static ThreadPool& global();
+
+	// Replaces the global pool. It must not be called while parallel work is in progress.
+	static void configure(const Settings& settings);
+
+	// The number of workers of the global pool without creating it
+	static std::size_t globalSize() noexcept;
+
+private:
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	struct Loop;
+
+	void work(std::size_t index);
+
+	bool pop(std::size_t index, Task& task);
+
+	bool steal(std::size_t thief, Task& task);
+
+	Settings settings;
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+	std::atomic<std::size_t> nextQueue{ 0 };	// the deque the next task from outside goes to
+
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	std::atomic<std::size_t> queued{ 0 };		// never exceeds the number of tasks in the deques
+	bool stopping = false;
+};	// ThreadPool
+
+
+/*
+* TaskGroup runs a set of tasks on the pool and waits for them. The first exception thrown by a task cancels the group and is rethrown
+* by wait(). When the group is cancelled, the tasks which have not started yet are skipped, and parallel loops run by the started ones
+* stop taking new chunks; a long task may also check isCancelled() itself. A group created by a task is cancelled along with the group
+* of that task.
+*
+* A worker of the pool waiting for a group runs other queued tasks meanwhile, so groups can be nested.
+*/
+
+class TaskGroup
+{
+public:
+
+	explicit TaskGroup(ThreadPool& pool = ThreadPool::global());
+
+	// Cancels the tasks which have not finished and waits for the running ones
+	~TaskGroup();
+
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator = (const TaskGroup&) = delete;
+
+	void run(ThreadPool::Task task);
+
+	void wait();
+
+	void cancel() noexcept { this->state->token.cancel(); }
+
+	bool isCancelled() const noexcept { return this->state->token.isCancelled(); }
+
+private:
+
+	struct State
+	{
+		CancellationToken token;
+		std::atomic<std::size_t> pending{ 0 };
+		std::mutex mutex;
+		std::condition_variable done;
+		std::atomic<bool> failed{ false };
+		std::exception_ptr eptr;
+	};
+
+	ThreadPool& pool;
+	std::shared_ptr<State> state;
+};	// TaskGroup
+
+
+#endif	// THREADPOOL_H
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Compares two result files written by doppelganger_bench, e.g. for the commits before and after a change.
+
+For each benchmark present in both files, the median times and the change are printed. A negative change is a speedup.
+Changes smaller than the threshold are not highlighted, since they are usually within the noise of the measurements.
+
+Example:
+    python3 doppelganger_benchcmp.py baseline.json doppelganger_bench.json --threshold=5
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        results = json.load(f)
+    benchmarks = {b["name"]: b for b in results["benchmarks"] if "skipped" not in b}
+    return results["context"], benchmarks
+
+
+def format_time(nanoseconds):
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if nanoseconds >= scale:
+            return "%.2f %s" % (nanoseconds / scale, unit)
+    return "%.2f ns" % nanoseconds
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline", help="the results to compare against")
+    parser.add_argument("contender", help="the new results")
+    parser.add_argument("--threshold", type=float, default=5.0, help="the change in percent worth noting (5 by default)")
+    args = parser.parse_args()
+
+    baseline_context, baseline = load(args.baseline)
+    contender_context, contender = load(args.contender)
+    print("Baseline:  %s (%s)" % (baseline_context.get("label") or args.baseline, baseline_context.get("date", "")))
+    print("Contender: %s (%s)" % (contender_context.get("label") or args.contender, contender_context.get("date", "")))
+    print("%-32s %14s %14s %10s" % ("Benchmark", "Baseline", "Contender", "Change"))
+
+    regressions = 0
+    for name, old in baseline.items():
+        new = contender.get(name)
+        if new is None:
+            continue
+        change = 100.0 * (new["median_ns"] - old["median_ns"]) / old["median_ns"]
+        note = ""
+        if change >= args.threshold:
+            note = "  slower"
+            regressions += 1
+        elif change <= -args.threshold:
+            note = "  faster"
+        print("%-32s %14s %14s %+9.1f%%%s" % (name, format_time(old["median_ns"]), format_time(new["median_ns"]), change, note))
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Sends queries to a Doppelganger server started with --serve and prints the responses.
+
+The server address is a port number on localhost or a Unix domain socket path, the same as passed to --serve.
+
+Example:
+    python3 doppelganger_client.py 8080 ../test/sofia-solares.jpg --top=5
+    python3 doppelganger_client.py /tmp/doppelganger.sock ../test/*.jpg
+"""
+
+import argparse
+import http.client
+import json
+import os
+import socket
+import sys
+
+
+class UnixHTTPConnection(http.client.HTTPConnection):
+    """An HTTP connection over a Unix domain socket."""
+
+    def __init__(self, path, timeout=60):
+        super().__init__("localhost", timeout=timeout)
+        self.path = path
+
+    def connect(self):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.settimeout(self.timeout)
+        self.sock.connect(self.path)
+
+
+def connect(address, timeout=60):
+    """Opens a connection to the server, which can be reused for multiple requests."""
+    if address.isdigit():
+        return http.client.HTTPConnection("127.0.0.1", int(address), timeout=timeout)
+    return UnixHTTPConnection(address, timeout=timeout)
+
+
+def request(connection, method, path, body=None):
+    """Sends a request and returns the status and the decoded JSON response."""
+    headers = {"Content-Type": "application/json"} if body is not None else {}
+    connection.request(method, path, body=None if body is None else json.dumps(body), headers=headers)
+    response = connection.getresponse()
+    return response.status, json.loads(response.read())
+
+
+def query(connection, image, top=None, unique=None):
+    """Asks the server to identify the person in the image file. The path is made absolute, since the server reads the file."""
+    body = {"image": os.path.abspath(image)}
+    if top is not None:
+        body["top"] = top
+    if unique is not None:
+        body["unique"] = unique
+    return request(connection, "POST", "/query", body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("address", help="the port number or the Unix domain socket path of the server")
+    parser.add_argument("images", nargs="*", help="image files to query (the health of the server is checked if none)")
+    parser.add_argument("--top", type=int, help="the number of best matches to list")
+    parser.add_argument("--unique", action="store_true", default=None, help="list at most one match for each label")
+    args = parser.parse_args()
+
+    connection = connect(args.address)
+    failed = False
+    try:
+        if not args.images:
+            status, response = request(connection, "GET", "/health")
+            print(json.dumps(response))
+            failed = status != 200
+
+        for image in args.images:
+            status, response = query(connection, image, args.top, args.unique)
+            print(json.dumps(response))
+            failed = failed or status != 200
+    finally:
+        connection.close()
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
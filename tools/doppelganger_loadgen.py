@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Generates load on a Doppelganger server started with --serve and reports throughput and latency.
+
+A number of concurrent clients send queries for the given image files in a round-robin fashion over their own keep-alive
+connections. At the end, the throughput, latency percentiles, and the number of failed requests are printed.
+
+Example:
+    python3 doppelganger_loadgen.py 8080 ../test/*.jpg --clients=8 --requests=1000
+"""
+
+import argparse
+import sys
+import threading
+import time
+
+from doppelganger_client import connect, query
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return float("nan")
+    index = min(int(round(p / 100.0 * (len(sorted_values) - 1))), len(sorted_values) - 1)
+    return sorted_values[index]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("address", help="the port number or the Unix domain socket path of the server")
+    parser.add_argument("images", nargs="+", help="image files to query")
+    parser.add_argument("--clients", type=int, default=4, help="the number of concurrent clients (4 by default)")
+    parser.add_argument("--requests", type=int, default=100, help="the total number of requests (100 by default)")
+    parser.add_argument("--top", type=int, help="the number of best matches requested")
+    args = parser.parse_args()
+
+    if args.clients <= 0 or args.requests <= 0:
+        parser.error("the number of clients and requests must be positive")
+
+    lock = threading.Lock()
+    latencies = []
+    failures = []
+    next_request = [0]
+
+    def run_client():
+        connection = connect(args.address)
+        try:
+            while True:
+                with lock:
+                    i = next_request[0]
+                    if i >= args.requests:
+                        return
+                    next_request[0] += 1
+
+                start = time.perf_counter()
+                try:
+                    status, response = query(connection, args.images[i % len(args.images)], args.top)
+                    error = None if status == 200 else response.get("error", "HTTP status %d" % status)
+                except Exception as e:  # the connection is reopened on the next request
+                    connection.close()
+                    error = str(e)
+                elapsed = time.perf_counter() - start
+
+                with lock:
+                    latencies.append(elapsed)
+                    if error is not None:
+                        failures.append(error)
+        finally:
+            connection.close()
+
+    clients = [threading.Thread(target=run_client) for _ in range(args.clients)]
+    start = time.perf_counter()
+    for client in clients:
+        client.start()
+    for client in clients:
+        client.join()
+    elapsed = time.perf_counter() - start
+
+    latencies.sort()
+    print("Requests: %d, failed: %d, clients: %d" % (len(latencies), len(failures), args.clients))
+    print("Throughput: %.1f queries/s" % (len(latencies) / elapsed))
+    print("Latency (ms): mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f" % (
+        1000 * sum(latencies) / len(latencies), 1000 * percentile(latencies, 50), 1000 * percentile(latencies, 90),
+        1000 * percentile(latencies, 99), 1000 * latencies[-1]))
+    for error in sorted(set(failures))[:10]:
+        print("Error: " + error)
+
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())